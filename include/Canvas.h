@@ -1,22 +1,34 @@
 #pragma once
 
-// This file defines the Canvas onto which UIBox classes draw.
+// This file defines the Canvas onto which UIBox classes draw,
+// as well as the DrawList for recording drawing to be done on another thread.
 
 #include "UICommon.h"
 
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Box.h>
 #include <Vec.h>
 #include <Types.h>
 
+#include <atomic>
 #include <memory>
 
 OUTER_NAMESPACE_BEGIN
 UICOMMON_LIBRARY_NAMESPACE_BEGIN
 
+// Copies of an Image share the pixel data until either is written to,
+// so a DrawList can keep an Image's pixels alive and unchanged, even if
+// the original Image is modified or destroyed while the DrawList is in use.
 class Image {
-	std::unique_ptr<Vec4f[]> pixels_;
+	std::shared_ptr<Vec4f[]> pixels_;
 	Vec2<size_t> size_;
 public:
 	INLINE Image() : pixels_(nullptr), size_(0,0) {}
+	Image(const Image&) = default;
+	Image(Image&&) = default;
+	Image& operator=(const Image&) = default;
+	Image& operator=(Image&&) = default;
 
 	INLINE const Vec2<size_t>& size() const {
 		return size_;
@@ -25,7 +37,9 @@ public:
 	inline void setSize(size_t width, size_t height) {
 		size_t newNumPixels = width*height;
 		size_t oldNumPixels = (pixels_.get() != nullptr) ? (size_[0]*size_[1]) : 0;
-		if (newNumPixels != oldNumPixels) {
+		// Pixel data shared with another Image can't be reused, since the
+		// other Image still expects it to be unchanged.
+		if (newNumPixels != oldNumPixels || pixels_.use_count() > 1) {
 			if (newNumPixels == 0) {
 				pixels_.reset();
 			}
@@ -38,6 +52,13 @@ public:
 	}
 
 	INLINE Vec4f* pixels() {
+		// Pixel data shared with another Image, e.g. one in a DrawList being
+		// drawn on another thread, must not be modified, so copy it first.
+		// Only the owner of this Image can add references, so if the count
+		// is 1, it can't become shared while this Image is being written.
+		if (pixels_.use_count() > 1) {
+			makeUnique();
+		}
 		return pixels_.get();
 	}
 	INLINE const Vec4f* pixels() const {
@@ -76,11 +97,159 @@ public:
 
 	UICOMMON_LIBRARY_EXPORTED void applyRectangle(const Box2f& rectangle, const Vec4f& colour);
 	UICOMMON_LIBRARY_EXPORTED void applyImage(const Box2f& destRectangle, const Image& srcImage, const Box2f& srcRectangle);
+
+	// Moves the pixels in srcRectangle so that its min is at destMin,
+	// like memmove, so the source and destination may overlap.
+	// Both rectangles are clipped to the image.
+	UICOMMON_LIBRARY_EXPORTED void moveRectangle(const Box2<size_t>& srcRectangle, const Vec2<size_t>& destMin);
+
+	// Copies the pixels in rectangle from srcImage, which must be the same size.
+	UICOMMON_LIBRARY_EXPORTED void copyRectangle(const Image& srcImage, const Box2<size_t>& rectangle);
+
+private:
+	UICOMMON_LIBRARY_EXPORTED void makeUnique();
+};
+
+struct DrawCommand {
+	enum class Type : uint32 {
+		RECTANGLE,
+		IMAGE,
+
+		// Moves the pixels of srcRectangle of the target to destRectangle,
+		// which is the same size, with both in whole pixels.
+		MOVE
+	};
+	Type type;
+
+	// Index into DrawList::images of the source image, if type is IMAGE.
+	uint32 imageIndex;
+
+	Box2f destRectangle;
+
+	// Rectangle of the source image, if type is IMAGE,
+	// or of the target, if type is MOVE.
+	Box2f srcRectangle;
+
+	// Colour of the rectangle, if type is RECTANGLE.
+	Vec4f colour;
+};
+
+// A DrawList records everything drawn to a Canvas for a frame, so that the
+// UI thread can walk the UIBox tree while the draw thread draws a previous
+// frame.  Once recorded, a DrawList doesn't refer to any UIBox, so the UI
+// thread can freely modify or destroy UIBox objects while it's being drawn.
+class DrawList {
+public:
+	Array<DrawCommand> commands;
+
+	// Copies of the images drawn by IMAGE commands, sharing pixel data.
+	Array<Image> images;
+
+	// Size of the canvas this is to be drawn onto.
+	Vec2<size_t> size;
+
+	// If this is true, the commands only draw damageRectangles, (and move
+	// pixels into them), on top of the previous frame, instead of drawing
+	// the whole frame, so it must be drawn onto an image with the contents
+	// of the previous frame.
+	bool isPartial;
+
+	// Pixel rectangles that the commands change, so that only these need to be
+	// updated in other images, converted, and presented.  If isPartial is
+	// false, this is the whole frame.
+	Array<Box2<size_t>> damageRectangles;
+
+	// Performance counter value of the earliest input event whose effects
+	// were first recorded in this frame, or 0 if none.  This is atomic, because
+	// the UI thread may update it if the previous frame was dropped.
+	std::atomic<uint64> inputEventTime;
+
+	DrawList() : size(0,0), isPartial(false), inputEventTime(0) {}
+
+	inline void clear() {
+		commands.setSize(0);
+		images.setSize(0);
+		isPartial = false;
+		damageRectangles.setSize(0);
+		inputEventTime.store(0, std::memory_order_relaxed);
+	}
+
+	inline void addRectangle(const Box2f& rectangle, const Vec4f& colour) {
+		if (colour[3] <= 0) {
+			// Fully transparent colour, so nothing to record.
+			return;
+		}
+		DrawCommand command;
+		command.type = DrawCommand::Type::RECTANGLE;
+		command.imageIndex = 0;
+		command.destRectangle = rectangle;
+		command.colour = colour;
+		commands.append(command);
+	}
+
+	inline void addImage(const Box2f& destRectangle, const Image& srcImage, const Box2f& srcRectangle) {
+		// NOTE: srcImage is const, so this doesn't copy shared pixel data.
+		const Vec4f* srcPixels = srcImage.pixels();
+		if (srcPixels == nullptr) {
+			return;
+		}
+		DrawCommand command;
+		command.type = DrawCommand::Type::IMAGE;
+		// Avoid adding another reference if the same image was just drawn.
+		if (images.size() == 0 || static_cast<const Image&>(images.last()).pixels() != srcPixels) {
+			images.append(srcImage);
+		}
+		command.imageIndex = uint32(images.size()-1);
+		command.destRectangle = destRectangle;
+		command.srcRectangle = srcRectangle;
+		commands.append(command);
+	}
+
+	inline void addMove(const Box2<size_t>& srcRectangle, const Vec2<size_t>& destMin) {
+		DrawCommand command;
+		command.type = DrawCommand::Type::MOVE;
+		command.imageIndex = 0;
+		command.srcRectangle = Box2f(
+			Vec2f(float(srcRectangle[0][0]), float(srcRectangle[1][0])),
+			Vec2f(float(srcRectangle[0][1]), float(srcRectangle[1][1]))
+		);
+		command.destRectangle = Box2f(
+			Vec2f(float(destMin[0]), float(destMin[1])),
+			Vec2f(float(destMin[0] + srcRectangle[0][1] - srcRectangle[0][0]), float(destMin[1] + srcRectangle[1][1] - srcRectangle[1][0]))
+		);
+		command.colour = Vec4f(0,0,0,0);
+		commands.append(command);
+	}
+
+	// Draws all of the recorded commands onto target, in order.
+	UICOMMON_LIBRARY_EXPORTED void draw(Image& target) const;
 };
 
 class Canvas {
 public:
 	Image image;
+
+	// If this is non-null, drawing is recorded into drawList,
+	// instead of being drawn onto image.
+	DrawList* drawList = nullptr;
+
+	inline void applyRectangle(const Box2f& rectangle, const Vec4f& colour) {
+		if (drawList != nullptr) {
+			drawList->addRectangle(rectangle, colour);
+		}
+		else {
+			image.applyRectangle(rectangle, colour);
+		}
+	}
+
+	inline void applyImage(const Box2f& destRectangle, const Image& srcImage, const Box2f& srcRectangle) {
+		if (drawList != nullptr) {
+			drawList->addImage(destRectangle, srcImage, srcRectangle);
+		}
+		else {
+			image.applyImage(destRectangle, srcImage, srcRectangle);
+		}
+	}
 };
 
 UICOMMON_LIBRARY_NAMESPACE_END
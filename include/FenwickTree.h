@@ -0,0 +1,151 @@
+#pragma once
+
+// This file defines FenwickTree, (also known as a binary indexed tree),
+// for maintaining prefix sums of an array of values, e.g. the offsets of
+// rows with varying heights, with O(log n) updates and lookups.
+
+#include "UICommon.h"
+
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Types.h>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+template<typename T>
+class FenwickTree {
+	// tree[i-1] is the sum of the values in the index range (i - lowBit(i), i],
+	// using one-based indices, where lowBit(i) is the lowest set bit of i.
+	Array<T> tree;
+
+	static INLINE size_t lowBit(size_t i) {
+		return i & (~i + 1);
+	}
+
+public:
+	INLINE size_t size() const {
+		return tree.size();
+	}
+
+	// Replaces the contents with the values, in O(n) time.
+	void build(const T* values, size_t n) {
+		tree.setSize(n);
+		for (size_t i = 0; i < n; ++i) {
+			tree[i] = values[i];
+		}
+		for (size_t i = 1; i <= n; ++i) {
+			const size_t parent = i + lowBit(i);
+			if (parent <= n) {
+				tree[parent-1] += tree[i-1];
+			}
+		}
+	}
+
+	// Replaces the contents with n copies of value, in O(n) time.
+	void buildUniform(size_t n, const T& value) {
+		tree.setSize(n);
+		for (size_t i = 1; i <= n; ++i) {
+			tree[i-1] = value*T(lowBit(i));
+		}
+	}
+
+	void clear() {
+		tree.setSize(0);
+	}
+
+	// Replaces the values from index begin to the end with the n values,
+	// in O(size() - begin + log(size())^2) time, e.g. after inserting or
+	// removing values after begin.
+	void replaceFrom(size_t begin, const T* values, size_t n) {
+		assert(begin <= tree.size());
+		const size_t newSize = begin + n;
+		tree.setSize(newSize);
+		for (size_t i = begin+1; i <= newSize; ++i) {
+			tree[i-1] = values[i-1-begin];
+		}
+		// Like in build, but each node after begin only gets the sums of its
+		// children after begin, so it has the sum of (max(i - lowBit(i), begin), i].
+		for (size_t i = begin+1; i <= newSize; ++i) {
+			const size_t parent = i + lowBit(i);
+			if (parent <= newSize) {
+				tree[parent-1] += tree[i-1];
+			}
+		}
+		// The few nodes covering values before begin still need the sum
+		// of those values, which are unchanged, so prefixSum can find them.
+		const T beginSum = prefixSum(begin);
+		for (size_t i = begin+1; i <= newSize; ++i) {
+			const size_t coveredBegin = i - lowBit(i);
+			if (coveredBegin < begin) {
+				tree[i-1] += beginSum - prefixSum(coveredBegin);
+			}
+		}
+	}
+
+	// Adds value to the end, in O(log n) time.
+	void append(const T& value) {
+		const size_t i = tree.size() + 1;
+		// The new node covers (i - lowBit(i), i], so it needs the sum of the
+		// existing values in (i - lowBit(i), i-1], as well as the new value.
+		const T sum = value + prefixSum(i-1) - prefixSum(i - lowBit(i));
+		tree.append(sum);
+	}
+
+	// Removes the last n values, in O(1) time.
+	void removeLast(size_t n) {
+		assert(n <= tree.size());
+		tree.setSize(tree.size() - n);
+	}
+
+	// Adds delta to the value at index.
+	void add(size_t index, const T& delta) {
+		const size_t n = tree.size();
+		assert(index < n);
+		for (size_t i = index+1; i <= n; i += lowBit(i)) {
+			tree[i-1] += delta;
+		}
+	}
+
+	// Returns the sum of the values at indices less than end.
+	T prefixSum(size_t end) const {
+		assert(end <= tree.size());
+		T sum = T(0);
+		for (size_t i = end; i > 0; i -= lowBit(i)) {
+			sum += tree[i-1];
+		}
+		return sum;
+	}
+
+	INLINE T total() const {
+		return prefixSum(tree.size());
+	}
+
+	// Returns the value at index, in O(log n) time.
+	T get(size_t index) const {
+		return prefixSum(index+1) - prefixSum(index);
+	}
+
+	// Returns the index of the value containing target, i.e. the largest
+	// index such that prefixSum(index) <= target, assuming that all values
+	// are non-negative.  If target is at least the total, this returns size().
+	size_t findIndex(T target) const {
+		const size_t n = tree.size();
+		size_t step = 1;
+		while (2*step <= n) {
+			step *= 2;
+		}
+		size_t position = 0;
+		for (; step != 0; step /= 2) {
+			const size_t next = position + step;
+			if (next <= n && !(target < tree[next-1])) {
+				position = next;
+				target -= tree[next-1];
+			}
+		}
+		return position;
+	}
+};
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
@@ -0,0 +1,98 @@
+#pragma once
+
+// This file defines structures for recording statistics about drawn frames,
+// such as the latency from an input event to the frame showing its effect.
+
+#include "UICommon.h"
+
+#include <Types.h>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+// Histogram of latencies with power-of-two bucket boundaries in microseconds.
+// Bucket 0 counts latencies below 1us, and bucket i (i > 0) counts latencies
+// in [2^(i-1), 2^i) microseconds, with the last bucket also counting
+// anything larger.
+struct LatencyHistogram {
+	constexpr static size_t NUM_BUCKETS = 32;
+
+	uint64 buckets[NUM_BUCKETS];
+	uint64 count;
+	uint64 totalMicroseconds;
+	uint64 maxMicroseconds;
+
+	LatencyHistogram() {
+		clear();
+	}
+
+	inline void clear() {
+		for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+			buckets[i] = 0;
+		}
+		count = 0;
+		totalMicroseconds = 0;
+		maxMicroseconds = 0;
+	}
+
+	inline void record(uint64 microseconds) {
+		size_t bucket = 0;
+		while (bucket < NUM_BUCKETS-1 && (microseconds >> bucket) != 0) {
+			++bucket;
+		}
+		++buckets[bucket];
+		++count;
+		totalMicroseconds += microseconds;
+		if (microseconds > maxMicroseconds) {
+			maxMicroseconds = microseconds;
+		}
+	}
+
+	// Returns the upper boundary of the bucket containing the given fraction
+	// of all recorded latencies, e.g. 0.99 for the 99th percentile.
+	// This is only accurate to within a factor of 2, because of the bucket sizes.
+	inline uint64 percentileUpperBound(double fraction) const {
+		if (count == 0) {
+			return 0;
+		}
+		const uint64 target = uint64(fraction*count);
+		uint64 total = 0;
+		for (size_t i = 0; i < NUM_BUCKETS-1; ++i) {
+			total += buckets[i];
+			if (total > target) {
+				return uint64(1) << i;
+			}
+		}
+		return maxMicroseconds;
+	}
+
+	inline uint64 averageMicroseconds() const {
+		return (count == 0) ? 0 : (totalMicroseconds / count);
+	}
+};
+
+// Latencies of the stages between receiving an input event that called
+// setNeedRedraw and the window surface containing its effect being presented.
+// Frames drawn without any pending input event only contribute to
+// drawStartToPresent.
+struct FrameLatencyStats {
+	// From the UI thread receiving the earliest input event handled in a frame,
+	// to the draw thread starting to draw that frame.
+	LatencyHistogram inputToDrawStart;
+
+	// From the draw thread starting to draw a frame, to the frame being presented.
+	LatencyHistogram drawStartToPresent;
+
+	// From the UI thread receiving the earliest input event handled in a frame,
+	// to the frame being presented.
+	LatencyHistogram inputToPresent;
+
+	uint64 numFramesPresented = 0;
+
+	// Frames that were recorded or drawn, but replaced by a newer frame
+	// before being presented, because a later stage was still busy.
+	uint64 numFramesDropped = 0;
+};
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
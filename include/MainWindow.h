@@ -3,6 +3,7 @@
 // This file defines the MainWindow class for UIContainer objects
 // that correspond with operating system windows, as well as related functions.
 
+#include "FrameStats.h"
 #include "UIBox.h"
 #include "UICommon.h"
 
@@ -47,8 +48,38 @@ UICOMMON_LIBRARY_EXPORTED void UILoop();
 // Pass nullptr to clear the keyboard focus.
 UICOMMON_LIBRARY_EXPORTED void setKeyFocus(const UIBox* box);
 
+// Marks the UI as changed, so that the UI thread records a new frame after
+// handling the current batch of events, and wakes up the draw thread to draw
+// it, limited by the target frame rate.  Multiple calls are coalesced.
+// If called from a thread other than the UI thread, this wakes up the UI thread.
 UICOMMON_LIBRARY_EXPORTED void setNeedRedraw();
 
+// The following are only to be called from the UI thread, for when only part
+// of the window changed, so that only that part is redrawn, converted,
+// and presented, instead of the whole window, as with setNeedRedraw.
+
+// Marks rectangle, in main window coordinates, as needing to be redrawn.
+UICOMMON_LIBRARY_EXPORTED void invalidateRectangle(const Box2f& rectangle);
+
+// Marks the visible part of box as needing to be redrawn.
+UICOMMON_LIBRARY_EXPORTED void invalidateBox(const UIBox& box);
+
+// Indicates that the contents of box moved by offset, so that the pixels
+// still visible can be moved instead of redrawn, and only the newly exposed
+// strips are redrawn.  Nothing may overlap box, since the moved pixels
+// include anything drawn over it.  If offset isn't whole pixels, the whole
+// box is redrawn instead.
+UICOMMON_LIBRARY_EXPORTED void scrollBoxContents(const UIBox& box, const Vec2f& offset);
+
+// Sets the maximum rate at which frames will be drawn, (60 by default).
+// Pass 0 to draw as soon as anything changes, without any limit.
+UICOMMON_LIBRARY_EXPORTED void setTargetFrameRate(float framesPerSecond);
+
+// Copies the input-to-photon latency statistics recorded since UIInit
+// or the last call to resetFrameLatencyStats.
+UICOMMON_LIBRARY_EXPORTED void getFrameLatencyStats(FrameLatencyStats& stats);
+UICOMMON_LIBRARY_EXPORTED void resetFrameLatencyStats();
+
 class UIExitListener {
 public:
 	// This is an opportunity for anything needing cleanup before the
@@ -0,0 +1,117 @@
+#pragma once
+
+// This file defines accelerator tables, for keyboard shortcuts like Ctrl+S,
+// that containers register to handle key presses while they're on the path
+// of keyboard focus, (see UIContainer::keyFocusIndex).  The tables of all
+// containers on the path are compiled into one hash table when the path
+// changes, so that a key press is resolved with a single lookup,
+// without walking every handler.
+//
+// These are only to be used from the UI thread.
+
+#include "UICommon.h"
+
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Types.h>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+struct UIContainer;
+
+// Modifier bits, which don't distinguish between left and right keys.
+constexpr static uint32 KEY_MODIFIER_SHIFT = 1;
+constexpr static uint32 KEY_MODIFIER_CTRL = 2;
+constexpr static uint32 KEY_MODIFIER_ALT = 4;
+constexpr static uint32 KEY_MODIFIER_GUI = 8;
+
+struct UIAccelerator {
+	// Key code, as passed to onKeyDown.  0 is never a valid key,
+	// so it marks empty slots.
+	size_t key;
+	uint32 modifiers;
+
+	// Returns true if the key press was handled, else the key press is
+	// passed on to onKeyDown, as if there were no accelerator.
+	bool (*action)(UIContainer& container, void* data);
+	void* data;
+
+	// Container whose table this came from.  This is only set in the
+	// compiled table for the focus path.
+	UIContainer* container;
+};
+
+// Hash table of accelerators, using open addressing with linear probing.
+class UIAcceleratorTable {
+	Array<UIAccelerator> slots;
+	size_t count;
+
+	static INLINE size_t hash(size_t key, uint32 modifiers) {
+		// Fibonacci hashing, so that consecutive keys are spread out.
+		const uint64 combined = (uint64(key) << 4) ^ modifiers;
+		return size_t((combined * 0x9E3779B97F4A7C15ULL) >> 32);
+	}
+
+	void grow();
+
+public:
+	UIAcceleratorTable() : count(0) {}
+
+	INLINE size_t size() const {
+		return count;
+	}
+
+	// Adds an accelerator, replacing any with the same key and modifiers.
+	UICOMMON_LIBRARY_EXPORTED void add(const UIAccelerator& accelerator);
+	UICOMMON_LIBRARY_EXPORTED void add(size_t key, uint32 modifiers, bool (*action)(UIContainer&, void*), void* data = nullptr);
+
+	// Returns true if there was an accelerator with the key and modifiers.
+	UICOMMON_LIBRARY_EXPORTED bool remove(size_t key, uint32 modifiers);
+
+	UICOMMON_LIBRARY_EXPORTED void clear();
+
+	template<typename FUNCTOR>
+	void forEach(FUNCTOR&& functor) const {
+		for (const UIAccelerator& slot : slots) {
+			if (slot.key != 0) {
+				functor(slot);
+			}
+		}
+	}
+
+	// Returns the accelerator with exactly the key and modifiers, or null.
+	INLINE const UIAccelerator* find(size_t key, uint32 modifiers) const {
+		const size_t capacity = slots.size();
+		if (count == 0) {
+			return nullptr;
+		}
+		const size_t mask = capacity-1;
+		for (size_t i = hash(key, modifiers) & mask; ; i = (i+1) & mask) {
+			const UIAccelerator& slot = slots[i];
+			if (slot.key == 0) {
+				return nullptr;
+			}
+			if (slot.key == key && slot.modifiers == modifiers) {
+				return &slot;
+			}
+		}
+	}
+};
+
+// Registers table for container, (or unregisters it if null).  table must
+// remain valid until unregistered or container is destroyed, so that it can be
+// shared by all containers of a class.
+UICOMMON_LIBRARY_EXPORTED void setAccelerators(UIContainer& container, const UIAcceleratorTable* table);
+
+// Marks the compiled table for the focus path as out of date.  This is called
+// automatically when a registered table or the keyboard focus changes.
+UICOMMON_LIBRARY_EXPORTED void markAcceleratorsChanged();
+
+// Calls the accelerator for the key and modifiers on the keyboard focus path
+// from root, returning true if it handled the key.  If more than one container
+// on the path has one, the innermost one is used.
+UICOMMON_LIBRARY_EXPORTED bool dispatchAccelerator(UIContainer& root, size_t key, uint32 modifiers);
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
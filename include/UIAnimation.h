@@ -0,0 +1,85 @@
+#pragma once
+
+// This file defines tweens for animating values of UIBox objects, e.g. hover
+// fades or progress bars.  All tweens share one frame clock, stepped by UILoop
+// once per frame while any are active, and each step only invalidates the
+// bounds of the animated box, instead of redrawing the whole window.
+// When no tweens are active, UILoop just waits for events.
+//
+// These functions are only to be called from the UI thread.
+
+#include "UICommon.h"
+
+#include <Types.h>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+struct UIBox;
+
+enum class UIEasing : uint8 {
+	LINEAR,
+	EASE_IN,
+	EASE_OUT,
+	EASE_IN_OUT
+};
+
+using UITweenID = uint64;
+constexpr static UITweenID INVALID_TWEEN_ID = 0;
+
+struct UITween {
+	// Box whose visible bounds are redrawn after each step.
+	UIBox* box = nullptr;
+
+	// If non-null, this is set to the current value on each step.
+	// It must remain valid until the tween finishes or is cancelled,
+	// so it's normally a member of box.
+	float* value = nullptr;
+
+	float from = 0;
+	float to = 1;
+
+	// Duration in seconds of one pass from from to to.
+	float duration = 0.25f;
+
+	UIEasing easing = UIEasing::EASE_IN_OUT;
+
+	// If true, the tween restarts from from each time it reaches to,
+	// e.g. for indeterminate progress bars, until cancelled.
+	bool repeat = false;
+
+	// If non-null, this is called after value is set on each step.
+	// Neither callback may destroy box.
+	void (*onStep)(UIBox& box, float value, void* data) = nullptr;
+
+	// If non-null, this is called once the tween finishes, (but not if it's
+	// cancelled), after the final step.  It may start new tweens.
+	void (*onFinished)(UIBox& box, void* data) = nullptr;
+
+	void* callbackData = nullptr;
+};
+
+// Starts tween, returning an ID that can be used to cancel it.
+// Any tween already animating the same non-null value is cancelled first.
+UICOMMON_LIBRARY_EXPORTED UITweenID startTween(const UITween& tween);
+
+// Animates *value from its current value to the given value, e.g. for fading
+// in on mouse enter, and reversing from wherever it got to on mouse exit.
+UICOMMON_LIBRARY_EXPORTED UITweenID animateValue(UIBox& box, float* value, float to, float duration, UIEasing easing = UIEasing::EASE_IN_OUT);
+
+// Stops a tween, leaving its value where it is, without calling onFinished.
+UICOMMON_LIBRARY_EXPORTED void cancelTween(UITweenID id);
+
+// Stops all tweens of box.  This is called automatically when a box with
+// active tweens is destroyed.
+UICOMMON_LIBRARY_EXPORTED void cancelAnimations(UIBox& box);
+
+// Returns true if any tweens are active, in which case UILoop keeps stepping.
+UICOMMON_LIBRARY_EXPORTED bool isAnimating();
+
+// Steps all active tweens to the given performance counter time.
+// This is called by UILoop once per frame interval, before recording a frame.
+UICOMMON_LIBRARY_EXPORTED void stepAnimations(uint64 frameTime);
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
@@ -0,0 +1,145 @@
+#pragma once
+
+// This file defines UIArena, a memory arena that UIBox objects can be
+// allocated from, so that a whole screen of boxes can be allocated in a few
+// large blocks and released together, and UIArenaScope, which makes
+// UIBoxClass::construct and new allocate boxes from an arena.
+
+#include "UICommon.h"
+
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Types.h>
+
+#include <cstddef>
+#include <utility>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+class UIArena;
+
+// This is placed before every UIBox allocation, so that operator delete can
+// find whether the box came from an arena or the heap, without needing to
+// know the size or type of the box.
+struct alignas(alignof(std::max_align_t)) UIAllocationHeader {
+	// nullptr if the box was allocated from the heap.
+	UIArena* arena;
+
+	// Rounded-up size of the allocation, not including the header.
+	size_t size;
+};
+
+struct UIArenaStats {
+	// Number of blocks and total bytes in them, including unused space.
+	size_t numBlocks = 0;
+	size_t bytesReserved = 0;
+
+	// Total bytes handed out, including headers, and not reduced by frees.
+	size_t bytesAllocated = 0;
+
+	size_t numAllocations = 0;
+
+	// Number of allocations that were satisfied from a free list,
+	// reusing the memory of a box that had been deleted.
+	size_t numReused = 0;
+
+	// Number of allocations that haven't been deleted yet.
+	size_t numLiveAllocations = 0;
+};
+
+// Allocations are bump-allocated from blocks, and deleted allocations are
+// kept in free lists by size, for reuse by later allocations of similar size,
+// e.g. when widgets of the same type are replaced.  No memory is returned
+// to the heap until the arena is reset or destroyed.
+//
+// An arena isn't thread-safe, so boxes allocated from it must only be
+// created and deleted on one thread at a time, (normally the UI thread).
+// All boxes allocated from an arena must be deleted before the arena is
+// reset or destroyed.  Deleting them is cheap, since only the destruct
+// functions run and the memory is just put on a free list.
+class UIArena {
+	constexpr static size_t ALIGNMENT = sizeof(UIAllocationHeader);
+
+	// Allocations up to this size are put on free lists when deleted.
+	// Larger allocations are only reclaimed when the arena is reset.
+	constexpr static size_t MAX_POOLED_SIZE = 1024;
+	constexpr static size_t NUM_SIZE_CLASSES = MAX_POOLED_SIZE/ALIGNMENT;
+
+	struct FreeNode {
+		FreeNode* next;
+	};
+
+	struct Block {
+		char* data;
+		// This can be larger than blockSize, for a large allocation.
+		size_t size;
+	};
+
+	Array<Block> blocks;
+	char* current;
+	char* currentEnd;
+	size_t blockSize;
+
+	FreeNode* freeLists[NUM_SIZE_CLASSES];
+
+	UIArenaStats stats;
+
+public:
+	constexpr static size_t DEFAULT_BLOCK_SIZE = 64*1024;
+
+	UICOMMON_LIBRARY_EXPORTED UIArena(size_t blockSize = DEFAULT_BLOCK_SIZE);
+	UICOMMON_LIBRARY_EXPORTED ~UIArena();
+
+	UIArena(const UIArena&) = delete;
+	UIArena& operator=(const UIArena&) = delete;
+
+	// Returns the memory after a header, for an object of the given size.
+	UICOMMON_LIBRARY_EXPORTED void* allocate(size_t size);
+
+	// p must be a pointer returned by allocate on this arena.
+	UICOMMON_LIBRARY_EXPORTED void deallocate(void* p);
+
+	// Makes all of the memory available again, keeping only the first block.
+	// All allocations must have been deleted first.
+	UICOMMON_LIBRARY_EXPORTED void reset();
+
+	INLINE const UIArenaStats& getStats() const {
+		return stats;
+	}
+
+	// Constructs a T in this arena, regardless of the thread's current arena.
+	// T must be derived from UIBox, so that deleting it returns it here.
+	template<typename T, typename... ARGS>
+	inline T* create(ARGS&&... args);
+
+private:
+	void addBlock(size_t minSize);
+	void freeBlocks(size_t numToKeep);
+};
+
+// While one of these exists, UIBox objects created on this thread,
+// including through UIBoxClass::construct, are allocated from arena.
+// Scopes can be nested, in which case the innermost one applies.
+class UIArenaScope {
+	UIArena* previous;
+public:
+	UICOMMON_LIBRARY_EXPORTED UIArenaScope(UIArena* arena);
+	UICOMMON_LIBRARY_EXPORTED ~UIArenaScope();
+
+	UIArenaScope(const UIArenaScope&) = delete;
+	UIArenaScope& operator=(const UIArenaScope&) = delete;
+};
+
+// Returns the arena that UIBox objects are allocated from on this thread,
+// or nullptr if they're allocated from the heap.
+UICOMMON_LIBRARY_EXPORTED UIArena* getCurrentUIArena();
+
+template<typename T, typename... ARGS>
+inline T* UIArena::create(ARGS&&... args) {
+	UIArenaScope scope(this);
+	return new T(std::forward<ARGS>(args)...);
+}
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
@@ -0,0 +1,53 @@
+#pragma once
+
+// This file defines functions for saving a tree of UIBox objects to a compact
+// binary format and loading it again, so that large screens can be created
+// without running the code that built them.  Loading creates the boxes in one
+// pass, with the children arrays preallocated, optionally in a UIArena, and
+// copies the fixed-size data of each box with a single memcpy.
+//
+// Classes are identified by UIBoxClass::typeName, so each class in a saved
+// tree must be registered with registerUIBoxClass before loading it.
+// Data specific to a class is saved and loaded with the writeData and
+// readData functions of its UIBoxClass.  Function pointers, like callbacks,
+// aren't saved, so they must be set after loading.
+//
+// The format uses the byte order of the machine, so it's only meant for
+// data built for the same platform.
+
+#include "UICommon.h"
+
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Types.h>
+
+#include <memory>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+struct UIBox;
+struct UIBoxClass;
+class UIArena;
+
+// Registers a class so that boxes of it can be loaded.  UIBox, UIContainer,
+// and the widgets in this library are registered automatically.
+// Returns false if a different class with the same typeName was already
+// registered, or typeName or construct is null.
+UICOMMON_LIBRARY_EXPORTED bool registerUIBoxClass(const UIBoxClass& c);
+
+// Returns the registered class with the given typeName, or null.
+UICOMMON_LIBRARY_EXPORTED const UIBoxClass* findUIBoxClass(const char* typeName);
+
+// Appends root and all of its descendants to output.
+// Returns false if any box's class has no typeName.
+UICOMMON_LIBRARY_EXPORTED bool saveUILayout(const UIBox& root, Array<uint8>& output);
+
+// Creates the tree saved by saveUILayout, allocating the boxes from arena,
+// if it's non-null, else from the thread's current arena, if any, else
+// from the heap.  Returns null if the data is invalid or has a class that
+// isn't registered.  The boxes are all marked as needing layout.
+UICOMMON_LIBRARY_EXPORTED std::unique_ptr<UIBox> loadUILayout(const uint8* data, size_t size, UIArena* arena = nullptr);
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
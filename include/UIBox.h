@@ -3,7 +3,12 @@
 // This file defines the base class for UI elements, UIBox,
 // as well as UIContainer.
 
+#include "UIAccelerators.h"
+#include "UIAnimation.h"
 #include "UICommon.h"
+#include "UIFlatTree.h"
+#include "UIGridIndex.h"
+#include "UILayout.h"
 
 #include <Array.h>
 #include <ArrayDef.h>
@@ -19,6 +24,7 @@ UICOMMON_LIBRARY_NAMESPACE_BEGIN
 class Canvas;
 struct UIBox;
 struct UIContainer;
+struct UIStaticDispatch;
 
 struct MouseState {
 	Vec2f position;
@@ -46,6 +52,13 @@ struct UIBoxClass {
 	// the container if this is true and outside the container if this is false.
 	bool consumesMouse = true;
 
+	// UILoop normally merges consecutive mouse motion events that have the
+	// same buttons down into a single onMouseMove call, with the sum of the
+	// changes.  If this is true, while a box of this class is in the chain
+	// of boxes with mouse focus, each motion event is passed on separately,
+	// e.g. for freehand drawing, where every sample matters.
+	bool wantsRawMouseMotion = false;
+
 	const char* typeName = nullptr;
 
 	UIBox* (*construct)() = nullptr;
@@ -97,6 +110,15 @@ struct UIBoxClass {
 	void (*draw)(const UIBox& box, const Box2f& clipRectangle, const Box2f& targetRectangle, Canvas& target) = nullptr;
 
 	const char* (*getTitle)(const UIBox&) = nullptr;
+
+	// Appends any data specific to the class to output, for saveUILayout,
+	// (see UIBinaryLayout.h).  If this is null, only the data common to all
+	// boxes and containers is saved.
+	void (*writeData)(const UIBox& box, Array<uint8>& output) = nullptr;
+
+	// Reads the data written by writeData, for loadUILayout, returning false
+	// if it's invalid.  If this is null, any data is ignored.
+	bool (*readData)(UIBox& box, const uint8* data, size_t size) = nullptr;
 };
 
 // This is the base class of all UI elements.
@@ -107,18 +129,44 @@ struct UIBox {
 	Vec2f origin;
 	Vec2f size;
 
+	// Parameters used by the layout of the parent container, if it has one.
+	// Call markLayoutDirty after changing these.
+	UILayoutParams layoutParams;
+	UILayoutState layoutState;
+
+	// Number of active tweens animating this box, (see UIAnimation.h),
+	// so that they can be cancelled when it's destroyed.
+	uint32 numTweens;
+
 	~UIBox() {
 		if (type != nullptr && type->destruct != nullptr) {
 			type->destruct(this);
 		}
+		if (numTweens != 0) {
+			cancelAnimations(*this);
+		}
+		// Any UIFlatTree containing this box must be rebuilt.
+		markUITreeStructureChanged();
 	}
 
 	UICOMMON_LIBRARY_EXPORTED static const UIBoxClass staticType;
 
 	inline const UIContainer* getRoot() const;
 
+	// Boxes are allocated from the current UIArena of the thread, (see UIArenaScope),
+	// if there is one, else from the heap.  Deleting a box returns its memory
+	// to wherever it was allocated from, so boxes can still be owned by
+	// std::unique_ptr either way.
+	UICOMMON_LIBRARY_EXPORTED static void* operator new(size_t size);
+	UICOMMON_LIBRARY_EXPORTED static void operator delete(void* p);
+
+	static void* operator new(size_t size, void* p) {
+		return p;
+	}
+	static void operator delete(void* p, void* place) {}
+
 protected:
-	UIBox(const UIBoxClass* c) : type(c), parent(nullptr), origin(0,0), size(0,0) {
+	UIBox(const UIBoxClass* c) : type(c), parent(nullptr), origin(0,0), size(0,0), numTweens(0) {
 		assert(c != nullptr);
 		assert(c->construct != construct);
 	}
@@ -131,7 +179,14 @@ private:
 };
 
 struct UIContainerClass : public UIBoxClass {
-	// TODO: Add container-specific functions and class values here.
+	// Returns the size that the container would like to be, given the size
+	// available to it, (normally by calling measureBox on its children).
+	// If this is null, the container is measured like a box that isn't a container.
+	Vec2f (*measure)(UIContainer& container, const Vec2f& availableSize) = nullptr;
+
+	// Sets the origin and size of the children to fit in the container's size.
+	// If this is null, children are only positioned manually.
+	void (*layout)(UIContainer& container) = nullptr;
 };
 
 struct UIContainer : public UIBox {
@@ -140,8 +195,25 @@ struct UIContainer : public UIBox {
 	size_t keyFocusIndex;
 	size_t mouseFocusIndex;
 
+	// Keyboard shortcuts handled while this is on the keyboard focus path.
+	// This is set with setAccelerators, and isn't owned by the container.
+	const UIAcceleratorTable* accelerators;
+
 	Vec4f backgroundColour;
 
+	// How the default layout function positions the children.
+	// Call markLayoutDirty after changing this.
+	UILayoutSettings layoutSettings;
+
+	// Optional index of children by position, to avoid checking every child
+	// when hit testing containers with many children.  This is null unless
+	// enableSpatialIndex has been called.
+	std::unique_ptr<UIGridIndex> spatialIndex;
+
+	// The node of this container in the UIFlatTree that most recently
+	// added it, (see UIFlatTree::findContainer).
+	uint32 flatTreeNode;
+
 	constexpr static size_t INVALID_INDEX = ~size_t(0);
 
 	UICOMMON_LIBRARY_EXPORTED static const UIContainerClass staticType;
@@ -149,8 +221,51 @@ struct UIContainer : public UIBox {
 	UIContainer() : UIContainer(&staticType) {}
 	~UIContainer() = default;
 
+	// Enables the spatial index of children, using a uniform grid with
+	// the given cell size, or a size based on the children if zero.
+	// While enabled, childBoundsChanged must be called after changing the
+	// origin or size of a child, and childrenChanged must be called after
+	// adding, removing, or reordering children.
+	UICOMMON_LIBRARY_EXPORTED void enableSpatialIndex(const Vec2f& cellSize = Vec2f(0,0));
+	UICOMMON_LIBRARY_EXPORTED void disableSpatialIndex();
+
+	// Updates only the cells that the child moved out of or into.
+	UICOMMON_LIBRARY_EXPORTED void childBoundsChanged(size_t childIndex);
+
+	// Marks the spatial index to be rebuilt the next time it's used,
+	// along with any UIFlatTree.
+	INLINE void childrenChanged() {
+		if (spatialIndex) {
+			spatialIndex->markForRebuild();
+		}
+		markUITreeStructureChanged();
+	}
+
+	// Adds child as the last, (topmost), child, setting its parent
+	// and marking the layout dirty.
+	UICOMMON_LIBRARY_EXPORTED void addChild(std::unique_ptr<UIBox>&& child);
+
+	// Removes the child at childIndex, returning ownership of it.
+	// This doesn't call onMouseExit on it, so it should not have mouse focus.
+	UICOMMON_LIBRARY_EXPORTED std::unique_ptr<UIBox> removeChild(size_t childIndex);
+
+	// Computes the clip rectangle, (in the child's space), and the target
+	// rectangle of a child with the given origin and size, from those of its
+	// parent, the same way that UIContainer draws its children.
+	// scale is the size of targetRectangle divided by the size of clipRectangle.
+	// Returns false if the child is entirely clipped away.
+	static inline bool computeChildRectangles(
+		const Vec2f& childOrigin,
+		const Vec2f& childSize,
+		const Box2f& clipRectangle,
+		const Box2f& targetRectangle,
+		const Vec2f& scale,
+		Box2f& childClipRectangle,
+		Box2f& childTargetRectangle
+	);
+
 protected:
-	UIContainer(const UIContainerClass* c) : UIBox(c), keyFocusIndex(INVALID_INDEX), mouseFocusIndex(INVALID_INDEX), backgroundColour(0,0,0,0) {}
+	UIContainer(const UIContainerClass* c) : UIBox(c), keyFocusIndex(INVALID_INDEX), mouseFocusIndex(INVALID_INDEX), accelerators(nullptr), backgroundColour(0,0,0,0), flatTreeNode(UIFlatTree::INVALID_NODE) {}
 
 	UICOMMON_LIBRARY_EXPORTED static UIBox* construct();
 	UICOMMON_LIBRARY_EXPORTED static void destruct(UIBox* box);
@@ -163,13 +278,62 @@ protected:
 	UICOMMON_LIBRARY_EXPORTED static void onMouseUp(UIBox& box, size_t button, const MouseState& state);
 	UICOMMON_LIBRARY_EXPORTED static void onMouseScroll(UIBox& box, float scrollAmount, const MouseState& state);
 
+	// These pass the key on to the keyFocusIndex child.
+	UICOMMON_LIBRARY_EXPORTED static void onKeyDown(UIBox& box, size_t key, const KeyState& state);
+	UICOMMON_LIBRARY_EXPORTED static void onKeyUp(UIBox& box, size_t key, const KeyState& state);
+
 	UICOMMON_LIBRARY_EXPORTED static void updateMouseFocusIndex(UIContainer& container, const MouseState& state);
 
 	UICOMMON_LIBRARY_EXPORTED static void draw(const UIBox& box, const Box2f& clipRectangle, const Box2f& targetRectangle, Canvas& target);
 
 	UICOMMON_LIBRARY_EXPORTED static UIContainerClass initClass();
+
+	friend class UIFlatTree;
+	friend struct UIStaticDispatch;
 };
 
+bool UIContainer::computeChildRectangles(
+	const Vec2f& childOrigin,
+	const Vec2f& childSize,
+	const Box2f& clipRectangle,
+	const Box2f& targetRectangle,
+	const Vec2f& scale,
+	Box2f& childClipRectangle,
+	Box2f& childTargetRectangle
+) {
+	childClipRectangle = clipRectangle;
+	// Clip the rectangle.
+	for (size_t axis = 0; axis < 2; ++axis) {
+		// The min of the parent clip rectangle in the child's space is usually
+		// negative, so it must be forced up to zero.
+		if (childClipRectangle[axis][0] < childOrigin[axis]) {
+			childClipRectangle[axis][0] = childOrigin[axis];
+		}
+		// The max of the parent clip rectangle in the child's space is usually
+		// past the max of the child, so it must be forced down to that.
+		if (childClipRectangle[axis][1] > childOrigin[axis]+childSize[axis]) {
+			childClipRectangle[axis][1] = childOrigin[axis]+childSize[axis];
+		}
+
+		if (childClipRectangle[axis][1] <= childClipRectangle[axis][0]) {
+			// Clip rectangle is empty, so there's nothing to draw.
+			return false;
+		}
+	}
+
+	// Compute corresponding child target rectangle based on
+	// childClipRectangle's relation to clipRectangle and targetRectangle.
+	// This takes into account if there's been a simple scale along the way.
+	childTargetRectangle = Box2f(
+		targetRectangle.min() + (childClipRectangle.min() - clipRectangle.min())*scale,
+		targetRectangle.max() + (childClipRectangle.max() - clipRectangle.max())*scale
+	);
+
+	// Shift the rectangle.
+	childClipRectangle -= childOrigin;
+	return true;
+}
+
 const UIContainer* UIBox::getRoot() const {
 	const UIContainer* root = nullptr;
 	if (parent != nullptr) {
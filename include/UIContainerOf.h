@@ -0,0 +1,262 @@
+#pragma once
+
+// This file defines UIContainerOf, a UIContainer whose class functions are
+// generated for a known child class, so that drawing and mouse routing call
+// the child's functions directly, instead of via the child's UIBoxClass.
+// Nested UIContainerOf classes are all defined in headers, so a deep tree of
+// them can be inlined into a few loops, instead of an indirect call per level.
+
+#include "Canvas.h"
+#include "UIBox.h"
+#include "UICommon.h"
+
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Box.h>
+#include <Vec.h>
+#include <Types.h>
+
+#include <memory>
+#include <type_traits>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+// Calls the class functions of a box, directly if the box's class uses the
+// function of the same name in T, else via its UIBoxClass, so it's always
+// correct, even if the box isn't a T.  T must declare UIStaticDispatch as a
+// friend if its functions aren't public; any it doesn't have are always
+// called via the UIBoxClass.
+struct UIStaticDispatch {
+	template<typename T, typename = void> struct HasDraw : std::false_type {};
+	template<typename T> struct HasDraw<T, std::void_t<decltype(&T::draw)>> : std::true_type {};
+	template<typename T, typename = void> struct HasOnMouseMove : std::false_type {};
+	template<typename T> struct HasOnMouseMove<T, std::void_t<decltype(&T::onMouseMove)>> : std::true_type {};
+	template<typename T, typename = void> struct HasOnMouseDown : std::false_type {};
+	template<typename T> struct HasOnMouseDown<T, std::void_t<decltype(&T::onMouseDown)>> : std::true_type {};
+	template<typename T, typename = void> struct HasOnMouseUp : std::false_type {};
+	template<typename T> struct HasOnMouseUp<T, std::void_t<decltype(&T::onMouseUp)>> : std::true_type {};
+	template<typename T, typename = void> struct HasOnMouseScroll : std::false_type {};
+	template<typename T> struct HasOnMouseScroll<T, std::void_t<decltype(&T::onMouseScroll)>> : std::true_type {};
+
+	template<typename T>
+	static INLINE void draw(const UIBox& box, const Box2f& clipRectangle, const Box2f& targetRectangle, Canvas& target) {
+		if constexpr (HasDraw<T>::value) {
+			if (box.type->draw == &T::draw) {
+				T::draw(box, clipRectangle, targetRectangle, target);
+				return;
+			}
+		}
+		auto function = box.type->draw;
+		if (function != nullptr) {
+			function(box, clipRectangle, targetRectangle, target);
+		}
+	}
+
+	template<typename T>
+	static INLINE void onMouseMove(UIBox& box, const Vec2f& change, const MouseState& state) {
+		if constexpr (HasOnMouseMove<T>::value) {
+			if (box.type->onMouseMove == &T::onMouseMove) {
+				T::onMouseMove(box, change, state);
+				return;
+			}
+		}
+		auto function = box.type->onMouseMove;
+		if (function != nullptr) {
+			function(box, change, state);
+		}
+	}
+
+	template<typename T>
+	static INLINE void onMouseDown(UIBox& box, size_t button, const MouseState& state) {
+		if constexpr (HasOnMouseDown<T>::value) {
+			if (box.type->onMouseDown == &T::onMouseDown) {
+				T::onMouseDown(box, button, state);
+				return;
+			}
+		}
+		auto function = box.type->onMouseDown;
+		if (function != nullptr) {
+			function(box, button, state);
+		}
+	}
+
+	template<typename T>
+	static INLINE void onMouseUp(UIBox& box, size_t button, const MouseState& state) {
+		if constexpr (HasOnMouseUp<T>::value) {
+			if (box.type->onMouseUp == &T::onMouseUp) {
+				T::onMouseUp(box, button, state);
+				return;
+			}
+		}
+		auto function = box.type->onMouseUp;
+		if (function != nullptr) {
+			function(box, button, state);
+		}
+	}
+
+	template<typename T>
+	static INLINE void onMouseScroll(UIBox& box, float scrollAmount, const MouseState& state) {
+		if constexpr (HasOnMouseScroll<T>::value) {
+			if (box.type->onMouseScroll == &T::onMouseScroll) {
+				T::onMouseScroll(box, scrollAmount, state);
+				return;
+			}
+		}
+		auto function = box.type->onMouseScroll;
+		if (function != nullptr) {
+			function(box, scrollAmount, state);
+		}
+	}
+};
+
+// A UIContainer whose children are expected to be CHILD objects, (whose
+// class is exactly CHILD::staticType).  Children of other classes still
+// work, but don't benefit from the direct calls.
+//
+// Each instantiation is a separate UIBoxClass, so CHILD must have a public
+// static member containerTypeName, (e.g. "UIContainerOf<CHILD>"), to use as
+// its typeName, which must be unique for saving and loading layouts.
+template<typename CHILD>
+struct UIContainerOf : public UIContainer {
+	static const UIContainerClass staticType;
+
+	UIContainerOf() : UIContainer(&staticType) {}
+
+	// Adds child as the last, (topmost), child, like UIContainer::addChild.
+	INLINE void addTypedChild(std::unique_ptr<CHILD>&& child) {
+		addChild(std::unique_ptr<UIBox>(std::move(child)));
+	}
+
+	INLINE CHILD& getChild(size_t childIndex) {
+		UIBox& child = *children[childIndex];
+		assert(child.type == &CHILD::staticType);
+		return static_cast<CHILD&>(child);
+	}
+	INLINE const CHILD& getChild(size_t childIndex) const {
+		const UIBox& child = *children[childIndex];
+		assert(child.type == &CHILD::staticType);
+		return static_cast<const CHILD&>(child);
+	}
+
+protected:
+	UIContainerOf(const UIContainerClass* c) : UIContainer(c) {}
+
+	static UIBox* construct() {
+		return new UIContainerOf<CHILD>();
+	}
+
+	static void onMouseMove(UIBox& box, const Vec2f& change, const MouseState& state) {
+		assert(box.type != nullptr);
+		assert(box.type->isContainer);
+		UIContainer& container = static_cast<UIContainer&>(box);
+
+		if (container.mouseFocusIndex != INVALID_INDEX) {
+			UIBox& child = *container.children[container.mouseFocusIndex];
+			// Transform state into the space of the child box.
+			MouseState childMouseState(state);
+			childMouseState.position -= child.origin;
+			UIStaticDispatch::onMouseMove<CHILD>(child, change, childMouseState);
+		}
+
+		// If any buttons are down, the mouse focus stays unchanged.
+		if (state.buttonsDown != 0) {
+			return;
+		}
+		updateMouseFocusIndex(container, state);
+	}
+
+	static void onMouseDown(UIBox& box, size_t button, const MouseState& state) {
+		assert(box.type != nullptr);
+		assert(box.type->isContainer);
+		UIContainer& container = static_cast<UIContainer&>(box);
+
+		// Pressing a mouse button down never changes mouse focus.
+		if (container.mouseFocusIndex != INVALID_INDEX) {
+			UIBox& child = *container.children[container.mouseFocusIndex];
+			MouseState childMouseState(state);
+			childMouseState.position -= child.origin;
+			UIStaticDispatch::onMouseDown<CHILD>(child, button, childMouseState);
+		}
+	}
+
+	static void onMouseUp(UIBox& box, size_t button, const MouseState& state) {
+		assert(box.type != nullptr);
+		assert(box.type->isContainer);
+		UIContainer& container = static_cast<UIContainer&>(box);
+
+		if (container.mouseFocusIndex != INVALID_INDEX) {
+			UIBox& child = *container.children[container.mouseFocusIndex];
+			MouseState childMouseState(state);
+			childMouseState.position -= child.origin;
+			UIStaticDispatch::onMouseUp<CHILD>(child, button, childMouseState);
+		}
+
+		if (state.buttonsDown != 0) {
+			return;
+		}
+		updateMouseFocusIndex(container, state);
+	}
+
+	static void onMouseScroll(UIBox& box, float scrollAmount, const MouseState& state) {
+		assert(box.type != nullptr);
+		assert(box.type->isContainer);
+		UIContainer& container = static_cast<UIContainer&>(box);
+
+		// Scrolling the mouse wheel never changes mouse focus.
+		if (container.mouseFocusIndex != INVALID_INDEX) {
+			UIBox& child = *container.children[container.mouseFocusIndex];
+			MouseState childMouseState(state);
+			childMouseState.position -= child.origin;
+			UIStaticDispatch::onMouseScroll<CHILD>(child, scrollAmount, childMouseState);
+		}
+	}
+
+	static void draw(const UIBox& box, const Box2f& clipRectangle, const Box2f& targetRectangle, Canvas& target) {
+		assert(box.type != nullptr);
+		assert(box.type->isContainer);
+		const UIContainer& container = static_cast<const UIContainer&>(box);
+
+		if (container.backgroundColour[3] != 0) {
+			target.applyRectangle(targetRectangle, container.backgroundColour);
+		}
+
+		Vec2f scale(1.0f, 1.0f);
+		const Vec2f clipSize = clipRectangle.size();
+		const Vec2f targetSize = targetRectangle.size();
+		if (clipSize != targetSize) {
+			scale = (targetSize / clipSize);
+		}
+
+		const Array<std::unique_ptr<UIBox>>& children = container.children;
+		for (size_t i = 0, n = children.size(); i < n; ++i) {
+			const UIBox& child = *children[i];
+			Box2f childClipRectangle;
+			Box2f childTargetRectangle;
+			if (!computeChildRectangles(child.origin, child.size, clipRectangle, targetRectangle, scale, childClipRectangle, childTargetRectangle)) {
+				continue;
+			}
+			UIStaticDispatch::draw<CHILD>(child, childClipRectangle, childTargetRectangle, target);
+		}
+	}
+
+	static UIContainerClass initClass() {
+		UIContainerClass c(UIContainer::initClass());
+		c.typeName = CHILD::containerTypeName;
+		c.construct = &construct;
+		c.onMouseMove = &onMouseMove;
+		c.onMouseDown = &onMouseDown;
+		c.onMouseUp = &onMouseUp;
+		c.onMouseScroll = &onMouseScroll;
+		c.draw = &draw;
+		return c;
+	}
+
+	friend struct UIStaticDispatch;
+};
+
+template<typename CHILD>
+const UIContainerClass UIContainerOf<CHILD>::staticType(UIContainerOf<CHILD>::initClass());
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
@@ -0,0 +1,123 @@
+#pragma once
+
+// This file defines UIFlatTree, an alternative storage of the frequently
+// accessed values of a UIBox tree, in contiguous arrays in depth-first order,
+// so that drawing and hit testing read memory sequentially, instead of
+// following a pointer to a separate allocation for each box.
+//
+// While a UIFlatTree is current on a thread, (see setCurrentUIFlatTree),
+// and up to date, UIContainer::draw and the UIContainer mouse functions read
+// the children of any container in it from the arrays, instead of from the
+// UIBox objects.  Any other time, they read the UIBox objects directly.
+
+#include "UICommon.h"
+
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Box.h>
+#include <Vec.h>
+#include <Types.h>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+class Canvas;
+struct UIBox;
+struct UIBoxClass;
+struct UIContainer;
+
+class UIFlatTree {
+	// Values of the change counts when this was last updated.
+	uint64 builtStructureCount;
+	uint64 builtBoundsCount;
+
+public:
+	constexpr static uint32 INVALID_NODE = ~uint32(0);
+
+	// The node is a container whose children are drawn by the regular
+	// container drawing, so the tree traversal draws them directly.
+	// Otherwise, the node's draw function is called to draw the whole subtree.
+	constexpr static uint32 DRAW_CHILDREN_BIT = 1;
+
+	// These arrays are all indexed by node, in depth-first order, so node 0 is
+	// the root, and the descendants of node i are nodes i+1 to subtreeEnds[i]-1.
+	// The children of node i are i+1, subtreeEnds[i+1], subtreeEnds[subtreeEnds[i+1]],
+	// and so on, until reaching subtreeEnds[i], in drawing order, or
+	// lastChildren[i], previousSiblings[lastChildren[i]], and so on,
+	// until reaching INVALID_NODE, in hit testing order.
+	Array<Vec2f> origins;
+	Array<Vec2f> sizes;
+	Array<const UIBoxClass*> types;
+	Array<uint32> parents;
+	Array<uint32> subtreeEnds;
+	Array<uint32> lastChildren;
+	Array<uint32> previousSiblings;
+	// Index of each node in the children array of its parent's UIContainer.
+	Array<uint32> indicesInParent;
+	Array<uint32> flags;
+
+	// Background colour of containers, or zero for other boxes.
+	Array<Vec4f> backgroundColours;
+
+	// The UIBox of each node, for any widget-specific data, which is only
+	// accessed when calling the functions in its UIBoxClass.
+	Array<UIBox*> boxes;
+
+	INLINE UIFlatTree() : builtStructureCount(0), builtBoundsCount(0) {}
+	UICOMMON_LIBRARY_EXPORTED ~UIFlatTree();
+
+	UIFlatTree(const UIFlatTree&) = delete;
+	UIFlatTree& operator=(const UIFlatTree&) = delete;
+
+	INLINE size_t size() const {
+		return boxes.size();
+	}
+
+	// Brings the arrays up to date with the tree of root, rebuilding them if
+	// any boxes were added, removed, reordered, or destroyed since they were
+	// built, else rereading the origin, size and background colour of every
+	// node if anything may have changed them.
+	UICOMMON_LIBRARY_EXPORTED void update(UIContainer& root);
+
+	// Returns true if nothing has changed since update was last called,
+	// so the arrays can be used instead of the UIBox objects.
+	UICOMMON_LIBRARY_EXPORTED bool isUpToDate() const;
+
+	UICOMMON_LIBRARY_EXPORTED void clear();
+
+	// Returns the node of container, or INVALID_NODE if this isn't up to date
+	// or doesn't contain container.
+	UICOMMON_LIBRARY_EXPORTED uint32 findContainer(const UIContainer& container) const;
+
+	// Draws the children of node, the same way as UIContainer::draw,
+	// with the clip rectangle in the space of node.
+	UICOMMON_LIBRARY_EXPORTED void drawChildren(uint32 node, const Box2f& clipRectangle, const Box2f& targetRectangle, Canvas& target) const;
+
+	// Returns the index, in the children of the container of node, of the
+	// topmost child containing position, (in the space of node), the same
+	// way as UIContainer chooses the child with mouse focus, or
+	// UIContainer::INVALID_INDEX if none.
+	UICOMMON_LIBRARY_EXPORTED size_t positionToChildIndex(uint32 node, const Vec2f& position) const;
+
+private:
+	void addSubtree(UIBox& box, uint32 parent, uint32 indexInParent);
+	void updateBounds();
+};
+
+// These must be called after changing the structure of any UIBox tree, or the
+// origin, size, or background colour of any box, respectively, so that
+// UIFlatTree objects know to update.  UIContainer::addChild, removeChild,
+// childrenChanged, and destroying a box call markUITreeStructureChanged,
+// and setNeedRedraw, invalidateRectangle and invalidateBox, (which must be
+// called after visible changes anyway), call markUITreeBoundsChanged.
+// These can be called from any thread.
+UICOMMON_LIBRARY_EXPORTED void markUITreeStructureChanged();
+UICOMMON_LIBRARY_EXPORTED void markUITreeBoundsChanged();
+
+// Sets the UIFlatTree that UIContainer functions on this thread read from
+// when it's up to date, or nullptr for none.
+UICOMMON_LIBRARY_EXPORTED void setCurrentUIFlatTree(UIFlatTree* tree);
+UICOMMON_LIBRARY_EXPORTED UIFlatTree* getCurrentUIFlatTree();
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
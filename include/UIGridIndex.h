@@ -0,0 +1,89 @@
+#pragma once
+
+// This file defines UIGridIndex, a uniform grid spatial index of the children
+// of a UIContainer, for hit testing containers with many children.
+
+#include "UICommon.h"
+
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Vec.h>
+#include <Types.h>
+
+#include <memory>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+struct UIBox;
+
+class UIGridIndex {
+	struct CellRange {
+		// Inclusive minimum and exclusive maximum cell coordinates.
+		// If min[0] >= max[0], the child isn't in any cells.
+		uint32 min[2];
+		uint32 max[2];
+	};
+
+	// Indices of the children overlapping each cell, in increasing order,
+	// so that iterating in reverse gives the topmost child first.
+	Array<Array<uint32>> cells;
+
+	// The range of cells that each child was added to.
+	Array<CellRange> childCellRanges;
+
+	// If cellSize was zero when enabled, a cell size is chosen based on
+	// the sizes of the children each time the index is rebuilt.
+	Vec2f requestedCellSize;
+
+	Vec2f cellSize;
+	Vec2<size_t> numCells;
+
+	// Size of the container when the index was built, since the grid covers it.
+	Vec2f containerSize;
+
+	// If this is true, the index must be rebuilt before it's used,
+	// e.g. because children were added, removed, or reordered.
+	bool needsRebuild;
+
+public:
+	UIGridIndex(const Vec2f& requestedCellSize_) :
+		requestedCellSize(requestedCellSize_),
+		cellSize(0,0),
+		numCells(0,0),
+		containerSize(0,0),
+		needsRebuild(true)
+	{}
+
+	INLINE void markForRebuild() {
+		needsRebuild = true;
+	}
+
+	// Rebuilds the index if it's been marked for rebuild or the container
+	// size has changed since the last time it was built.
+	INLINE void ensureBuilt(const Vec2f& currentContainerSize, const Array<std::unique_ptr<UIBox>>& children) {
+		if (needsRebuild || currentContainerSize != containerSize || childCellRanges.size() != children.size()) {
+			build(currentContainerSize, children);
+		}
+	}
+
+	UICOMMON_LIBRARY_EXPORTED void build(const Vec2f& currentContainerSize, const Array<std::unique_ptr<UIBox>>& children);
+
+	// Moves the child into the cells overlapping its current origin and size,
+	// keeping the order of child indices in each cell.
+	UICOMMON_LIBRARY_EXPORTED void updateChild(size_t childIndex, const UIBox& child);
+
+	// Returns the indices of the children that might contain position,
+	// in increasing order, or nullptr if position is outside the grid,
+	// in which case, any child might contain position.
+	// ensureBuilt must be called first.
+	UICOMMON_LIBRARY_EXPORTED const Array<uint32>* findCandidates(const Vec2f& position) const;
+
+private:
+	CellRange computeCellRange(const UIBox& child) const;
+	void addToCells(uint32 childIndex, const CellRange& range);
+	void removeFromCells(uint32 childIndex, const CellRange& range);
+};
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
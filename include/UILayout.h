@@ -0,0 +1,120 @@
+#pragma once
+
+// This file defines the layout parameters and state stored in each UIBox,
+// the layout settings of UIContainer, and functions for incrementally
+// updating the layout of a tree of boxes.
+//
+// Layout happens in two passes: measuring, which computes the size that each
+// box would like to be, given the size available to it, and laying out,
+// which sets the origin and size of each child of a container.
+// Measured sizes are cached, and only boxes marked dirty with markLayoutDirty,
+// (and their ancestors), are measured again, so changing one box only
+// recomputes the containers along the path to the root and any children
+// whose size actually changed as a result.
+
+#include "UICommon.h"
+
+#include <Vec.h>
+#include <Types.h>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+struct UIBox;
+struct UIContainer;
+
+// How a container positions its children.
+enum class UILayoutKind : uint8 {
+	// Children are positioned manually, so the container doesn't change them.
+	NONE,
+
+	// Children are placed one after another along the layout axis.
+	// Children with a flexWeight of zero get their measured size along the axis,
+	// and any remaining space is divided between children with a non-zero
+	// flexWeight, in proportion to their weights.  Across the axis, every
+	// child fills the container, limited by its maxSize.
+	STACK,
+
+	// Children are placed in rows of numColumns, in order, from the top.
+	// The columns evenly divide the width of the container, and each row is
+	// as tall as the tallest measured child in it.
+	GRID
+};
+
+// Parameters of any box, used by the layout of its parent container.
+struct UILayoutParams {
+	// If the box isn't a container with a layout, its measured size is
+	// preferredSize, limited to be between minSize and maxSize.
+	Vec2f preferredSize = Vec2f(0,0);
+	Vec2f minSize = Vec2f(0,0);
+	Vec2f maxSize = Vec2f(1e30f,1e30f);
+
+	// Share of any space left over in a STACK container.
+	float flexWeight = 0;
+};
+
+// Layout settings of a container, used for laying out its children.
+struct UILayoutSettings {
+	UILayoutKind kind = UILayoutKind::NONE;
+
+	// 0 for placing STACK children horizontally, from left to right,
+	// or 1 for placing them vertically, from top to bottom.
+	uint8 axis = 1;
+
+	// Number of columns for GRID containers.
+	uint32 numColumns = 1;
+
+	// Space between adjacent children, and between the children and the
+	// edges of the container, in each dimension.
+	Vec2f spacing = Vec2f(0,0);
+	Vec2f padding = Vec2f(0,0);
+};
+
+// The box may have a different measured size than what's cached.
+constexpr static uint32 LAYOUT_MEASURE_DIRTY_BIT = 1;
+
+// The box is a container whose children must be repositioned,
+// e.g. because its size changed, or a child's measured size might have changed.
+constexpr static uint32 LAYOUT_CHILDREN_DIRTY_BIT = 2;
+
+// Some descendant of the box has LAYOUT_CHILDREN_DIRTY_BIT set, so updateLayout
+// must visit the children, even if they don't need to be repositioned.
+constexpr static uint32 LAYOUT_DESCENDANT_DIRTY_BIT = 4;
+
+// Cached state of the layout of a box, managed by the functions below.
+struct UILayoutState {
+	uint32 flags = LAYOUT_MEASURE_DIRTY_BIT | LAYOUT_CHILDREN_DIRTY_BIT;
+
+	// The available size that measuredSize was computed for.
+	Vec2f availableSize = Vec2f(-1,-1);
+	Vec2f measuredSize = Vec2f(0,0);
+};
+
+// Marks the box as needing to be measured again, e.g. because its content
+// or layout parameters changed, and marks its ancestors as needing layout.
+// This also calls setNeedRedraw, so that updateLayout is called before the
+// next frame is recorded.
+UICOMMON_LIBRARY_EXPORTED void markLayoutDirty(UIBox& box);
+
+// Marks the container's children as needing to be repositioned,
+// e.g. because the size of the container was changed by something other
+// than the layout of its parent.
+UICOMMON_LIBRARY_EXPORTED void markChildLayoutDirty(UIContainer& container);
+
+// Returns the size that box would like to be, if the given size is available,
+// using the cached size if the box hasn't been marked dirty since the
+// last time it was measured with the same available size.
+UICOMMON_LIBRARY_EXPORTED Vec2f measureBox(UIBox& box, const Vec2f& availableSize);
+
+// Repositions the children of any dirty containers in the tree of root,
+// using the current size of root.  Subtrees that aren't dirty are skipped.
+// The UI thread calls this on the main window before recording each frame.
+UICOMMON_LIBRARY_EXPORTED void updateLayout(UIBox& root);
+
+// The default UIContainerClass::measure and UIContainerClass::layout,
+// which use the container's layout settings.
+UICOMMON_LIBRARY_EXPORTED Vec2f measureContainerChildren(UIContainer& container, const Vec2f& availableSize);
+UICOMMON_LIBRARY_EXPORTED void layoutContainerChildren(UIContainer& container);
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
@@ -1,5 +1,9 @@
 #pragma once
 
+#include "MappedFile.h"
+#include "TextArena.h"
+#include "TextLine.h"
+#include "../FenwickTree.h"
 #include "../UICommon.h"
 #include "../undo/UndoEvent.h"
 
@@ -7,34 +11,125 @@
 #include <ArrayDef.h>
 #include <Types.h>
 
+#include <type_traits>
+
 OUTER_NAMESPACE_BEGIN
 UICOMMON_LIBRARY_NAMESPACE_BEGIN
 
-struct LineArrayClass {
-
-};
+class LineArray;
+struct LineArrayClass;
+struct TextReplacementEvent;
+struct TextBatchReplacementEvent;
 
+// An array of lines of text, where the line breaks aren't stored.
+// There is always at least one line, which may be empty.
+//
+// The storage of the text is determined by the LineArrayClass, so that
+// different storage can be used for different uses, e.g. PieceTableLineArray
+// for editing huge files.  LineArray itself stores a gap buffer for each line,
+// so that typing in a long line doesn't move the rest of the line each time.
 class LineArray {
 public:
 	const LineArrayClass*const type;
 protected:
-	BufArray<Array<char>, 1> lines;
+	BufArray<TextLine, 1> lines;
+
+	// The size of each line plus one for its line break, (even for the last
+	// line, for simplicity), so that positions can be converted to and from
+	// offsets in O(log n) time.
+	FenwickTree<size_t> lineOffsets;
+
+	// The file that unedited lines borrow their text from, if any,
+	// which is unmapped when the text is replaced or this is destructed.
+	MappedFile mappedFile;
+
+	// If there's no mapped file, unedited lines that are too long to be
+	// stored inline borrow their text from here, instead of each having
+	// its own allocation.  numDeadArenaBytes is the amount of that text
+	// that's no longer used, because its lines were edited or removed.
+	TextArena textArena;
+	size_t numDeadArenaBytes;
 public:
 	struct Position {
 		size_t line;
 		size_t col;
 	};
 
-	UICOMMON_LIBRARY_EXPORTED void getText(
+	// Function called by visitText with each span of text, returning false
+	// to stop early.
+	using TextVisitor = bool (*)(const char* text, size_t size, void* data);
+
+	// One of the replacements for replaceMany
+	struct Replacement {
+		Position begin;
+		Position end;
+		const char* newTextBegin;
+		const char* newTextEnd;
+	};
+
+	UICOMMON_LIBRARY_EXPORTED static const LineArrayClass staticType;
+
+	UICOMMON_LIBRARY_EXPORTED LineArray();
+	inline ~LineArray();
+
+	LineArray(const LineArray&) = delete;
+	LineArray& operator=(const LineArray&) = delete;
+
+	inline size_t getNumLines() const;
+
+	// Returns the number of bytes in the line, excluding the line break.
+	inline size_t getLineSize(size_t line) const;
+
+	// Returns the number of bytes in all lines, including line breaks.
+	inline size_t getTotalSize() const;
+
+	// Converts between a position and the offset in bytes from the beginning
+	// of the text, counting each line break as one byte, in O(log n) time.
+	inline size_t positionToOffset(const Position& position) const;
+	inline Position offsetToPosition(size_t offset) const;
+
+	// Appends the text from begin to end to text, with '\n' between lines.
+	inline void getText(
 		const Position& begin,
 		const Position& end,
 		Array<char>& text
 	) const;
 
+	// Calls visitor with consecutive spans of the text from begin to end,
+	// which together are the same text that getText would append, but
+	// pointing directly into the storage, instead of being copied, e.g. for
+	// rendering, searching, or saving.  Spans are never empty, and are only
+	// valid until the text is modified, or, if hasStableVisitedText returns
+	// false, only until visitor returns.  Line breaks are '\n', and they may
+	// be in separate spans, or in the middle of spans.  Returns false if
+	// visitor stopped early.
+	inline bool visitText(
+		const Position& begin,
+		const Position& end,
+		TextVisitor visitor,
+		void* data
+	) const;
+
+	// Returns false if visitText passes copies of the text that are destroyed
+	// when visitor returns, because the class doesn't implement visitText,
+	// so any spans that are kept until later must be copied.
+	inline bool hasStableVisitedText() const;
+
+	// Like visitText, but with a functor taking (const char* text, size_t size),
+	// e.g. a lambda, returning true to continue.
+	template<typename FUNCTOR>
+	INLINE bool visitText(const Position& begin, const Position& end, FUNCTOR&& functor) const {
+		using FunctorType = typename std::remove_reference<FUNCTOR>::type;
+		auto visitor = [](const char* text, size_t size, void* data) -> bool {
+			return (*(FunctorType*)data)(text, size);
+		};
+		return visitText(begin, end, visitor, (void*)&functor);
+	}
+
 	// Replaces the text from begin to end with the text between
 	// newTextBegin and newTextEnd, optionally filling in a
 	// TextReplacementEvent to be able to undo the replacement.
-	UICOMMON_LIBRARY_EXPORTED void replace(
+	inline void replace(
 		const Position& begin,
 		const Position& end,
 		const char* newTextBegin,
@@ -42,6 +137,43 @@ public:
 		TextReplacementEvent* undoEvent = nullptr
 	);
 
+	// Applies all of the replacements at once, e.g. for typing with multiple
+	// carets, or replacing all matches of a search.  The replacements must be
+	// sorted and not overlap, and their positions are all in the text before
+	// any of the replacements.  This optionally fills in a single undo event
+	// for all of them, and for LineArray itself, it takes time proportional
+	// to the number of lines plus the size of the changed lines, instead of
+	// the number of lines times the number of replacements.
+	inline void replaceMany(
+		const Replacement* replacements,
+		size_t numReplacements,
+		TextBatchReplacementEvent* undoEvent = nullptr
+	);
+
+	// Replaces all of the text with text[0, size), whose line breaks are at
+	// the increasing offsets in lineBreaks[0, numLineBreaks), all at once,
+	// e.g. when loading a file, without filling in an undo event.
+	// Each line break is lineBreakSize bytes, ending at the offset,
+	// (i.e. 2 for "\r\n"), and isn't included in the lines.
+	inline void setText(
+		const char* text,
+		size_t size,
+		const size_t* lineBreaks,
+		size_t numLineBreaks,
+		size_t lineBreakSize = 1
+	);
+
+	// Like setText, but with the text of the mapped file, taking ownership of
+	// the mapping, so that lines can point directly into the file until they're
+	// edited, if the LineArray class supports it.  Returns false, leaving
+	// file unchanged, if the class doesn't support it.
+	inline bool setMappedText(
+		MappedFile& file,
+		const size_t* lineBreaks,
+		size_t numLineBreaks,
+		size_t lineBreakSize = 1
+	);
+
 	INLINE void insert(
 		const Position& position,
 		const char* newTextBegin,
@@ -55,7 +187,8 @@ public:
 		const char* newTextEnd,
 		TextReplacementEvent* undoEvent = nullptr
 	) {
-		replace(Position{0,0}, Position{lines.size()-1, lines.last().size()}, newTextBegin, newTextEnd, undoEvent);
+		const size_t lastLine = getNumLines()-1;
+		replace(Position{0,0}, Position{lastLine, getLineSize(lastLine)}, newTextBegin, newTextEnd, undoEvent);
 	}
 	INLINE void remove(
 		const Position& begin,
@@ -65,17 +198,289 @@ public:
 		replace(begin, end, nullptr, nullptr, undoEvent);
 	}
 protected:
+	LineArray(const LineArrayClass* c) : type(c), numDeadArenaBytes(0) {}
+
+	// Functions for LineArray::staticType
+	UICOMMON_LIBRARY_EXPORTED static void destruct(LineArray* lineArray);
+	UICOMMON_LIBRARY_EXPORTED static size_t getNumLinesImpl(const LineArray& lineArray);
+	UICOMMON_LIBRARY_EXPORTED static size_t getLineSizeImpl(const LineArray& lineArray, size_t line);
+	UICOMMON_LIBRARY_EXPORTED static size_t getTotalSizeImpl(const LineArray& lineArray);
+	UICOMMON_LIBRARY_EXPORTED static size_t positionToOffsetImpl(const LineArray& lineArray, const Position& position);
+	UICOMMON_LIBRARY_EXPORTED static Position offsetToPositionImpl(const LineArray& lineArray, size_t offset);
+	UICOMMON_LIBRARY_EXPORTED static void getTextImpl(
+		const LineArray& lineArray,
+		const Position& begin,
+		const Position& end,
+		Array<char>& text
+	);
+	UICOMMON_LIBRARY_EXPORTED static bool visitTextImpl(
+		const LineArray& lineArray,
+		const Position& begin,
+		const Position& end,
+		TextVisitor visitor,
+		void* data
+	);
+	UICOMMON_LIBRARY_EXPORTED static void replaceImpl(
+		LineArray& lineArray,
+		const Position& begin,
+		const Position& end,
+		const char* newTextBegin,
+		const char* newTextEnd,
+		TextReplacementEvent* undoEvent
+	);
+
+	UICOMMON_LIBRARY_EXPORTED static void replaceManyImpl(
+		LineArray& lineArray,
+		const Replacement* replacements,
+		size_t numReplacements,
+		TextBatchReplacementEvent* undoEvent
+	);
+
+	UICOMMON_LIBRARY_EXPORTED static void setTextImpl(
+		LineArray& lineArray,
+		const char* text,
+		size_t size,
+		const size_t* lineBreaks,
+		size_t numLineBreaks,
+		size_t lineBreakSize
+	);
+
+	UICOMMON_LIBRARY_EXPORTED static void setMappedTextImpl(
+		LineArray& lineArray,
+		MappedFile& file,
+		const size_t* lineBreaks,
+		size_t numLineBreaks,
+		size_t lineBreakSize
+	);
+
+	// Replaces all of the lines with the lines of text, either copying
+	// or borrowing the text of each line.
+	void setLines(
+		const char* text,
+		size_t size,
+		const size_t* lineBreaks,
+		size_t numLineBreaks,
+		size_t lineBreakSize,
+		bool borrow
+	);
+
+	// Marks the text of lines [beginLine, endLine) as no longer used,
+	// if they borrow it from textArena, since they're about to be edited.
+	void releaseArenaLines(size_t beginLine, size_t endLine);
+
+	// Copies the text still borrowed from textArena into a new arena, if
+	// enough of it is no longer used, so that the unused memory is freed.
+	void compactTextArena();
+
+	// Updates lineOffsets after replaceImpl changed numChangedLines lines
+	// starting at firstLine, when there were previously numOldLines lines.
+	void updateLineOffsets(size_t firstLine, size_t numChangedLines, size_t numOldLines);
+
 	// Helper function for replacing text within a single line
 	// with text containing no line breaks.
 	UICOMMON_LIBRARY_EXPORTED static size_t replaceSingleHelper(
-		Array<char>& line,
+		TextLine& line,
 		size_t beginCol,
 		size_t endCol,
 		const char* beginText,
 		const char* endText
 	);
+
+	// Fills in the end of undoEvent after inserting newTextBegin to
+	// newTextEnd at begin, for LineArrayClass::replace implementations.
+	UICOMMON_LIBRARY_EXPORTED static void setUndoEventEnd(
+		TextReplacementEvent& undoEvent,
+		const Position& begin,
+		const char* newTextBegin,
+		const char* newTextEnd
+	);
+
+	// Returns the position after the text from textBegin to textEnd,
+	// if it were inserted at begin.
+	UICOMMON_LIBRARY_EXPORTED static Position findTextEnd(
+		const Position& begin,
+		const char* textBegin,
+		const char* textEnd
+	);
+
+	// Fills in undoEvent for replaceMany, before the replacements are made,
+	// for LineArrayClass::replaceMany implementations.
+	UICOMMON_LIBRARY_EXPORTED static void prepareBatchUndoEvent(
+		const LineArray& lineArray,
+		const Replacement* replacements,
+		size_t numReplacements,
+		TextBatchReplacementEvent& undoEvent
+	);
+
+private:
+	static inline LineArrayClass initClass();
+};
+
+// This struct acts like a virtual table for LineArray, (like UIBoxClass),
+// so that the storage of the lines can differ between LineArray classes.
+struct LineArrayClass {
+	const char* typeName = nullptr;
+
+	void (*destruct)(LineArray*) = nullptr;
+
+	size_t (*getNumLines)(const LineArray& lineArray) = nullptr;
+	size_t (*getLineSize)(const LineArray& lineArray, size_t line) = nullptr;
+	size_t (*getTotalSize)(const LineArray& lineArray) = nullptr;
+	size_t (*positionToOffset)(const LineArray& lineArray, const LineArray::Position& position) = nullptr;
+	LineArray::Position (*offsetToPosition)(const LineArray& lineArray, size_t offset) = nullptr;
+
+	void (*getText)(
+		const LineArray& lineArray,
+		const LineArray::Position& begin,
+		const LineArray::Position& end,
+		Array<char>& text
+	) = nullptr;
+
+	// This is optional.  If it's null, visitText copies the text with getText,
+	// and calls the visitor once, with text that's only valid during the call.
+	bool (*visitText)(
+		const LineArray& lineArray,
+		const LineArray::Position& begin,
+		const LineArray::Position& end,
+		LineArray::TextVisitor visitor,
+		void* data
+	) = nullptr;
+
+	void (*replace)(
+		LineArray& lineArray,
+		const LineArray::Position& begin,
+		const LineArray::Position& end,
+		const char* newTextBegin,
+		const char* newTextEnd,
+		TextReplacementEvent* undoEvent
+	) = nullptr;
+
+	// This is optional.  If it's null, the replacements are made one at
+	// a time using replace, from the last to the first.
+	void (*replaceMany)(
+		LineArray& lineArray,
+		const LineArray::Replacement* replacements,
+		size_t numReplacements,
+		TextBatchReplacementEvent* undoEvent
+	) = nullptr;
+
+	void (*setText)(
+		LineArray& lineArray,
+		const char* text,
+		size_t size,
+		const size_t* lineBreaks,
+		size_t numLineBreaks,
+		size_t lineBreakSize
+	) = nullptr;
+
+	// This is optional, in case the LineArray class can't use the mapped
+	// file without copying the text.
+	void (*setMappedText)(
+		LineArray& lineArray,
+		MappedFile& file,
+		const size_t* lineBreaks,
+		size_t numLineBreaks,
+		size_t lineBreakSize
+	) = nullptr;
 };
 
+LineArray::~LineArray() {
+	if (type != nullptr && type->destruct != nullptr) {
+		type->destruct(this);
+	}
+}
+
+size_t LineArray::getNumLines() const {
+	return type->getNumLines(*this);
+}
+
+size_t LineArray::getLineSize(size_t line) const {
+	return type->getLineSize(*this, line);
+}
+
+size_t LineArray::getTotalSize() const {
+	return type->getTotalSize(*this);
+}
+
+size_t LineArray::positionToOffset(const Position& position) const {
+	return type->positionToOffset(*this, position);
+}
+
+LineArray::Position LineArray::offsetToPosition(size_t offset) const {
+	return type->offsetToPosition(*this, offset);
+}
+
+void LineArray::getText(const Position& begin, const Position& end, Array<char>& text) const {
+	type->getText(*this, begin, end, text);
+}
+
+bool LineArray::visitText(const Position& begin, const Position& end, TextVisitor visitor, void* data) const {
+	if (type->visitText != nullptr) {
+		return type->visitText(*this, begin, end, visitor, data);
+	}
+	// The text is destroyed on return, so hasStableVisitedText returns false.
+	Array<char> text;
+	type->getText(*this, begin, end, text);
+	return (text.size() == 0) || visitor(text.data(), text.size(), data);
+}
+
+bool LineArray::hasStableVisitedText() const {
+	return type->visitText != nullptr;
+}
+
+void LineArray::replace(
+	const Position& begin,
+	const Position& end,
+	const char* newTextBegin,
+	const char* newTextEnd,
+	TextReplacementEvent* undoEvent
+) {
+	type->replace(*this, begin, end, newTextBegin, newTextEnd, undoEvent);
+}
+
+void LineArray::replaceMany(
+	const Replacement* replacements,
+	size_t numReplacements,
+	TextBatchReplacementEvent* undoEvent
+) {
+	if (type->replaceMany != nullptr) {
+		type->replaceMany(*this, replacements, numReplacements, undoEvent);
+		return;
+	}
+	if (undoEvent != nullptr) {
+		prepareBatchUndoEvent(*this, replacements, numReplacements, *undoEvent);
+	}
+	// Replacing from the end doesn't change the positions of the earlier ones.
+	for (size_t i = numReplacements; i > 0;) {
+		--i;
+		const Replacement& replacement = replacements[i];
+		type->replace(*this, replacement.begin, replacement.end, replacement.newTextBegin, replacement.newTextEnd, nullptr);
+	}
+}
+
+void LineArray::setText(
+	const char* text,
+	size_t size,
+	const size_t* lineBreaks,
+	size_t numLineBreaks,
+	size_t lineBreakSize
+) {
+	type->setText(*this, text, size, lineBreaks, numLineBreaks, lineBreakSize);
+}
+
+bool LineArray::setMappedText(
+	MappedFile& file,
+	const size_t* lineBreaks,
+	size_t numLineBreaks,
+	size_t lineBreakSize
+) {
+	if (type->setMappedText == nullptr) {
+		return false;
+	}
+	type->setMappedText(*this, file, lineBreaks, numLineBreaks, lineBreakSize);
+	return true;
+}
+
 struct TextReplacementEvent : public UndoEvent {
 	LineArray* lineArray;
 	Array<char> previousText;
@@ -83,5 +488,48 @@ struct TextReplacementEvent : public UndoEvent {
 	LineArray::Position end;
 };
 
+// Undo event for LineArray::replaceMany, with the previous text of all of
+// the replacements in one array, instead of an event for each replacement.
+struct TextBatchReplacementEvent : public UndoEvent {
+	struct Range {
+		// The position of the new text, after all of the replacements.
+		LineArray::Position begin;
+		LineArray::Position end;
+		// The previous text is from the previous range's previousTextEnd,
+		// (or zero), to this.
+		size_t previousTextEnd;
+	};
+
+	LineArray* lineArray;
+	Array<Range> ranges;
+	Array<char> previousText;
+
+	UICOMMON_LIBRARY_EXPORTED static const UndoEventClass staticType;
+
+	TextBatchReplacementEvent() : UndoEvent(&staticType), lineArray(nullptr) {}
+
+protected:
+	static UndoEvent* construct() {
+		return new TextBatchReplacementEvent();
+	}
+	static void destruct(UndoEvent* undoEvent) {
+		assert(undoEvent);
+		assert(undoEvent->type == &staticType);
+		TextBatchReplacementEvent* event = static_cast<TextBatchReplacementEvent*>(undoEvent);
+		event->ranges.setCapacity(0);
+		event->previousText.setCapacity(0);
+	}
+
+	UICOMMON_LIBRARY_EXPORTED static std::unique_ptr<UndoEvent> undo(std::unique_ptr<UndoEvent>&& original);
+
+	static void getDescription(const UndoEvent& undoEvent, Array<char>& text) {
+		assert(undoEvent.type == &staticType);
+		const char description[] = "Replace";
+		text.append(description, description + sizeof(description)-1);
+	}
+private:
+	static inline UndoEventClass initClass();
+};
+
 UICOMMON_LIBRARY_NAMESPACE_END
 OUTER_NAMESPACE_END
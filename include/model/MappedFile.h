@@ -0,0 +1,26 @@
+#pragma once
+
+#include "../UICommon.h"
+
+#include <Types.h>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+// A read-only file mapped into memory.
+struct MappedFile {
+	const char* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#endif
+};
+
+// Maps the whole file into memory, read-only, returning false on failure.
+// file must be unmapped with unmapFile when no longer needed.
+UICOMMON_LIBRARY_EXPORTED bool mapFile(const char* filename, MappedFile& file);
+UICOMMON_LIBRARY_EXPORTED void unmapFile(MappedFile& file);
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "LineArray.h"
+#include "../UICommon.h"
+
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Types.h>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+// A LineArray that stores the text as a piece table, for editing huge files.
+// The original text is kept in one buffer, which is never modified, and all
+// inserted text is appended to a second buffer.  The document is a sequence of
+// pieces of those buffers, kept in a treap, (a randomized balanced binary tree),
+// ordered by position, with the number of bytes and line breaks of each
+// subtree, so that converting between positions and offsets, and replacing
+// text, take O(log n) expected time, for n pieces, no matter how many lines
+// there are.
+//
+// Line breaks are stored as '\n' in the buffers, and any '\r' before a '\n'
+// is part of the line.
+class PieceTableLineArray : public LineArray {
+public:
+	UICOMMON_LIBRARY_EXPORTED static const LineArrayClass staticType;
+
+	UICOMMON_LIBRARY_EXPORTED PieceTableLineArray();
+
+	// Starts with a copy of the text from textBegin to textEnd as the original
+	// buffer, without splitting it into lines up front.
+	UICOMMON_LIBRARY_EXPORTED PieceTableLineArray(const char* textBegin, const char* textEnd);
+
+	// Returns the number of pieces, which increases with each separate edit.
+	INLINE size_t getNumPieces() const {
+		return nodes.size() - freeNodes.size();
+	}
+
+protected:
+	constexpr static uint32 NO_NODE = ~uint32(0);
+	constexpr static uint32 ORIGINAL_BUFFER = 0;
+	constexpr static uint32 ADDED_BUFFER = 1;
+
+	struct Buffer {
+		Array<char> text;
+		// Offsets of every '\n' in text, in increasing order.
+		Array<size_t> lineBreaks;
+	};
+
+	struct Node {
+		// The piece is text[start, start+length) of buffers[buffer].
+		uint32 buffer;
+		size_t start;
+		size_t length;
+		size_t numLineBreaks;
+
+		uint32 left;
+		uint32 right;
+		uint32 priority;
+
+		// Totals of the pieces in this subtree.
+		size_t totalSize;
+		size_t totalLineBreaks;
+	};
+
+	Buffer buffers[2];
+	Array<Node> nodes;
+	Array<uint32> freeNodes;
+	uint32 root;
+	uint32 randomState;
+
+	INLINE size_t subtreeSize(uint32 node) const {
+		return (node == NO_NODE) ? 0 : nodes[node].totalSize;
+	}
+	INLINE size_t subtreeLineBreaks(uint32 node) const {
+		return (node == NO_NODE) ? 0 : nodes[node].totalLineBreaks;
+	}
+
+	// Returns the number of line breaks in text[begin, end) of the buffer,
+	// in O(log n) time.
+	size_t countLineBreaks(uint32 buffer, size_t begin, size_t end) const;
+
+	uint32 newNode(uint32 buffer, size_t start, size_t length);
+	void freeSubtree(uint32 node);
+	void updateTotals(uint32 node);
+
+	// Splits the tree node into the text before offset and the text after it,
+	// splitting a piece if offset is inside it.
+	void split(uint32 node, size_t offset, uint32& left, uint32& right);
+	uint32 merge(uint32 left, uint32 right);
+
+	// Returns the offset of the beginning of the line.
+	size_t lineBeginOffset(size_t line) const;
+
+	size_t findOffset(const Position& position) const;
+	Position findPosition(size_t offset) const;
+
+	// Appends text[begin, end) of the subtree, whose first byte is at
+	// nodeOffset in the document.
+	void appendText(uint32 node, size_t nodeOffset, size_t begin, size_t end, Array<char>& text) const;
+
+	// Like appendText, but calls visitor with each piece in the range,
+	// returning false if visitor stopped early.
+	bool visitPieces(uint32 node, size_t nodeOffset, size_t begin, size_t end, TextVisitor visitor, void* data) const;
+
+	// Appends text to the added buffer, returning its start offset there.
+	size_t appendToAddedBuffer(const char* textBegin, const char* textEnd);
+
+	UICOMMON_LIBRARY_EXPORTED static void destruct(LineArray* lineArray);
+	UICOMMON_LIBRARY_EXPORTED static size_t getNumLinesImpl(const LineArray& lineArray);
+	UICOMMON_LIBRARY_EXPORTED static size_t getLineSizeImpl(const LineArray& lineArray, size_t line);
+	UICOMMON_LIBRARY_EXPORTED static size_t getTotalSizeImpl(const LineArray& lineArray);
+	UICOMMON_LIBRARY_EXPORTED static size_t positionToOffsetImpl(const LineArray& lineArray, const Position& position);
+	UICOMMON_LIBRARY_EXPORTED static Position offsetToPositionImpl(const LineArray& lineArray, size_t offset);
+	UICOMMON_LIBRARY_EXPORTED static void getTextImpl(
+		const LineArray& lineArray,
+		const Position& begin,
+		const Position& end,
+		Array<char>& text
+	);
+	UICOMMON_LIBRARY_EXPORTED static bool visitTextImpl(
+		const LineArray& lineArray,
+		const Position& begin,
+		const Position& end,
+		TextVisitor visitor,
+		void* data
+	);
+	UICOMMON_LIBRARY_EXPORTED static void replaceImpl(
+		LineArray& lineArray,
+		const Position& begin,
+		const Position& end,
+		const char* newTextBegin,
+		const char* newTextEnd,
+		TextReplacementEvent* undoEvent
+	);
+	UICOMMON_LIBRARY_EXPORTED static void setTextImpl(
+		LineArray& lineArray,
+		const char* text,
+		size_t size,
+		const size_t* lineBreaks,
+		size_t numLineBreaks,
+		size_t lineBreakSize
+	);
+
+private:
+	static inline LineArrayClass initClass();
+};
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "LineArray.h"
+#include "TextLine.h"
+#include "../UICommon.h"
+
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Types.h>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+// A LineArray for following text that's only appended to, e.g. live logs,
+// which keeps at most a maximum number of lines and bytes, evicting the
+// oldest lines when text is appended past either limit.
+//
+// The lines are stored in a ring buffer, so that appending lines and evicting
+// them from the front each take O(1) time per line.  Edits before the end
+// are supported, but take time proportional to the number of lines after
+// the edit.  replace and replaceMany only evict lines before the first
+// edit, so that their undo events stay valid, so the limits can be exceeded
+// until the next append or setLimits.
+//
+// Line indices in Positions are relative to the first line that hasn't been
+// evicted, so they change when lines are evicted.  getFirstLineNumber can be
+// used to keep track of lines by their absolute line numbers instead, which
+// stay the same across evictions.
+class TailLineArray : public LineArray {
+public:
+	UICOMMON_LIBRARY_EXPORTED static const LineArrayClass staticType;
+
+	constexpr static size_t DEFAULT_MAX_LINES = 100000;
+	constexpr static size_t DEFAULT_MAX_BYTES = 64*1024*1024;
+
+	UICOMMON_LIBRARY_EXPORTED TailLineArray(size_t maxLines = DEFAULT_MAX_LINES, size_t maxBytes = DEFAULT_MAX_BYTES);
+
+	// Sets the limits, evicting lines if they're now exceeded.  Bytes include
+	// one for each line break.  The last line is never evicted, even if it's
+	// larger than maxBytes, so there's always at least one line.
+	UICOMMON_LIBRARY_EXPORTED void setLimits(size_t maxLines, size_t maxBytes);
+
+	// Appends the text to the end, evicting lines from the front if needed.
+	UICOMMON_LIBRARY_EXPORTED void append(const char* textBegin, const char* textEnd);
+
+	// Returns the absolute line number of line 0, i.e. the number of lines
+	// that have been evicted since the text was last set.
+	INLINE uint64 getFirstLineNumber() const {
+		return firstLineNumber;
+	}
+
+	// Finds the current line index of the line with the given absolute line
+	// number, returning false if it's been evicted or doesn't exist yet.
+	INLINE bool findLine(uint64 lineNumber, size_t& line) const {
+		if (lineNumber < firstLineNumber || lineNumber - firstLineNumber >= numLines) {
+			return false;
+		}
+		line = size_t(lineNumber - firstLineNumber);
+		return true;
+	}
+
+protected:
+	struct Entry {
+		TextLine text;
+		// Offset of the beginning of the line from the beginning of the text
+		// when it was last set, including evicted lines, so that evicting
+		// lines doesn't require updating the offsets of the others.
+		uint64 beginOffset;
+	};
+
+	// The lines are ring[(firstIndex + i) & (ring.size()-1)], for i in [0, numLines).
+	// The size of ring is always a power of two.
+	Array<Entry> ring;
+	size_t firstIndex;
+	size_t numLines;
+	uint64 firstLineNumber;
+
+	size_t maxLines;
+	size_t maxBytes;
+
+	INLINE Entry& entry(size_t line) {
+		assert(line < numLines);
+		return ring[(firstIndex + line) & (ring.size()-1)];
+	}
+	INLINE const Entry& entry(size_t line) const {
+		assert(line < numLines);
+		return ring[(firstIndex + line) & (ring.size()-1)];
+	}
+
+	// Number of bytes in the lines, including a line break after each line.
+	INLINE uint64 getNumBytes() const {
+		const Entry& last = entry(numLines-1);
+		return last.beginOffset + last.text.size() + 1 - entry(0).beginOffset;
+	}
+
+	// Makes the ring big enough for at least minLines lines.
+	void reserve(size_t minLines);
+
+	// Inserts count empty lines before line.
+	void insertLines(size_t line, size_t count);
+
+	// Removes count lines starting at line, which can't be all of the lines.
+	void removeLines(size_t line, size_t count);
+
+	// Recomputes beginOffset of every line after line.
+	void updateOffsetsAfter(size_t line);
+
+	// Evicts lines from the front until both limits are met, or
+	// maxNumEvicted lines have been evicted, returning the number evicted.
+	size_t evict(size_t maxNumEvicted = ~size_t(0));
+
+	// Replaces the text, without filling in an undo event or evicting.
+	void replaceText(const Position& begin, const Position& end, const char* newTextBegin, const char* newTextEnd);
+
+	UICOMMON_LIBRARY_EXPORTED static void destruct(LineArray* lineArray);
+	UICOMMON_LIBRARY_EXPORTED static size_t getNumLinesImpl(const LineArray& lineArray);
+	UICOMMON_LIBRARY_EXPORTED static size_t getLineSizeImpl(const LineArray& lineArray, size_t line);
+	UICOMMON_LIBRARY_EXPORTED static size_t getTotalSizeImpl(const LineArray& lineArray);
+	UICOMMON_LIBRARY_EXPORTED static size_t positionToOffsetImpl(const LineArray& lineArray, const Position& position);
+	UICOMMON_LIBRARY_EXPORTED static Position offsetToPositionImpl(const LineArray& lineArray, size_t offset);
+	UICOMMON_LIBRARY_EXPORTED static void getTextImpl(
+		const LineArray& lineArray,
+		const Position& begin,
+		const Position& end,
+		Array<char>& text
+	);
+	UICOMMON_LIBRARY_EXPORTED static bool visitTextImpl(
+		const LineArray& lineArray,
+		const Position& begin,
+		const Position& end,
+		TextVisitor visitor,
+		void* data
+	);
+	UICOMMON_LIBRARY_EXPORTED static void replaceImpl(
+		LineArray& lineArray,
+		const Position& begin,
+		const Position& end,
+		const char* newTextBegin,
+		const char* newTextEnd,
+		TextReplacementEvent* undoEvent
+	);
+	UICOMMON_LIBRARY_EXPORTED static void replaceManyImpl(
+		LineArray& lineArray,
+		const Replacement* replacements,
+		size_t numReplacements,
+		TextBatchReplacementEvent* undoEvent
+	);
+	UICOMMON_LIBRARY_EXPORTED static void setTextImpl(
+		LineArray& lineArray,
+		const char* text,
+		size_t size,
+		const size_t* lineBreaks,
+		size_t numLineBreaks,
+		size_t lineBreakSize
+	);
+
+private:
+	static inline LineArrayClass initClass();
+};
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "../UICommon.h"
+
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Types.h>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+// Memory for unaligned text, bump-allocated from large chunks, so that many
+// lines of text can be stored with only a few allocations.  Nothing is freed
+// until the whole arena is cleared, so the owner must track how much of it
+// is no longer used, and copy the rest into a new arena when it's worthwhile.
+class TextArena {
+	Array<char*> chunks;
+	char* current;
+	char* currentEnd;
+	size_t numBytes;
+
+public:
+	constexpr static size_t CHUNK_SIZE = 1024*1024;
+
+	INLINE TextArena() : current(nullptr), currentEnd(nullptr), numBytes(0) {}
+	INLINE ~TextArena() {
+		clear();
+	}
+
+	TextArena(const TextArena&) = delete;
+	TextArena& operator=(const TextArena&) = delete;
+
+	// Total number of bytes allocated since the last clear.
+	INLINE size_t size() const {
+		return numBytes;
+	}
+
+	UICOMMON_LIBRARY_EXPORTED char* allocate(size_t size);
+
+	// Frees all of the memory.
+	UICOMMON_LIBRARY_EXPORTED void clear();
+
+	UICOMMON_LIBRARY_EXPORTED void swap(TextArena& that);
+};
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
@@ -0,0 +1,64 @@
+#pragma once
+
+// This file contains functions for loading text files into a LineArray
+// quickly, by mapping the file into memory, and finding all of the line
+// breaks up front, in parallel, so that the lines can be created in one pass.
+
+#include "LineArray.h"
+#include "MappedFile.h"
+#include "../UICommon.h"
+
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Types.h>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+enum class LineEnding : uint8 {
+	// "\n"
+	LF,
+	// "\r\n", which is only used if every line break in the file is "\r\n".
+	CRLF
+};
+
+// Appends the offset of every '\n' in text to lineBreaks, in increasing order.
+// Large text is split into chunks that are searched in parallel, using SSE2
+// to check 16 bytes at a time.
+UICOMMON_LIBRARY_EXPORTED void findLineBreaks(const char* text, size_t size, Array<size_t>& lineBreaks);
+
+// Returns CRLF if there's at least one line break and every one has a '\r'
+// before it, else LF.
+UICOMMON_LIBRARY_EXPORTED LineEnding detectLineEnding(const char* text, const Array<size_t>& lineBreaks);
+
+// Replaces the contents of lineArray with the contents of the file, returning
+// false if the file couldn't be read.  If the file uses CRLF line breaks,
+// the '\r' characters are removed.  The detected line ending is returned
+// in lineEnding, if it's not null, so that it can be used when saving.
+UICOMMON_LIBRARY_EXPORTED bool loadTextFile(const char* filename, LineArray& lineArray, LineEnding* lineEnding = nullptr);
+
+// Like loadTextFile, but if the LineArray class supports it, the lines point
+// directly into the mapped file, and are only copied when they're edited,
+// so memory use depends on the number of lines and the edits, not on the
+// size of the file.  The file is unmapped when lineArray is destructed or
+// its text is set again, and it must not be modified until then.
+//
+// If the file uses CRLF line breaks, the '\r' characters are still left
+// out of the lines, since the lines are separate pointers into the file.
+UICOMMON_LIBRARY_EXPORTED bool mapTextFile(const char* filename, LineArray& lineArray, LineEnding* lineEnding = nullptr);
+
+// Writes all of the text of lineArray to the file, with the given line
+// ending, returning false if it couldn't be written.  The text is written
+// directly from the storage of lineArray, using LineArray::visitText, in
+// batches of spans with writev, instead of being copied into one buffer
+// first.  (On Windows, which has no equivalent for regular files, small
+// spans are combined into a buffer.)
+//
+// The text is written to a temporary file, which then replaces the file,
+// so that the file isn't left partly written if writing fails, and so that
+// lineArray can still be borrowing text from a mapping of the file,
+// (except on Windows, where a mapped file can't be replaced).
+UICOMMON_LIBRARY_EXPORTED bool saveTextFile(const char* filename, const LineArray& lineArray, LineEnding lineEnding = LineEnding::LF);
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
@@ -0,0 +1,197 @@
+#pragma once
+
+// This file defines TextLine, a line of text stored as a gap buffer,
+// so that repeated edits near the same column, e.g. typing or
+// deleting one character at a time, take amortized O(1) time,
+// even in very long lines.
+
+#include "../UICommon.h"
+
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Types.h>
+
+#include <string.h>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+// The text is buffer[0, gapBegin) followed by buffer[gapEnd, capacity),
+// and the gap is moved to each edit, so only the text between the previous
+// edit and the current one is moved, instead of everything after the edit.
+//
+// Most lines are short, so lines up to INLINE_CAPACITY bytes are stored in
+// the TextLine itself, without a separate allocation.
+//
+// A line can also borrow text owned by something else, e.g. a mapped file,
+// in which case the text is the whole buffer, with an empty gap at the end.
+// The text is copied into the line on the first edit.
+class TextLine {
+public:
+	constexpr static size_t INLINE_CAPACITY = 23;
+
+private:
+	enum class Storage : uint8 {
+		SMALL,
+		OWNED,
+		BORROWED
+	};
+
+	// Both start with storage, so it can be read from either one.
+	struct ExternalBuffer {
+		Storage storage;
+		// This is only written to if storage is OWNED.
+		char* text;
+		size_t capacity;
+	};
+	struct InlineBuffer {
+		Storage storage;
+		char text[INLINE_CAPACITY];
+	};
+	union {
+		ExternalBuffer external;
+		InlineBuffer small;
+	};
+	size_t gapBegin;
+	size_t gapEnd;
+
+	INLINE Storage storage() const {
+		return small.storage;
+	}
+	INLINE char* buffer() {
+		return (storage() == Storage::SMALL) ? small.text : external.text;
+	}
+	INLINE const char* buffer() const {
+		return (storage() == Storage::SMALL) ? small.text : external.text;
+	}
+	INLINE size_t capacity() const {
+		return (storage() == Storage::SMALL) ? INLINE_CAPACITY : external.capacity;
+	}
+	INLINE void setEmptyInline() {
+		small.storage = Storage::SMALL;
+		gapBegin = 0;
+		gapEnd = INLINE_CAPACITY;
+	}
+	INLINE void moveFrom(TextLine& that) {
+		memcpy(&external, &that.external, (sizeof(external) > sizeof(small)) ? sizeof(external) : sizeof(small));
+		gapBegin = that.gapBegin;
+		gapEnd = that.gapEnd;
+		that.setEmptyInline();
+	}
+
+public:
+	INLINE TextLine() {
+		setEmptyInline();
+	}
+
+	// Starts with a copy of the text, with no gap, so no space is wasted
+	// until the line is edited.
+	UICOMMON_LIBRARY_EXPORTED TextLine(const char* textBegin, const char* textEnd);
+
+	INLINE ~TextLine() {
+		freeBuffer();
+	}
+
+	INLINE TextLine(TextLine&& that) {
+		moveFrom(that);
+	}
+	INLINE TextLine& operator=(TextLine&& that) {
+		if (this != &that) {
+			freeBuffer();
+			moveFrom(that);
+		}
+		return *this;
+	}
+
+	TextLine(const TextLine&) = delete;
+	TextLine& operator=(const TextLine&) = delete;
+
+	// Replaces the contents with the text from textBegin to textEnd without
+	// copying it, so it must stay valid until this line is edited, borrows
+	// other text, or is destructed.  Text that fits inline is copied anyway,
+	// since that takes no extra memory.
+	UICOMMON_LIBRARY_EXPORTED void borrow(const char* textBegin, const char* textEnd);
+
+	INLINE bool isBorrowed() const {
+		return storage() == Storage::BORROWED;
+	}
+
+	// Number of bytes of text, excluding the gap.
+	INLINE size_t size() const {
+		return capacity() - (gapEnd - gapBegin);
+	}
+
+	INLINE char operator[](size_t col) const {
+		return (col < gapBegin) ? buffer()[col] : buffer()[col + (gapEnd - gapBegin)];
+	}
+
+	// Appends the text from beginCol to endCol to text, which is
+	// at most two copies, one on each side of the gap.
+	UICOMMON_LIBRARY_EXPORTED void appendTo(Array<char>& text, size_t beginCol, size_t endCol) const;
+
+	INLINE void appendTo(Array<char>& text) const {
+		appendTo(text, 0, size());
+	}
+
+	// Calls visitor with the text from beginCol to endCol, without copying it
+	// or moving the gap, so it's at most two calls, one on each side of the gap.
+	// Returns false if visitor returned false, to stop early.
+	UICOMMON_LIBRARY_EXPORTED bool visit(
+		size_t beginCol,
+		size_t endCol,
+		bool (*visitor)(const char* text, size_t size, void* data),
+		void* data
+	) const;
+
+	// Returns a pointer to the text, moving the gap to the end, so that
+	// the text is contiguous until the next edit.  Borrowed text is returned
+	// directly, without copying it.
+	UICOMMON_LIBRARY_EXPORTED const char* data();
+
+	// Replaces the text from beginCol to endCol with the text from
+	// textBegin to textEnd, returning the column after the new text.
+	UICOMMON_LIBRARY_EXPORTED size_t replace(size_t beginCol, size_t endCol, const char* textBegin, const char* textEnd);
+
+	INLINE void append(const char* textBegin, const char* textEnd) {
+		const size_t col = size();
+		replace(col, col, textBegin, textEnd);
+	}
+
+	// Removes the text after col.
+	INLINE void truncate(size_t col) {
+		replace(col, size(), nullptr, nullptr);
+	}
+
+	// Replaces the contents with the text from textBegin to textEnd,
+	// keeping the buffer if it's large enough.
+	INLINE void assign(const char* textBegin, const char* textEnd) {
+		if (isBorrowed()) {
+			setEmptyInline();
+		}
+		else {
+			gapBegin = 0;
+			gapEnd = capacity();
+		}
+		replace(0, 0, textBegin, textEnd);
+	}
+
+	INLINE void clear() {
+		freeBuffer();
+		setEmptyInline();
+	}
+
+private:
+	UICOMMON_LIBRARY_EXPORTED void freeBuffer();
+
+	// Copies borrowed text into the line, so that it can be edited.
+	void copyBorrowedText();
+
+	// Moves the gap to start at col, moving the text between.
+	void moveGap(size_t col);
+
+	// Moves the text into a larger buffer, with a gap of at least minGapSize.
+	void grow(size_t minGapSize);
+};
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
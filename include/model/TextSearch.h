@@ -0,0 +1,90 @@
+#pragma once
+
+#include "LineArray.h"
+#include "../UICommon.h"
+
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Types.h>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+// The set of all matches of a literal pattern in a LineArray, found using
+// SSE2 to check 16 candidate positions at a time, with large documents split
+// across threads.  Matches are found within lines, and don't overlap, so
+// after an edit, only the edited lines need to be searched again.
+//
+// The matches aren't updated automatically when the text changes, so after
+// every change, one of the update functions must be called, (or findAll,
+// or clear), before the matches are used again.  That includes lines
+// evicted from a TailLineArray, for which removeFirstLines must be called.
+class TextSearch {
+	Array<char> pattern;
+	bool caseSensitive;
+
+	// The beginning of each match, in increasing order.  Every match is
+	// pattern.size() bytes, since only ASCII letters are case-folded.
+	Array<LineArray::Position> matches;
+
+public:
+	INLINE TextSearch() : caseSensitive(true) {}
+
+	// Sets the pattern, removing any matches, so findAll must be called again.
+	// The pattern can't contain line breaks, since matches are within lines.
+	// If caseSensitive is false, ASCII letters match either case.
+	UICOMMON_LIBRARY_EXPORTED void setPattern(const char* patternBegin, const char* patternEnd, bool caseSensitive = true);
+
+	INLINE size_t getPatternSize() const {
+		return pattern.size();
+	}
+
+	INLINE const Array<LineArray::Position>& getMatches() const {
+		return matches;
+	}
+
+	// Replaces the matches with all matches in lineArray.
+	UICOMMON_LIBRARY_EXPORTED void findAll(const LineArray& lineArray);
+
+	// Updates the matches after the text from begin to oldEnd in lineArray was
+	// replaced with text now ending at newEnd, searching only the edited lines,
+	// and moving the later matches to their new lines.
+	UICOMMON_LIBRARY_EXPORTED void update(
+		const LineArray& lineArray,
+		const LineArray::Position& begin,
+		const LineArray::Position& oldEnd,
+		const LineArray::Position& newEnd
+	);
+
+	// Updates the matches after LineArray::replaceMany, using the ranges
+	// recorded in undoEvent, or after undoing it, since the undo refills it.
+	UICOMMON_LIBRARY_EXPORTED void update(const TextBatchReplacementEvent& undoEvent);
+
+	// Updates the matches after the first numLines lines were removed,
+	// e.g. evicted from a TailLineArray, which can be found from the change in
+	// TailLineArray::getFirstLineNumber.  Matches in those lines are removed,
+	// and the later ones are moved up.  For TailLineArray::append, call this
+	// for the evicted lines, then update for the appended text, with
+	// positions after the eviction.  TailLineArray::replaceMany only evicts
+	// lines before its first replacement, and its undo event has positions
+	// after the eviction, so call this, then update with the event, the same
+	// way after replaceMany or after undoing it.
+	UICOMMON_LIBRARY_EXPORTED void removeFirstLines(size_t numLines);
+
+	// Finds the first match at or after position, returning false if there
+	// are none, e.g. for "find next".
+	UICOMMON_LIBRARY_EXPORTED bool findNext(const LineArray::Position& position, size_t& matchIndex) const;
+
+	INLINE void clear() {
+		matches.setSize(0);
+	}
+
+	// Appends the matches in lines [beginLine, endLine) to lineMatches,
+	// without changing the stored matches, e.g. to search only part of the
+	// text.  This doesn't modify anything, so it can be called on multiple
+	// threads at once.
+	UICOMMON_LIBRARY_EXPORTED void findInLines(const LineArray& lineArray, size_t beginLine, size_t endLine, Array<LineArray::Position>& lineMatches) const;
+};
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
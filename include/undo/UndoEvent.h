@@ -98,7 +98,7 @@ protected:
 	static void destruct(UndoEvent* undoEvent) {
 		// Assert that original points to an UndoSequence.
 		assert(undoEvent);
-		assert(undoEvent->type == staticType);
+		assert(undoEvent->type == &staticType);
 		UndoSequence* sequence = static_cast<UndoSequence*>(undoEvent);
 		// Destruct the array.
 		sequence->sequence.setCapacity(0);
@@ -108,7 +108,7 @@ protected:
 	static std::unique_ptr<UndoEvent> undo(std::unique_ptr<UndoEvent>&& original) {
 		// Assert that original points to an UndoSequence.
 		assert(original);
-		assert(original->type == staticType);
+		assert(original->type == &staticType);
 		UndoSequence* sequence = static_cast<UndoSequence*>(original.release());
 		auto& array = sequence->sequence;
 
@@ -133,9 +133,8 @@ protected:
 	}
 
 	static void getDescription(const UndoEvent& undoEvent, Array<char>& text) {
-		// Assert that original points to an UndoSequence.
-		assert(undoEvent);
-		assert(undoEvent->type == staticType);
+		// Assert that undoEvent is an UndoSequence.
+		assert(undoEvent.type == &staticType);
 		const UndoSequence& sequence = static_cast<const UndoSequence&>(undoEvent);
 		text.append(sequence.description.begin(), sequence.description.end());
 	}
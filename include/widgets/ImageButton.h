@@ -55,6 +55,8 @@ protected:
 
 private:
 	static inline UIBoxClass initClass();
+
+	friend struct UIStaticDispatch;
 };
 
 UICOMMON_LIBRARY_NAMESPACE_END
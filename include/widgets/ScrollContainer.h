@@ -0,0 +1,54 @@
+#pragma once
+
+#include "../UIBox.h"
+#include "../UICommon.h"
+
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Vec.h>
+#include <Types.h>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+// A container whose children can be scrolled within its bounds.
+// The children are positioned by the user, as they would be when scrolled
+// to the top left, and scrolling moves all of them.
+//
+// Scrolling by whole pixels moves the pixels of the contents that stay
+// visible, instead of redrawing them, so nothing may be drawn over this box,
+// or it would be moved along with the contents.
+struct ScrollContainer : public UIContainer {
+	// Distance the contents are scrolled right and down, (i.e. the
+	// contents move left and up, toward negative x and positive y).
+	Vec2f scrollPosition;
+
+	// Size of the contents, limiting scrollPosition to keep them in view.
+	Vec2f contentSize;
+
+	// Distance scrolled per mouse wheel notch.
+	float scrollDistancePerNotch;
+
+	UICOMMON_LIBRARY_EXPORTED static const UIContainerClass staticType;
+
+	UICOMMON_LIBRARY_EXPORTED ScrollContainer();
+
+	// Scrolls to position, limited to the range of contentSize,
+	// and rounded to whole pixels, so that the contents can be moved
+	// instead of redrawn.
+	UICOMMON_LIBRARY_EXPORTED void scrollTo(const Vec2f& position);
+
+protected:
+	UICOMMON_LIBRARY_EXPORTED static UIBox* construct();
+	UICOMMON_LIBRARY_EXPORTED static void onMouseScroll(UIBox& box, float scrollAmount, const MouseState& state);
+	UICOMMON_LIBRARY_EXPORTED static void writeData(const UIBox& box, Array<uint8>& output);
+	UICOMMON_LIBRARY_EXPORTED static bool readData(UIBox& box, const uint8* data, size_t size);
+
+private:
+	static inline UIContainerClass initClass();
+
+	friend struct UIStaticDispatch;
+};
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "../UIBox.h"
+#include "../UICommon.h"
+#include "../FenwickTree.h"
+
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Vec.h>
+#include <Types.h>
+
+#include <memory>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+// A vertically scrolling list of rows, which only has child boxes for the rows
+// intersecting its bounds.  Children are recycled as rows scroll in and out
+// of view, so drawing and hit testing only ever look at the visible rows,
+// no matter how many rows there are.
+//
+// The children are regular UIContainer children, ordered by row, with
+// children[i] showing row firstChildRow+i.
+struct VirtualList : public UIContainer {
+	// This is called to create a new row box when there are no recycled ones.
+	UIBox* (*createRow)(VirtualList& list);
+
+	// This is called to fill in row with the contents for rowIndex, when the
+	// row box is first shown or recycled for a different row, or after
+	// rowsChanged is called.
+	void (*bindRow)(VirtualList& list, UIBox& row, size_t rowIndex);
+
+	void* callbackData;
+
+	// Distance from the top of the first row to the top of the list.
+	// Rows go down from the top of the list, (i.e. toward negative y).
+	float scrollPosition;
+
+	// Number of rows of defaultRowHeight scrolled per mouse wheel notch.
+	float rowsPerWheelNotch;
+
+	float defaultRowHeight;
+
+	UICOMMON_LIBRARY_EXPORTED static const UIContainerClass staticType;
+
+	UICOMMON_LIBRARY_EXPORTED VirtualList();
+
+	INLINE size_t getNumRows() const {
+		return rowHeights.size();
+	}
+
+	INLINE size_t getFirstChildRow() const {
+		return firstChildRow;
+	}
+
+	// Total height of all rows.
+	INLINE float getContentHeight() const {
+		return rowOffsets.total();
+	}
+
+	// Returns the offset of the top of the row from the top of the first row,
+	// in O(log n) time.
+	INLINE float getRowOffset(size_t rowIndex) const {
+		return rowOffsets.prefixSum(rowIndex);
+	}
+
+	// Returns the index of the row at the given offset from the top of the
+	// first row, in O(log n) time, or getNumRows() if it's past the last row.
+	INLINE size_t findRowAtOffset(float offset) const {
+		return rowOffsets.findIndex(offset);
+	}
+
+	// Replaces all rows with numRows rows of defaultRowHeight, scrolled to the top.
+	UICOMMON_LIBRARY_EXPORTED void setNumRows(size_t numRows);
+
+	// Adds a row at the end.
+	UICOMMON_LIBRARY_EXPORTED void appendRow(float height);
+
+	UICOMMON_LIBRARY_EXPORTED void setRowHeight(size_t rowIndex, float height);
+
+	// Scrolls so that position is at the top of the list, limited to
+	// the range of the content.
+	UICOMMON_LIBRARY_EXPORTED void scrollTo(float position);
+
+	// Calls bindRow on all visible rows, e.g. after the data they show changed.
+	UICOMMON_LIBRARY_EXPORTED void rowsChanged();
+
+	// Creates, recycles, and positions children to match the visible rows.
+	// This is called automatically after scrolling, resizing, or changing rows.
+	UICOMMON_LIBRARY_EXPORTED void updateVisibleRows();
+
+protected:
+	// rowOffsets has the same values as rowHeights, so that the offset of
+	// any row can be found or updated in O(log n) time.
+	Array<float> rowHeights;
+	FenwickTree<float> rowOffsets;
+
+	size_t firstChildRow;
+
+	// Children that scrolled out of view, to be rebound to rows scrolling into view.
+	Array<std::unique_ptr<UIBox>> recycledRows;
+
+	UICOMMON_LIBRARY_EXPORTED static UIBox* construct();
+	UICOMMON_LIBRARY_EXPORTED static void destruct(UIBox* box);
+	UICOMMON_LIBRARY_EXPORTED static void onMouseScroll(UIBox& box, float scrollAmount, const MouseState& state);
+	UICOMMON_LIBRARY_EXPORTED static void layout(UIContainer& container);
+	UICOMMON_LIBRARY_EXPORTED static void writeData(const UIBox& box, Array<uint8>& output);
+	UICOMMON_LIBRARY_EXPORTED static bool readData(UIBox& box, const uint8* data, size_t size);
+
+private:
+	// Moves the children to show the rows intersecting the list's bounds,
+	// reusing the children of rows that stay visible, (rebinding them only
+	// if rebindAll is true), and recycling the children of rows that don't.
+	void updateRows(bool rebindAll);
+
+	// Sets scrollPosition and updates the rows, moving the pixels of rows
+	// that stay visible, so only newly exposed rows are redrawn.
+	void scrollRows(float position);
+
+	static inline UIContainerClass initClass();
+
+	friend struct UIStaticDispatch;
+};
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
@@ -3,6 +3,7 @@
 #include <Types.h>
 
 #include <assert.h>
+#include <string.h>
 
 OUTER_NAMESPACE_BEGIN
 UICOMMON_LIBRARY_NAMESPACE_BEGIN
@@ -57,7 +58,7 @@ void Image::applyRectangle(const Box2f& rectangle, const Vec4f& colour) {
 	};
 	const Box2<size_t> contractedRectangle(minCeil, maxFloor);
 
-	Vec4f* beginPixels = pixels_.get();
+	Vec4f* beginPixels = pixels();
 	beginPixels += contractedRectangle[1][0]*size_[0] + contractedRectangle[0][0];
 	const size_t midHeight = contractedRectangle[1][1] - contractedRectangle[1][0];
 	const size_t midWidth = contractedRectangle[0][1] - contractedRectangle[0][0];
@@ -206,7 +207,7 @@ void Image::applyImage(const Box2f& destRectangleIn, const Image& srcImage, cons
 	};
 	const Box2<size_t> contractedRectangle(minCeil, maxFloor);
 
-	Vec4f* beginDestPixels = pixels_.get();
+	Vec4f* beginDestPixels = pixels();
 	beginDestPixels += contractedRectangle[1][0]*size_[0] + contractedRectangle[0][0];
 	const size_t midHeight = contractedRectangle[1][1] - contractedRectangle[1][0];
 	const size_t midWidth = contractedRectangle[0][1] - contractedRectangle[0][0];
@@ -280,5 +281,98 @@ void Image::applyImage(const Box2f& destRectangleIn, const Image& srcImage, cons
 	// FIXME: Apply contributions to incomplete pixels!!!
 }
 
+void Image::moveRectangle(const Box2<size_t>& srcRectangle, const Vec2<size_t>& destMin) {
+	// Clip the source and destination to the image.
+	size_t srcMin[2];
+	size_t destBegin[2];
+	size_t extent[2];
+	for (size_t axis = 0; axis < 2; ++axis) {
+		srcMin[axis] = srcRectangle[axis][0];
+		destBegin[axis] = destMin[axis];
+		size_t srcEnd = (srcRectangle[axis][1] < size_[axis]) ? srcRectangle[axis][1] : size_[axis];
+		if (srcEnd <= srcMin[axis] || destBegin[axis] >= size_[axis]) {
+			return;
+		}
+		extent[axis] = srcEnd - srcMin[axis];
+		if (destBegin[axis] + extent[axis] > size_[axis]) {
+			extent[axis] = size_[axis] - destBegin[axis];
+		}
+	}
+
+	Vec4f* allPixels = pixels();
+	const size_t rowBytes = extent[0]*sizeof(Vec4f);
+	if (destBegin[1] <= srcMin[1]) {
+		// Moving down in memory, so go forward, so rows aren't overwritten before being moved.
+		for (size_t y = 0; y < extent[1]; ++y) {
+			memmove(
+				allPixels + (destBegin[1]+y)*size_[0] + destBegin[0],
+				allPixels + (srcMin[1]+y)*size_[0] + srcMin[0],
+				rowBytes);
+		}
+	}
+	else {
+		// Moving up in memory, so go backward.
+		for (size_t y = extent[1]; y > 0; ) {
+			--y;
+			memmove(
+				allPixels + (destBegin[1]+y)*size_[0] + destBegin[0],
+				allPixels + (srcMin[1]+y)*size_[0] + srcMin[0],
+				rowBytes);
+		}
+	}
+}
+
+void Image::copyRectangle(const Image& srcImage, const Box2<size_t>& rectangle) {
+	assert(srcImage.size_[0] == size_[0] && srcImage.size_[1] == size_[1]);
+	if (srcImage.size_[0] != size_[0] || srcImage.size_[1] != size_[1]) {
+		return;
+	}
+	const size_t xEnd = (rectangle[0][1] < size_[0]) ? rectangle[0][1] : size_[0];
+	const size_t yEnd = (rectangle[1][1] < size_[1]) ? rectangle[1][1] : size_[1];
+	if (rectangle[0][0] >= xEnd || rectangle[1][0] >= yEnd) {
+		return;
+	}
+	const size_t rowBytes = (xEnd - rectangle[0][0])*sizeof(Vec4f);
+	const Vec4f* srcPixels = srcImage.pixels_.get();
+	Vec4f* destPixels = pixels();
+	for (size_t y = rectangle[1][0]; y < yEnd; ++y) {
+		const size_t offset = y*size_[0] + rectangle[0][0];
+		memcpy(destPixels + offset, srcPixels + offset, rowBytes);
+	}
+}
+
+void Image::makeUnique() {
+	const size_t numPixels = size_[0]*size_[1];
+	std::shared_ptr<Vec4f[]> newPixels(new Vec4f[numPixels]);
+	memcpy(newPixels.get(), pixels_.get(), numPixels*sizeof(Vec4f));
+	pixels_ = std::move(newPixels);
+}
+
+void DrawList::draw(Image& target) const {
+	for (const DrawCommand& command : commands) {
+		switch (command.type) {
+			case DrawCommand::Type::RECTANGLE: {
+				target.applyRectangle(command.destRectangle, command.colour);
+				break;
+			}
+			case DrawCommand::Type::IMAGE: {
+				target.applyImage(command.destRectangle, images[command.imageIndex], command.srcRectangle);
+				break;
+			}
+			case DrawCommand::Type::MOVE: {
+				const Box2f& src = command.srcRectangle;
+				target.moveRectangle(
+					Box2<size_t>(
+						Vec2<size_t>(size_t(src[0][0]), size_t(src[1][0])),
+						Vec2<size_t>(size_t(src[0][1]), size_t(src[1][1]))
+					),
+					Vec2<size_t>(size_t(command.destRectangle[0][0]), size_t(command.destRectangle[1][0]))
+				);
+				break;
+			}
+		}
+	}
+}
+
 UICOMMON_LIBRARY_NAMESPACE_END
 OUTER_NAMESPACE_END
@@ -3,7 +3,10 @@
 
 #include "MainWindow.h"
 #include "Canvas.h"
+#include "UIAccelerators.h"
+#include "UIAnimation.h"
 #include "UIBox.h"
+#include "UIFlatTree.h"
 
 #include <SDL.h>
 #include <Array.h>
@@ -11,6 +14,9 @@
 #include <bmp/sRGB.h>
 #include <Types.h>
 
+#include <atomic>
+#include <math.h>
+#include <string.h>
 #include <emmintrin.h> // For _mm_pause
 
 OUTER_NAMESPACE_BEGIN
@@ -18,24 +24,162 @@ UICOMMON_LIBRARY_NAMESPACE_BEGIN
 
 static Array<SDL_Rect> monitorBounds;
 static SDL_Window* mainWindow;
-static Canvas mainCanvas;
 static MainWindow* mainWindowContainer;
+
+// Flat copy of the tree of mainWindowContainer, which is current on the UI
+// thread, so that drawing and mouse routing read it while it's up to date.
+static UIFlatTree mainWindowTree;
 static Array<SDL_Window*> otherWindows;
 
 static Array<UIExitListener*> exitListeners;
 
-static SDL_TimerID uiTimerID;
-static volatile bool isInsideTimerCallback;
-
 static volatile bool isExiting = false;
 
 static SDL_Thread* drawThread;
 static SDL_cond* drawThreadCond;
 static SDL_mutex* drawThreadCondLock;
 
-static uint64 lastDrawUIModCount = 0;
-// TODO: Make this atomic for increment, though reading can be relaxed.
-static uint64 uiStateModCount = 1;
+// Frames pass through a pipeline of 3 stages, each on its own thread:
+// the draw thread draws a DrawList into a frame's linear colour image,
+// the convert thread converts that into the window's sRGB pixel format,
+// and the present thread copies that into the window surface and presents it.
+// With as many frames as stages, each stage can work on a different frame
+// at the same time, so the frame rate is limited by the slowest stage,
+// instead of the sum of all stages.
+struct PipelineFrame {
+	Image image;
+	Array<uint8> convertedPixels;
+	Vec2<size_t> size;
+	uint64 inputTime;
+	uint64 drawStartTime;
+
+	// Regions of image that are older than the most recently drawn frame,
+	// because other frames were drawn since this one was last drawn.
+	// These are only accessed by the draw thread.
+	Array<Box2<size_t>> staleRectangles;
+
+	// Regions of image that have changed since convertedPixels was converted.
+	Array<Box2<size_t>> unconvertedRectangles;
+
+	// Regions of the window that changed since the previously presented frame,
+	// including the changes of any frames dropped in between.
+	Array<Box2<size_t>> presentRectangles;
+};
+
+enum class PipelineFrameState {
+	FREE,
+	DRAWING,
+	DRAWN,
+	CONVERTING,
+	CONVERTED,
+	PRESENTING
+};
+
+constexpr static uint32 NUM_PIPELINE_FRAMES = 3;
+constexpr static uint32 NO_PIPELINE_FRAME = ~uint32(0);
+
+// All members of this are protected by pipelineLock, except the contents of
+// each frame, which are only accessed by the stage whose state it's in.
+// Only the most recently finished frame is kept waiting for each of the
+// later stages, so if the earlier stages are faster, older frames are dropped,
+// and if the later stages are faster, the earlier stages must wait for a free frame.
+struct FramePipeline {
+	PipelineFrame frames[NUM_PIPELINE_FRAMES];
+	PipelineFrameState states[NUM_PIPELINE_FRAMES];
+	uint32 drawnFrame = NO_PIPELINE_FRAME;
+	uint32 convertedFrame = NO_PIPELINE_FRAME;
+};
+
+static FramePipeline pipeline;
+
+// The pipeline frame whose image has the most recently drawn frame,
+// for bringing other images up to date before drawing partial frames.
+// This is only accessed by the draw thread.
+static uint32 lastDrawnPipelineFrame = NO_PIPELINE_FRAME;
+
+static SDL_mutex* pipelineLock;
+static SDL_cond* pipelineCond;
+static SDL_Thread* convertThread;
+static SDL_Thread* presentThread;
+static Uint8 screenBytesPerPixel;
+
+// uiStateModCount is incremented by setNeedRedraw, possibly from other threads.
+// lastRecordedUIModCount is only accessed by the UI thread.
+static std::atomic<uint64> uiStateModCount(1);
+static uint64 lastRecordedUIModCount = 0;
+
+// Event type registered with SDL for setNeedRedraw to wake up the UI thread
+// from other threads, so that it doesn't conflict with any SDL_USEREVENT
+// events of the application.  The event itself doesn't need handling,
+// since recordFrame checks uiStateModCount after each batch of events.
+static Uint32 wakeUpEventType = Uint32(-1);
+
+// This is true while the draw thread is waiting for a new DrawList,
+// so that the UI thread only needs to signal drawThreadCond when it's idle.
+static std::atomic<bool> isDrawThreadIdle(false);
+
+// DrawList objects are triple-buffered between the UI thread, which records
+// them, and the draw thread, which draws them, so that neither blocks the other.
+// The UI thread owns drawLists[uiDrawListIndex], the draw thread owns
+// drawLists[drawThreadDrawListIndex], and the remaining one's index is in
+// publishedDrawListState, along with FRESH_DRAW_LIST_BIT if the UI thread
+// has published it, but the draw thread hasn't taken it yet.
+static DrawList drawLists[3];
+static uint32 uiDrawListIndex = 0;
+static uint32 drawThreadDrawListIndex = 2;
+static std::atomic<uint32> publishedDrawListState(1);
+constexpr static uint32 DRAW_LIST_INDEX_MASK = 3;
+constexpr static uint32 FRESH_DRAW_LIST_BIT = 4;
+
+// Canvas used by the UI thread to record into drawLists[uiDrawListIndex].
+static Canvas recordingCanvas;
+
+// setNeedRedraw doesn't say what changed, so it sets this to redraw the
+// whole frame.  Otherwise, only pendingDamageRectangles are redrawn,
+// after moving the pixels of pendingMoves.
+static std::atomic<bool> isFullRedrawNeeded(true);
+
+struct PendingMove {
+	Box2<size_t> srcRectangle;
+	Vec2<size_t> destMin;
+};
+
+// These are only accessed by the UI thread.
+static Array<Box2<size_t>> pendingDamageRectangles;
+static Array<PendingMove> pendingMoves;
+static Vec2<size_t> lastRecordedSize(0,0);
+
+// If the draw thread falls behind, the UI thread adds to the DrawList it
+// hasn't taken yet, so if it falls far behind, the whole frame is redrawn
+// instead, to limit how much the DrawList can grow.
+constexpr static size_t MAX_EXTENDED_DRAW_COMMANDS = 8192;
+
+// Merging rectangles into their bounding box past this many avoids spending
+// more time on the rectangles than on the extra area.
+constexpr static size_t MAX_DAMAGE_RECTANGLES = 16;
+
+static thread_local bool isUIThread = false;
+
+// Minimum performance counter interval between the starts of frames,
+// or 0 to draw as soon as anything changes.
+static std::atomic<uint64> frameIntervalCounts(0);
+// setTargetFrameRate may be called from any thread, so this is atomic too.
+static std::atomic<float> targetFrameRate(60.0f);
+
+// Performance counter value when the UI thread received the input event
+// it's currently handling, or 0 if it's not handling an input event.
+// This is thread_local so that setNeedRedraw calls from other threads
+// aren't attributed to input events.
+static thread_local uint64 currentInputEventTime = 0;
+
+// Performance counter value of the earliest input event that called
+// setNeedRedraw since the UI thread last recorded a frame, or 0 if none.
+// This is only accessed by the UI thread.
+static uint64 pendingInputEventTime = 0;
+
+static SDL_mutex* frameStatsLock;
+static FrameLatencyStats frameStats;
+static uint64 performanceFrequency;
 
 constexpr static Vec4f defaultBackgroundColour(0.5f,0.5f,0.5f,1.0f);
 
@@ -59,130 +203,452 @@ UIContainerClass MainWindow::initClass() {
 
 const UIContainerClass MainWindow::staticType(MainWindow::initClass());
 
-static void convertToSRGB(const Vec4f* inputColours, uint8* outputData, size_t bytesPerPixel, size_t width, size_t height) {
+static bool isEmptyRectangle(const Box2<size_t>& rectangle) {
+	return rectangle[0][0] >= rectangle[0][1] || rectangle[1][0] >= rectangle[1][1];
+}
+
+// Limits rectangle to be within (0,0) to size.
+static Box2<size_t> clipRectangle(const Box2<size_t>& rectangle, const Vec2<size_t>& size) {
+	Box2<size_t> clipped(rectangle);
+	for (size_t axis = 0; axis < 2; ++axis) {
+		if (clipped[axis][1] > size[axis]) {
+			clipped[axis][1] = size[axis];
+		}
+		if (clipped[axis][0] > clipped[axis][1]) {
+			clipped[axis][0] = clipped[axis][1];
+		}
+	}
+	return clipped;
+}
+
+static void addDamageRectangle(Array<Box2<size_t>>& rectangles, const Box2<size_t>& rectangle) {
+	if (isEmptyRectangle(rectangle)) {
+		return;
+	}
+	for (const Box2<size_t>& existing : rectangles) {
+		if (existing[0][0] <= rectangle[0][0] && existing[0][1] >= rectangle[0][1] &&
+			existing[1][0] <= rectangle[1][0] && existing[1][1] >= rectangle[1][1]
+		) {
+			// Already covered.
+			return;
+		}
+	}
+	if (rectangles.size() < MAX_DAMAGE_RECTANGLES) {
+		rectangles.append(rectangle);
+		return;
+	}
+	Box2<size_t> bounds(rectangle);
+	for (const Box2<size_t>& existing : rectangles) {
+		for (size_t axis = 0; axis < 2; ++axis) {
+			if (existing[axis][0] < bounds[axis][0]) {
+				bounds[axis][0] = existing[axis][0];
+			}
+			if (existing[axis][1] > bounds[axis][1]) {
+				bounds[axis][1] = existing[axis][1];
+			}
+		}
+	}
+	rectangles.setSize(1);
+	rectangles[0] = bounds;
+}
+
+static void addDamageRectangles(Array<Box2<size_t>>& rectangles, const Array<Box2<size_t>>& newRectangles) {
+	for (const Box2<size_t>& rectangle : newRectangles) {
+		addDamageRectangle(rectangles, rectangle);
+	}
+}
+
+// Converts the pixels of inputColours in rectangle to the screen format in
+// outputData, which is flipped vertically, since the y axis of the UI points up.
+static void convertToSRGB(const Vec4f* inputColours, uint8* outputData, size_t bytesPerPixel, size_t width, size_t height, const Box2<size_t>& rectangle) {
 	// FIXME: Parallelize this!!!
-	if (bytesPerPixel == 4) {
-		uint32* outputColours = reinterpret_cast<uint32*>(outputData);
-		outputColours += width*(height-1);
-		for (size_t y = 0; y < height; ++y) {
-			for (size_t x = 0; x < width; ++x) {
+	const Box2<size_t> clipped = clipRectangle(rectangle, Vec2<size_t>(width, height));
+	const size_t xBegin = clipped[0][0];
+	const size_t rectangleWidth = clipped[0][1] - xBegin;
+	for (size_t y = clipped[1][0]; y < clipped[1][1]; ++y) {
+		const Vec4f* input = inputColours + y*width + xBegin;
+		uint8* output = outputData + ((height-1-y)*width + xBegin)*bytesPerPixel;
+		if (bytesPerPixel == 4) {
+			uint32* outputColours = reinterpret_cast<uint32*>(output);
+			for (size_t x = 0; x < rectangleWidth; ++x) {
 				// FIXME: Use a fast approximation, instead of the exact calculation!!!
-				uint32 outputColour = bmp::linearToSRGB(*inputColours);
-				++inputColours;
-				*outputColours = outputColour;
-				++outputColours;
+				outputColours[x] = bmp::linearToSRGB(input[x]);
 			}
-			outputColours -= 2*width;
 		}
-	}
-	else {
-		outputData += 3*width*(height-1);
-		for (size_t y = 0; y < height; ++y) {
-			for (size_t x = 0; x < width; ++x) {
+		else {
+			for (size_t x = 0; x < rectangleWidth; ++x) {
 				// FIXME: Use a fast approximation, instead of the exact calculation!!!
-				uint32 outputColour = bmp::linearToSRGB(*inputColours);
-				++inputColours;
-				outputData[0] = uint8(outputColour);
-				outputData[1] = uint8(outputColour >> 8);
-				outputData[2] = uint8(outputColour >> 16);
-				outputData += 3;
+				uint32 outputColour = bmp::linearToSRGB(input[x]);
+				output[0] = uint8(outputColour);
+				output[1] = uint8(outputColour >> 8);
+				output[2] = uint8(outputColour >> 16);
+				output += 3;
 			}
-			outputData -= 6*width;
 		}
 	}
 }
 
-static int drawThreadFunction(void* data) {
-	// SDL_CondWait needs a lock that is locked, so we lock.
-	// We need to acquire uiStateLock anyway to access uiState.
-	SDL_LockMutex(drawThreadCondLock);
-	// Wait for a signal that there's drawing to be done.
-	SDL_CondWait(drawThreadCond, drawThreadCondLock);
+static uint64 countsToMicroseconds(uint64 counts) {
+	// Split the multiplication to avoid overflow for large counts.
+	const uint64 seconds = counts / performanceFrequency;
+	const uint64 remainder = counts % performanceFrequency;
+	return seconds*1000000 + (remainder*1000000)/performanceFrequency;
+}
+
+static void recordDroppedFrame() {
+	SDL_LockMutex(frameStatsLock);
+	++frameStats.numFramesDropped;
+	SDL_UnlockMutex(frameStatsLock);
+}
+
+static void recordFrameLatency(uint64 inputTime, uint64 drawStartTime, uint64 presentTime) {
+	SDL_LockMutex(frameStatsLock);
+	frameStats.drawStartToPresent.record(countsToMicroseconds(presentTime - drawStartTime));
+	if (inputTime != 0) {
+		frameStats.inputToDrawStart.record(countsToMicroseconds(drawStartTime - inputTime));
+		frameStats.inputToPresent.record(countsToMicroseconds(presentTime - inputTime));
+	}
+	++frameStats.numFramesPresented;
+	SDL_UnlockMutex(frameStatsLock);
+}
+
+void getFrameLatencyStats(FrameLatencyStats& stats) {
+	if (frameStatsLock == nullptr) {
+		stats = FrameLatencyStats();
+		return;
+	}
+	SDL_LockMutex(frameStatsLock);
+	stats = frameStats;
+	SDL_UnlockMutex(frameStatsLock);
+}
+
+void resetFrameLatencyStats() {
+	if (frameStatsLock == nullptr) {
+		return;
+	}
+	SDL_LockMutex(frameStatsLock);
+	frameStats = FrameLatencyStats();
+	SDL_UnlockMutex(frameStatsLock);
+}
 
+// Waits until a pipeline frame is free, marks it as being drawn, and returns
+// its index, or returns NO_PIPELINE_FRAME if exiting.
+static uint32 acquireFreePipelineFrame() {
+	uint32 frameIndex = NO_PIPELINE_FRAME;
+	SDL_LockMutex(pipelineLock);
 	while (!isExiting) {
-		const uint64 uiStateModCountCopy = uiStateModCount;
-		SDL_UnlockMutex(drawThreadCondLock);
+		for (uint32 i = 0; i < NUM_PIPELINE_FRAMES; ++i) {
+			if (pipeline.states[i] == PipelineFrameState::FREE) {
+				frameIndex = i;
+				break;
+			}
+		}
+		if (frameIndex != NO_PIPELINE_FRAME) {
+			pipeline.states[frameIndex] = PipelineFrameState::DRAWING;
+			break;
+		}
+		SDL_CondWait(pipelineCond, pipelineLock);
+	}
+	SDL_UnlockMutex(pipelineLock);
+	return frameIndex;
+}
 
-		// Draw to screen buffer.
-		// We reacquire screen each time, just in case window resized and screen was replaced.
-		SDL_Surface* screen = SDL_GetWindowSurface(mainWindow);
+// Passes a frame on to the next stage, via waitingFrame.  If the next stage
+// hasn't taken the previous frame yet, the previous frame is dropped.
+static void submitPipelineFrame(uint32 frameIndex, uint32& waitingFrame, PipelineFrameState newState) {
+	bool dropped = false;
+	SDL_LockMutex(pipelineLock);
+	if (waitingFrame != NO_PIPELINE_FRAME) {
+		// Keep the earliest input time, so that latency isn't underestimated.
+		const PipelineFrame& droppedFrame = pipeline.frames[waitingFrame];
+		PipelineFrame& frame = pipeline.frames[frameIndex];
+		if (droppedFrame.inputTime != 0 && (frame.inputTime == 0 || droppedFrame.inputTime < frame.inputTime)) {
+			frame.inputTime = droppedFrame.inputTime;
+		}
+		// The window must also be updated where the dropped frame changed it.
+		addDamageRectangles(frame.presentRectangles, droppedFrame.presentRectangles);
+		pipeline.states[waitingFrame] = PipelineFrameState::FREE;
+		dropped = true;
+	}
+	pipeline.states[frameIndex] = newState;
+	waitingFrame = frameIndex;
+	SDL_CondBroadcast(pipelineCond);
+	SDL_UnlockMutex(pipelineLock);
 
-		//printf("Drawing at %d\n", SDL_GetTicks());
-		if (mainCanvas.image.size()[0] != screen->w || mainCanvas.image.size()[1] != screen->h) {
-			// FIXME: The mainWindowContainer should have already been resized and had any necessary layout changes done!!!
-			mainWindowContainer->size = Vec2f(screen->w, screen->h);
-			mainCanvas.image.setSize(screen->w, screen->h);
+	if (dropped) {
+		recordDroppedFrame();
+	}
+}
+
+// Waits until there's a frame in waitingFrame, takes it, and returns its index,
+// or returns NO_PIPELINE_FRAME if exiting.
+static uint32 takePipelineFrame(uint32& waitingFrame, PipelineFrameState newState) {
+	uint32 frameIndex = NO_PIPELINE_FRAME;
+	SDL_LockMutex(pipelineLock);
+	while (!isExiting && waitingFrame == NO_PIPELINE_FRAME) {
+		SDL_CondWait(pipelineCond, pipelineLock);
+	}
+	if (!isExiting) {
+		frameIndex = waitingFrame;
+		waitingFrame = NO_PIPELINE_FRAME;
+		pipeline.states[frameIndex] = newState;
+	}
+	SDL_UnlockMutex(pipelineLock);
+	return frameIndex;
+}
+
+static void releasePipelineFrame(uint32 frameIndex) {
+	SDL_LockMutex(pipelineLock);
+	pipeline.states[frameIndex] = PipelineFrameState::FREE;
+	SDL_CondBroadcast(pipelineCond);
+	SDL_UnlockMutex(pipelineLock);
+}
+
+// Waits until the frame interval has passed since the previous frame started,
+// so that bursts of setNeedRedraw calls are coalesced into a single frame.
+static void waitForFrameInterval(uint64 previousFrameStartTime) {
+	const uint64 interval = frameIntervalCounts.load(std::memory_order_relaxed);
+	if (previousFrameStartTime == 0 || interval == 0) {
+		return;
+	}
+	const uint64 elapsed = SDL_GetPerformanceCounter() - previousFrameStartTime;
+	if (elapsed >= interval) {
+		return;
+	}
+	// Round up to whole milliseconds, to avoid waking up just before the deadline.
+	const uint64 remaining = interval - elapsed;
+	const Uint32 milliseconds = Uint32((remaining*1000 + performanceFrequency-1) / performanceFrequency);
+
+	// Wait on the condition variable, instead of SDL_Delay, so that exiting
+	// doesn't need to wait for the full interval.  The UI thread won't signal,
+	// because the draw thread isn't marked as idle.
+	SDL_LockMutex(drawThreadCondLock);
+	if (!isExiting) {
+		SDL_CondWaitTimeout(drawThreadCond, drawThreadCondLock, milliseconds);
+	}
+	SDL_UnlockMutex(drawThreadCondLock);
+}
+
+static int drawThreadFunction(void* data) {
+	uint64 previousFrameStartTime = 0;
+
+	while (true) {
+		// Sleep until there's a new DrawList to draw.  isDrawThreadIdle must be
+		// set before checking publishedDrawListState, so that the UI thread either
+		// sees that it needs to signal, or this sees the newly published DrawList.
+		SDL_LockMutex(drawThreadCondLock);
+		while (!isExiting) {
+			isDrawThreadIdle.store(true);
+			if ((publishedDrawListState.load() & FRESH_DRAW_LIST_BIT) != 0) {
+				break;
+			}
+			SDL_CondWait(drawThreadCond, drawThreadCondLock);
+		}
+		isDrawThreadIdle.store(false);
+		SDL_UnlockMutex(drawThreadCondLock);
+
+		if (isExiting) {
+			break;
 		}
 
-		Box2f bounds(Vec2f(0,0), mainWindowContainer->size);
-		MainWindow::staticType.draw(*mainWindowContainer, bounds, bounds, mainCanvas);
+		waitForFrameInterval(previousFrameStartTime);
 
-		SDL_LockSurface(screen);
+		// Wait for a free frame to draw into, before taking a DrawList,
+		// so that the most recent DrawList is drawn after waiting.
+		const uint32 frameIndex = acquireFreePipelineFrame();
+		if (frameIndex == NO_PIPELINE_FRAME) {
+			break;
+		}
+		PipelineFrame& frame = pipeline.frames[frameIndex];
 
-		Uint8 bytesPerPixel = screen->format->BytesPerPixel;
-		if (bytesPerPixel != 3 && bytesPerPixel != 4) {
-			// Only 3 and 4 bytes supported
-			return 0;
+		// Take the most recently published DrawList, which may be newer than
+		// the one that woke up this thread, if more were published while waiting.
+		// The UI thread may have taken it back to extend it while this was
+		// waiting, in which case, the published one was already drawn, so
+		// this must only take it while it's still fresh, and otherwise go back
+		// to waiting for the UI thread to publish the extended one.
+		uint32 previousState = publishedDrawListState.load();
+		bool isTaken = false;
+		while ((previousState & FRESH_DRAW_LIST_BIT) != 0) {
+			if (publishedDrawListState.compare_exchange_weak(previousState, drawThreadDrawListIndex)) {
+				isTaken = true;
+				break;
+			}
+		}
+		if (!isTaken) {
+			releasePipelineFrame(frameIndex);
+			continue;
 		}
+		drawThreadDrawListIndex = previousState & DRAW_LIST_INDEX_MASK;
+		DrawList& drawList = drawLists[drawThreadDrawListIndex];
 
-		convertToSRGB(mainCanvas.image.pixels(), (uint8*)(screen->pixels), bytesPerPixel, size_t(screen->w), size_t(screen->h));
+		frame.inputTime = drawList.inputEventTime.exchange(0);
+		frame.drawStartTime = SDL_GetPerformanceCounter();
+		previousFrameStartTime = frame.drawStartTime;
 
-		SDL_UnlockSurface(screen);
+		// Draw to the frame's image.
+		//printf("Drawing at %d\n", SDL_GetTicks());
+		const Vec2<size_t>& size = drawList.size;
+		if (frame.image.size()[0] != size[0] || frame.image.size()[1] != size[1]) {
+			frame.image.setSize(size[0], size[1]);
+			// None of the new image is valid yet.
+			const Box2<size_t> wholeFrame(Vec2<size_t>(0,0), size);
+			frame.staleRectangles.setSize(0);
+			addDamageRectangle(frame.staleRectangles, wholeFrame);
+			frame.unconvertedRectangles.setSize(0);
+			addDamageRectangle(frame.unconvertedRectangles, wholeFrame);
+		}
+		frame.size = size;
 
-		lastDrawUIModCount = uiStateModCountCopy;
+		if (drawList.isPartial) {
+			// The partial frame is drawn on top of the previous frame, so first
+			// bring this image up to date with the most recently drawn one.
+			// The UI thread records a full frame whenever the size changes,
+			// so the most recently drawn image is the same size.
+			if (lastDrawnPipelineFrame != NO_PIPELINE_FRAME && lastDrawnPipelineFrame != frameIndex) {
+				const Image& newestImage = pipeline.frames[lastDrawnPipelineFrame].image;
+				for (const Box2<size_t>& rectangle : frame.staleRectangles) {
+					frame.image.copyRectangle(newestImage, rectangle);
+				}
+			}
+			addDamageRectangles(frame.unconvertedRectangles, frame.staleRectangles);
+		}
+		frame.staleRectangles.setSize(0);
 
-		// Swap screen buffer contents with window buffer.
-		SDL_UpdateWindowSurface(mainWindow);
+		drawList.draw(frame.image);
 
-		// FIXME: Handle exiting in a more robust way without the race conditions!!!
-		if (isExiting) {
-			return 0;
+		// The other images don't have the changes of this frame.
+		const Array<Box2<size_t>>& damage = drawList.damageRectangles;
+		for (uint32 i = 0; i < NUM_PIPELINE_FRAMES; ++i) {
+			if (i != frameIndex) {
+				addDamageRectangles(pipeline.frames[i].staleRectangles, damage);
+			}
 		}
+		addDamageRectangles(frame.unconvertedRectangles, damage);
+		frame.presentRectangles.setSize(0);
+		addDamageRectangles(frame.presentRectangles, damage);
+		lastDrawnPipelineFrame = frameIndex;
 
-		SDL_LockMutex(drawThreadCondLock);
-		// Wait for a signal that there's drawing to be done.
-		SDL_CondWait(drawThreadCond, drawThreadCondLock);
+		submitPipelineFrame(frameIndex, pipeline.drawnFrame, PipelineFrameState::DRAWN);
 	}
 
-	SDL_UnlockMutex(drawThreadCondLock);
-
 	return 0;
 }
 
-static Uint32 uiTimerCallbackFunction(Uint32 interval, void* data) {
-	isInsideTimerCallback = true;
+static int convertThreadFunction(void* data) {
+	while (true) {
+		const uint32 frameIndex = takePipelineFrame(pipeline.drawnFrame, PipelineFrameState::CONVERTING);
+		if (frameIndex == NO_PIPELINE_FRAME) {
+			break;
+		}
+		PipelineFrame& frame = pipeline.frames[frameIndex];
 
-	if (uiTimerID == -1) {
-		isInsideTimerCallback = false;
-		return 0;
+		const size_t width = frame.size[0];
+		const size_t height = frame.size[1];
+		frame.convertedPixels.setSize(width*height*screenBytesPerPixel);
+		if (width != 0 && height != 0) {
+			// Only the parts of the image that changed since this frame's pixels
+			// were last converted need to be converted again.
+			// NOTE: The const pixels() avoids copying the image data.
+			const Image& image = frame.image;
+			for (const Box2<size_t>& rectangle : frame.unconvertedRectangles) {
+				convertToSRGB(image.pixels(), frame.convertedPixels.data(), screenBytesPerPixel, width, height, rectangle);
+			}
+		}
+		frame.unconvertedRectangles.setSize(0);
+
+		submitPipelineFrame(frameIndex, pipeline.convertedFrame, PipelineFrameState::CONVERTED);
 	}
+	return 0;
+}
 
-	// NOTE: It didn't work to push an event for the timer, because SDL_WaitEvent
-	// doesn't respond to manually pushed events.
+static int presentThreadFunction(void* data) {
+	Array<SDL_Rect> screenRectangles;
+	while (true) {
+		const uint32 frameIndex = takePipelineFrame(pipeline.convertedFrame, PipelineFrameState::PRESENTING);
+		if (frameIndex == NO_PIPELINE_FRAME) {
+			break;
+		}
+		PipelineFrame& frame = pipeline.frames[frameIndex];
 
-	if (uiStateModCount != lastDrawUIModCount) {
-		//printf("Timer at %d\n", SDL_GetTicks());
+		// We reacquire screen each time, just in case window resized and screen was replaced.
+		SDL_Surface* screen = SDL_GetWindowSurface(mainWindow);
+		const size_t width = frame.size[0];
+		const size_t height = frame.size[1];
+		if (size_t(screen->w) != width || size_t(screen->h) != height ||
+			screen->format->BytesPerPixel != screenBytesPerPixel
+		) {
+			// The window was resized after this frame was recorded, so skip it.
+			// The UI thread will record a frame with the new size when it
+			// handles the resize event.
+			releasePipelineFrame(frameIndex);
+			recordDroppedFrame();
+			continue;
+		}
 
-		SDL_CondSignal(drawThreadCond);
-	}
+		// Only copy the parts of the window that changed since the previously
+		// presented frame.  The converted pixels are flipped vertically,
+		// so the rows are flipped here too.
+		screenRectangles.setSize(0);
+		SDL_LockSurface(screen);
+		const size_t rowBytes = width*screenBytesPerPixel;
+		for (const Box2<size_t>& rectangle : frame.presentRectangles) {
+			const Box2<size_t> clipped = clipRectangle(rectangle, frame.size);
+			if (isEmptyRectangle(clipped)) {
+				continue;
+			}
+			const size_t screenRowBegin = height - clipped[1][1];
+			const size_t screenRowEnd = height - clipped[1][0];
+			const size_t xOffset = clipped[0][0]*screenBytesPerPixel;
+			const size_t copyBytes = (clipped[0][1] - clipped[0][0])*screenBytesPerPixel;
+			const uint8* source = frame.convertedPixels.data() + screenRowBegin*rowBytes + xOffset;
+			uint8* dest = (uint8*)(screen->pixels) + screenRowBegin*screen->pitch + xOffset;
+			for (size_t y = screenRowBegin; y < screenRowEnd; ++y) {
+				memcpy(dest, source, copyBytes);
+				source += rowBytes;
+				dest += screen->pitch;
+			}
+			SDL_Rect screenRectangle;
+			screenRectangle.x = int(clipped[0][0]);
+			screenRectangle.y = int(screenRowBegin);
+			screenRectangle.w = int(clipped[0][1] - clipped[0][0]);
+			screenRectangle.h = int(screenRowEnd - screenRowBegin);
+			screenRectangles.append(screenRectangle);
+		}
+		SDL_UnlockSurface(screen);
+
+		// Swap screen buffer contents with window buffer.
+		if (screenRectangles.size() != 0) {
+			SDL_UpdateWindowSurfaceRects(mainWindow, screenRectangles.data(), int(screenRectangles.size()));
+		}
 
-	isInsideTimerCallback = false;
-	return interval;
+		recordFrameLatency(frame.inputTime, frame.drawStartTime, SDL_GetPerformanceCounter());
+
+		releasePipelineFrame(frameIndex);
+	}
+	return 0;
 }
 
-class UITimerExitListener : public UIExitListener {
+class DrawThreadExitListener : public UIExitListener {
 	virtual void uiExiting() {
-		SDL_RemoveTimer(uiTimerID);
-		uiTimerID = -1;
-		SDL_Delay(1);
-		while (isInsideTimerCallback) {
-			// This is a spin-wait loop.
-			SDL_Delay(1);
-		}
+		// isExiting has already been set, so wake up the pipeline threads
+		// and wait for them to finish any frames in progress.
+		SDL_LockMutex(drawThreadCondLock);
+		SDL_CondSignal(drawThreadCond);
+		SDL_UnlockMutex(drawThreadCondLock);
+		SDL_LockMutex(pipelineLock);
+		SDL_CondBroadcast(pipelineCond);
+		SDL_UnlockMutex(pipelineLock);
+		SDL_WaitThread(drawThread, nullptr);
+		SDL_WaitThread(convertThread, nullptr);
+		SDL_WaitThread(presentThread, nullptr);
+		drawThread = nullptr;
+		convertThread = nullptr;
+		presentThread = nullptr;
 	}
 };
 
-static UITimerExitListener uiTimerExitListener;
+static DrawThreadExitListener drawThreadExitListener;
 
 MainWindow* UIInit(
 	int monitorNum,
@@ -195,6 +661,11 @@ MainWindow* UIInit(
 		SDL_LogCritical(SDL_LOG_CATEGORY_ERROR, "Error initializing SDL!  Error message: \"%s\"\n", SDL_GetError());
 		return nullptr;
 	}
+	wakeUpEventType = SDL_RegisterEvents(1);
+	if (wakeUpEventType == Uint32(-1)) {
+		SDL_LogCritical(SDL_LOG_CATEGORY_ERROR, "Error registering the wake-up event type!  Error message: \"%s\"\n", SDL_GetError());
+		return nullptr;
+	}
 
 	int numMonitors = SDL_GetNumVideoDisplays();
 	if (numMonitors < 1) {
@@ -305,6 +776,13 @@ MainWindow* UIInit(
 		SDL_SetRelativeMouseMode(SDL_TRUE);
 	}
 
+	performanceFrequency = SDL_GetPerformanceFrequency();
+	frameStatsLock = SDL_CreateMutex();
+	if (frameStatsLock == nullptr) {
+		SDL_LogCritical(SDL_LOG_CATEGORY_ERROR, "Error creating the frame statistics lock!  Error message: \"%s\"\n", SDL_GetError());
+		return nullptr;
+	}
+
 	drawThreadCondLock = SDL_CreateMutex();
 	if (drawThreadCondLock == nullptr) {
 		SDL_LogCritical(SDL_LOG_CATEGORY_ERROR, "Error creating the draw thread lock!  Error message: \"%s\"\n", SDL_GetError());
@@ -315,22 +793,50 @@ MainWindow* UIInit(
 		SDL_LogCritical(SDL_LOG_CATEGORY_ERROR, "Error creating the drawing thread condition variable!  Error message: \"%s\"\n", SDL_GetError());
 		return nullptr;
 	}
-	drawThread = SDL_CreateThread(drawThreadFunction, "Draw Thread", nullptr);
-	if (drawThread == nullptr) {
-		SDL_LogCritical(SDL_LOG_CATEGORY_ERROR, "Error creating the drawing thread!  Error message: \"%s\"\n", SDL_GetError());
-		return nullptr;
-	}
+	setTargetFrameRate(targetFrameRate.load(std::memory_order_relaxed));
+
+	isUIThread = true;
 
 	mainWindowContainer = new MainWindow();
 	mainWindowContainer->origin = Vec2f(mainWindowBounds.x, mainWindowBounds.y);
 	mainWindowContainer->size = Vec2f(mainWindowBounds.w, mainWindowBounds.h);
 	mainWindowContainer->backgroundColour = defaultBackgroundColour;
 
-	mainCanvas.image.setSize(mainWindowBounds.w, mainWindowBounds.h);
+	screenBytesPerPixel = screen->format->BytesPerPixel;
+	for (uint32 i = 0; i < NUM_PIPELINE_FRAMES; ++i) {
+		pipeline.states[i] = PipelineFrameState::FREE;
+	}
+	pipelineLock = SDL_CreateMutex();
+	if (pipelineLock == nullptr) {
+		SDL_LogCritical(SDL_LOG_CATEGORY_ERROR, "Error creating the frame pipeline lock!  Error message: \"%s\"\n", SDL_GetError());
+		return nullptr;
+	}
+	pipelineCond = SDL_CreateCond();
+	if (pipelineCond == nullptr) {
+		SDL_LogCritical(SDL_LOG_CATEGORY_ERROR, "Error creating the frame pipeline condition variable!  Error message: \"%s\"\n", SDL_GetError());
+		return nullptr;
+	}
 
-	uiTimerID = SDL_AddTimer(30u, uiTimerCallbackFunction, nullptr);
+	// The pipeline threads are created last, because the draw thread starts
+	// drawing the initial frame as soon as it's recorded, so everything
+	// they use must be initialized.
+	presentThread = SDL_CreateThread(presentThreadFunction, "Present Thread", nullptr);
+	if (presentThread == nullptr) {
+		SDL_LogCritical(SDL_LOG_CATEGORY_ERROR, "Error creating the presenting thread!  Error message: \"%s\"\n", SDL_GetError());
+		return nullptr;
+	}
+	convertThread = SDL_CreateThread(convertThreadFunction, "Convert Thread", nullptr);
+	if (convertThread == nullptr) {
+		SDL_LogCritical(SDL_LOG_CATEGORY_ERROR, "Error creating the colour conversion thread!  Error message: \"%s\"\n", SDL_GetError());
+		return nullptr;
+	}
+	drawThread = SDL_CreateThread(drawThreadFunction, "Draw Thread", nullptr);
+	if (drawThread == nullptr) {
+		SDL_LogCritical(SDL_LOG_CATEGORY_ERROR, "Error creating the drawing thread!  Error message: \"%s\"\n", SDL_GetError());
+		return nullptr;
+	}
 
-	exitListeners.append(&uiTimerExitListener);
+	exitListeners.append(&drawThreadExitListener);
 
 	return mainWindowContainer;
 }
@@ -344,140 +850,635 @@ struct KeyState {
 	const size_t numKeys;
 };
 
+static void resizeMainWindowContainer(int width, int height) {
+	const Vec2f newSize{float(width), float(height)};
+	if (newSize == mainWindowContainer->size) {
+		return;
+	}
+	const Vec2f prevOrigin = mainWindowContainer->origin;
+	const Vec2f prevSize = mainWindowContainer->size;
+	mainWindowContainer->size = newSize;
+	// The children will be repositioned by updateLayout before the next frame.
+	markChildLayoutDirty(*mainWindowContainer);
+	auto onResize = MainWindow::staticType.onResize;
+	if (onResize != nullptr) {
+		onResize(*mainWindowContainer, prevOrigin, prevSize);
+	}
+}
+
+// Records the UI state into a DrawList and publishes it to the draw thread,
+// if anything has changed since the last time a frame was recorded.
+// This must only be called from the UI thread.
+static void recordFrame() {
+	if (mainWindowContainer == nullptr) {
+		return;
+	}
+	const uint64 modCount = uiStateModCount.load();
+	if (modCount == lastRecordedUIModCount) {
+		return;
+	}
+
+	// Layout changes call setNeedRedraw, so this only needs to be checked
+	// when something has changed.
+	updateLayout(*mainWindowContainer);
+	lastRecordedUIModCount = uiStateModCount.load();
+	mainWindowTree.update(*mainWindowContainer);
+
+	// If the draw thread hasn't taken the previously published DrawList yet,
+	// take it back and add to it, instead of replacing it, since the changes
+	// in a partial frame would be lost if it were skipped.
+	uint32 publishedState = publishedDrawListState.load();
+	bool isExtending = false;
+	if ((publishedState & FRESH_DRAW_LIST_BIT) != 0 &&
+		publishedDrawListState.compare_exchange_strong(publishedState, uiDrawListIndex)
+	) {
+		uiDrawListIndex = publishedState & DRAW_LIST_INDEX_MASK;
+		isExtending = true;
+		recordDroppedFrame();
+	}
+	DrawList& drawList = drawLists[uiDrawListIndex];
+
+	const Vec2f& size = mainWindowContainer->size;
+	const Vec2<size_t> frameSize = Vec2<size_t>(size_t(size[0]), size_t(size[1]));
+	// Partial frames are drawn over the previous frame, so a transparent
+	// background would be blended with the old contents.
+	bool isFull = isFullRedrawNeeded.exchange(false) ||
+		frameSize[0] != lastRecordedSize[0] || frameSize[1] != lastRecordedSize[1] ||
+		mainWindowContainer->backgroundColour[3] < 1 ||
+		(isExtending && drawList.commands.size() > MAX_EXTENDED_DRAW_COMMANDS);
+	lastRecordedSize = frameSize;
+
+	// Keep the earliest input time, so that latency isn't underestimated.
+	uint64 inputTime = pendingInputEventTime;
+	pendingInputEventTime = 0;
+	if (isExtending) {
+		const uint64 previousTime = drawList.inputEventTime.load(std::memory_order_relaxed);
+		if (previousTime != 0 && (inputTime == 0 || previousTime < inputTime)) {
+			inputTime = previousTime;
+		}
+	}
+
+	if (isFull || !isExtending) {
+		drawList.clear();
+		drawList.isPartial = !isFull;
+	}
+	// If extending, the previous commands are kept, even if they were a full frame.
+	drawList.size = frameSize;
+	drawList.inputEventTime.store(inputTime, std::memory_order_relaxed);
+
+	recordingCanvas.drawList = &drawList;
+	if (isFull) {
+		Box2f bounds(Vec2f(0,0), size);
+		MainWindow::staticType.draw(*mainWindowContainer, bounds, bounds, recordingCanvas);
+		addDamageRectangle(drawList.damageRectangles, Box2<size_t>(Vec2<size_t>(0,0), frameSize));
+	}
+	else {
+		// Moves must come first, since damage was adjusted for them when added.
+		for (const PendingMove& move : pendingMoves) {
+			drawList.addMove(move.srcRectangle, move.destMin);
+			const Box2<size_t> destRectangle(
+				move.destMin,
+				Vec2<size_t>(
+					move.destMin[0] + move.srcRectangle[0][1] - move.srcRectangle[0][0],
+					move.destMin[1] + move.srcRectangle[1][1] - move.srcRectangle[1][0]
+				)
+			);
+			addDamageRectangle(drawList.damageRectangles, destRectangle);
+		}
+		// Only draw the parts of the tree inside the damaged rectangles.
+		for (const Box2<size_t>& rectangle : pendingDamageRectangles) {
+			const Box2f bounds = Box2f(
+				Vec2f(float(rectangle[0][0]), float(rectangle[1][0])),
+				Vec2f(float(rectangle[0][1]), float(rectangle[1][1]))
+			);
+			MainWindow::staticType.draw(*mainWindowContainer, bounds, bounds, recordingCanvas);
+			addDamageRectangle(drawList.damageRectangles, rectangle);
+		}
+	}
+	recordingCanvas.drawList = nullptr;
+	pendingMoves.setSize(0);
+	pendingDamageRectangles.setSize(0);
+
+	// Publish the new DrawList, getting back the previously published one,
+	// which the draw thread must have already taken, since any untaken one
+	// was taken back above, and only this thread publishes.
+	const uint32 previousState = publishedDrawListState.exchange(uiDrawListIndex | FRESH_DRAW_LIST_BIT);
+	assert((previousState & FRESH_DRAW_LIST_BIT) == 0);
+	uiDrawListIndex = previousState & DRAW_LIST_INDEX_MASK;
+
+	// Wake up the draw thread if it's waiting.  If it's not waiting,
+	// it will check publishedDrawListState before it next waits.
+	if (isDrawThreadIdle.load()) {
+		SDL_LockMutex(drawThreadCondLock);
+		SDL_CondSignal(drawThreadCond);
+		SDL_UnlockMutex(drawThreadCondLock);
+	}
+}
+
+// Converts SDL key modifiers to KEY_MODIFIER_* bits.
+static uint32 keyModifiers(uint16 sdlModifiers) {
+	uint32 modifiers = 0;
+	if (sdlModifiers & KMOD_SHIFT) {
+		modifiers |= KEY_MODIFIER_SHIFT;
+	}
+	if (sdlModifiers & KMOD_CTRL) {
+		modifiers |= KEY_MODIFIER_CTRL;
+	}
+	if (sdlModifiers & KMOD_ALT) {
+		modifiers |= KEY_MODIFIER_ALT;
+	}
+	if (sdlModifiers & KMOD_GUI) {
+		modifiers |= KEY_MODIFIER_GUI;
+	}
+	return modifiers;
+}
+
+static void handleEvent(const SDL_Event& event, uint64& mouseButtonState, const KeyState& keyState) {
+	const bool isInputEvent = (
+		event.type == SDL_KEYDOWN || event.type == SDL_KEYUP ||
+		event.type == SDL_MOUSEMOTION || event.type == SDL_MOUSEWHEEL ||
+		event.type == SDL_MOUSEBUTTONDOWN || event.type == SDL_MOUSEBUTTONUP
+	);
+	currentInputEventTime = isInputEvent ? SDL_GetPerformanceCounter() : 0;
+	switch (event.type) {
+		case SDL_QUIT: {
+			// Let everything know that the program is ending.
+			isExiting = true;
+			for (UIExitListener* listener : exitListeners) {
+				listener->uiExiting();
+			}
+			exitListeners.setCapacity(0);
+			if (mainWindowContainer != nullptr) {
+				MainWindow::staticType.destruct(mainWindowContainer);
+				mainWindowContainer = nullptr;
+				mainWindowTree.clear();
+			}
+			break;
+		}
+		case SDL_KEYDOWN: {
+			SDL_Keycode key = event.key.keysym.sym;
+			// Shortcuts registered on the keyboard focus path take precedence
+			// over the box with keyboard focus.
+			if (dispatchAccelerator(*mainWindowContainer, size_t(key), keyModifiers(event.key.keysym.mod))) {
+				break;
+			}
+			if (MainWindow::staticType.onKeyDown != nullptr) {
+				MainWindow::staticType.onKeyDown(*mainWindowContainer, key, keyState);
+			}
+			break;
+		}
+		case SDL_KEYUP: {
+			SDL_Keycode key = event.key.keysym.sym;
+			//SDL_GetKeyboardState()
+			if (MainWindow::staticType.onKeyUp != nullptr) {
+				MainWindow::staticType.onKeyUp(*mainWindowContainer, key, keyState);
+			}
+			break;
+		}
+		case SDL_MOUSEMOTION: {
+			// TODO: Handle entry and exit from main window, if mouse isn't in exclusive mode.
+			const Vec2f change(event.motion.xrel, -event.motion.yrel);
+			// FIXME: Consider applying translation by (0.5,0.5), since that's the middle of the pixel.
+			const MouseState mouseState{Vec2f(float(event.motion.x), mainWindowContainer->size[1] - event.motion.y - 1), event.motion.state};
+			mouseButtonState = event.motion.state;
+			MainWindow::staticType.onMouseMove(*mainWindowContainer, change, mouseState);
+			break;
+		}
+		case SDL_MOUSEBUTTONDOWN: {
+			// FIXME: Consider applying translation by (0.5,0.5), since that's the middle of the pixel.
+			const MouseState mouseState{Vec2f(float(event.button.x), mainWindowContainer->size[1] - event.button.y - 1), event.button.state};
+			mouseButtonState = event.motion.state;
+			MainWindow::staticType.onMouseDown(*mainWindowContainer, event.button.button, mouseState);
+			break;
+		}
+		case SDL_MOUSEBUTTONUP: {
+			// FIXME: Consider applying translation by (0.5,0.5), since that's the middle of the pixel.
+			const MouseState mouseState{Vec2f(float(event.button.x), mainWindowContainer->size[1] - event.button.y - 1), event.button.state};
+			mouseButtonState = event.motion.state;
+			MainWindow::staticType.onMouseUp(*mainWindowContainer, event.button.button, mouseState);
+			break;
+		}
+		case SDL_MOUSEWHEEL: {
+			float amount = event.wheel.y / 120.0f;
+			if (event.wheel.direction == SDL_MOUSEWHEEL_FLIPPED) {
+				amount = -amount;
+			}
+			const MouseState mouseState{Vec2f(event.wheel.x, event.wheel.y), mouseButtonState};
+			MainWindow::staticType.onMouseScroll(*mainWindowContainer, amount, mouseState);
+			break;
+		}
+		case SDL_WINDOWEVENT: {
+			switch (event.window.event) {
+				case SDL_WINDOWEVENT_SHOWN: {
+					setNeedRedraw();
+					break;
+				}
+				case SDL_WINDOWEVENT_HIDDEN:
+				case SDL_WINDOWEVENT_MINIMIZED: {
+					// FIXME: Call onMouseExit for mainWindowContainer if mouse was currently inside!!!
+					break;
+				}
+				case SDL_WINDOWEVENT_EXPOSED: {
+					setNeedRedraw();
+					break;
+				}
+				case SDL_WINDOWEVENT_RESIZED:
+				case SDL_WINDOWEVENT_SIZE_CHANGED: {
+					// The container is resized here on the UI thread, instead of
+					// on the draw thread, so that it's consistent with any
+					// frame recorded afterward.
+					resizeMainWindowContainer(event.window.data1, event.window.data2);
+					setNeedRedraw();
+					break;
+				}
+				case SDL_WINDOWEVENT_MAXIMIZED:
+				case SDL_WINDOWEVENT_RESTORED: {
+					// Multiple calls are coalesced until the next frame is recorded.
+					setNeedRedraw();
+					break;
+				}
+				case SDL_WINDOWEVENT_ENTER: {
+					// FIXME: Call onMouseEnter for mainWindowContainer if mouse was currently outside!!!
+					// Consider debug warning if mouse was already inside?
+					break;
+				}
+				case SDL_WINDOWEVENT_LEAVE: {
+					// FIXME: Call onMouseExit for mainWindowContainer if mouse was currently inside!!!
+					// Consider debug warning if mouse was already outside?
+					break;
+				}
+				case SDL_WINDOWEVENT_CLOSE: {
+					// FIXME: If this is the main window, call window close callback,
+					// e.g. to check if the user wants to save the open file!!!
+					// Let everything know that the program is ending.
+					isExiting = true;
+					for (UIExitListener* listener : exitListeners) {
+						listener->uiExiting();
+					}
+					exitListeners.setCapacity(0);
+					if (mainWindowContainer != nullptr) {
+						MainWindow::staticType.destruct(mainWindowContainer);
+						mainWindowContainer = nullptr;
+					}
+					break;
+				}
+				// FIXME: Add any others that apply!!!
+			}
+
+			break;
+		}
+	}
+	currentInputEventTime = 0;
+}
+
+// Returns true if any box in the chain of boxes with mouse focus
+// wants each mouse motion event separately.
+static bool mouseFocusWantsRawMotion() {
+	const UIBox* box = mainWindowContainer;
+	while (box != nullptr) {
+		if (box->type->wantsRawMouseMotion) {
+			return true;
+		}
+		if (!box->type->isContainer) {
+			break;
+		}
+		const UIContainer* container = static_cast<const UIContainer*>(box);
+		if (container->mouseFocusIndex == UIContainer::INVALID_INDEX) {
+			break;
+		}
+		box = container->children[container->mouseFocusIndex].get();
+	}
+	return false;
+}
+
+static void handleEventBatch(SDL_Event* events, size_t numEvents, uint64& mouseButtonState, const KeyState& keyState) {
+	for (size_t i = 0; i < numEvents && !isExiting; ) {
+		SDL_Event& event = events[i];
+		++i;
+		if (event.type == SDL_MOUSEMOTION && mainWindowContainer != nullptr && !mouseFocusWantsRawMotion()) {
+			// Merge any directly following motion events with the same buttons
+			// down into this one.  Any other event in between, e.g. a button
+			// being pressed or the mouse leaving the window, ends the merging,
+			// so the order of motion relative to other events is unchanged.
+			SDL_MouseMotionEvent& motion = event.motion;
+			while (i < numEvents && events[i].type == SDL_MOUSEMOTION &&
+				events[i].motion.state == motion.state &&
+				events[i].motion.windowID == motion.windowID
+			) {
+				const SDL_MouseMotionEvent& nextMotion = events[i].motion;
+				motion.x = nextMotion.x;
+				motion.y = nextMotion.y;
+				motion.xrel += nextMotion.xrel;
+				motion.yrel += nextMotion.yrel;
+				++i;
+			}
+		}
+		handleEvent(event, mouseButtonState, keyState);
+	}
+}
+
+// Returns the time between steps of tweens, which is the frame interval,
+// or 1 millisecond if frames aren't limited, to avoid spinning.
+static uint64 animationIntervalCounts() {
+	const uint64 interval = frameIntervalCounts.load(std::memory_order_relaxed);
+	const uint64 minInterval = performanceFrequency/1000;
+	return (interval > minInterval) ? interval : minInterval;
+}
+
 void UILoop() {
+	isUIThread = true;
+	setCurrentUIFlatTree(&mainWindowTree);
+
 	uint64 mouseButtonState = 0;
 
 	int numKeys;
 	const uint8* sdlKeyState = SDL_GetKeyboardState(&numKeys);
 	KeyState keyState{sdlKeyState, size_t(numKeys)};
 
+	constexpr size_t EVENT_BATCH_SIZE = 64;
+	SDL_Event eventBatch[EVENT_BATCH_SIZE];
+
+	// Performance counter time at which active tweens are next stepped.
+	uint64 nextAnimationTime = 0;
+
 	while (!isExiting) {
-		SDL_Event event;
-		// NOTE: SDL_WaitEvent does not wake up for events manually pushed with SDL_PushEvent.
-		int eventCount = SDL_WaitEvent(&event);
+		// Step any tweens at most once per frame interval, all with the same
+		// frame time, so that they stay in sync.
+		if (isAnimating()) {
+			const uint64 now = SDL_GetPerformanceCounter();
+			if (now >= nextAnimationTime) {
+				stepAnimations(now);
+				nextAnimationTime = now + animationIntervalCounts();
+			}
+		}
+
+		// Record a frame if anything changed while handling the previous
+		// batch of events, before waiting for more events.
+		recordFrame();
+
+		// NOTE: SDL_WaitEvent only wakes up for events pushed with SDL_PushEvent
+		// from other threads as of SDL 2.0.16.
+		int eventCount;
+		if (isAnimating()) {
+			// Only wait until the next step, so that the loop goes idle
+			// automatically once there are no more active tweens.
+			const uint64 now = SDL_GetPerformanceCounter();
+			const uint64 remaining = (nextAnimationTime > now) ? (nextAnimationTime - now) : 0;
+			const int milliseconds = int((remaining*1000 + performanceFrequency-1) / performanceFrequency);
+			eventCount = SDL_WaitEventTimeout(&eventBatch[0], milliseconds);
+		}
+		else {
+			eventCount = SDL_WaitEvent(&eventBatch[0]);
+		}
 		if (eventCount == 0) {
 			continue;
 		}
-		switch (event.type) {
-			case SDL_QUIT: {
-				// Let everything know that the program is ending.
-				isExiting = true;
-				for (UIExitListener* listener : exitListeners) {
-					listener->uiExiting();
-				}
-				exitListeners.setCapacity(0);
-				if (mainWindowContainer != nullptr) {
-					MainWindow::staticType.destruct(mainWindowContainer);
-					mainWindowContainer = nullptr;
-				}
-				break;
-			}
-			case SDL_KEYDOWN: {
-				SDL_Keycode key = event.key.keysym.sym;
-				//SDL_GetKeyboardState()
-				if (MainWindow::staticType.onKeyDown != nullptr) {
-					MainWindow::staticType.onKeyDown(*mainWindowContainer, key, keyState);
-				}
+
+		// Handle all events that are already queued before recording a frame,
+		// so that a frame isn't recorded for each one.  They're taken from the
+		// queue in batches, so that consecutive mouse motion events can be merged.
+		size_t numEvents = 1;
+		while (!isExiting) {
+			SDL_PumpEvents();
+			const int numMoreEvents = SDL_PeepEvents(eventBatch + numEvents, int(EVENT_BATCH_SIZE - numEvents), SDL_GETEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT);
+			if (numMoreEvents > 0) {
+				numEvents += size_t(numMoreEvents);
 			}
-			case SDL_KEYUP: {
-				SDL_Keycode key = event.key.keysym.sym;
-				//SDL_GetKeyboardState()
-				if (MainWindow::staticType.onKeyUp != nullptr) {
-					MainWindow::staticType.onKeyUp(*mainWindowContainer, key, keyState);
-				}
-				break;
+			// Bring the flat tree up to date with any changes since the
+			// previous batch, so that mouse routing can read it.
+			if (mainWindowContainer != nullptr) {
+				mainWindowTree.update(*mainWindowContainer);
 			}
-			case SDL_MOUSEMOTION: {
-				// TODO: Handle entry and exit from main window, if mouse isn't in exclusive mode.
-				const Vec2f change(event.motion.xrel, -event.motion.yrel);
-				// FIXME: Consider applying translation by (0.5,0.5), since that's the middle of the pixel.
-				const MouseState mouseState{Vec2f(float(event.motion.x), mainWindowContainer->size[1] - event.motion.y - 1), event.motion.state};
-				mouseButtonState = event.motion.state;
-				MainWindow::staticType.onMouseMove(*mainWindowContainer, change, mouseState);
+			handleEventBatch(eventBatch, numEvents, mouseButtonState, keyState);
+
+			// If the batch wasn't filled, the queue was empty.
+			if (numEvents < EVENT_BATCH_SIZE) {
 				break;
 			}
-			case SDL_MOUSEBUTTONDOWN: {
-				// FIXME: Consider applying translation by (0.5,0.5), since that's the middle of the pixel.
-				const MouseState mouseState{Vec2f(float(event.button.x), mainWindowContainer->size[1] - event.button.y - 1), event.button.state};
-				mouseButtonState = event.motion.state;
-				MainWindow::staticType.onMouseDown(*mainWindowContainer, event.button.button, mouseState);
-				break;
+			numEvents = 0;
+		}
+	}
+}
+
+// Marks the UI as changed from the UI thread, so that a new frame is recorded.
+static void markUIChanged() {
+	assert(isUIThread);
+	++uiStateModCount;
+	markUITreeBoundsChanged();
+
+	// Only keep the earliest input event time, so that the latency
+	// measured is that of the input event waiting the longest.
+	if (currentInputEventTime != 0 && pendingInputEventTime == 0) {
+		pendingInputEventTime = currentInputEventTime;
+	}
+}
+
+void setNeedRedraw() {
+	isFullRedrawNeeded.store(true);
+
+	if (!isUIThread) {
+		++uiStateModCount;
+		markUITreeBoundsChanged();
+		// Wake up the UI thread, so that it records a new frame.
+		SDL_Event event{};
+		event.type = wakeUpEventType;
+		SDL_PushEvent(&event);
+		return;
+	}
+
+	markUIChanged();
+}
+
+// Finds the part of box that's inside all of its ancestors, in the space of
+// the main window container, returning false if it's empty or the box isn't
+// in the main window.
+static bool getVisibleWindowRectangle(const UIBox& box, Box2f& rectangle) {
+	Vec2f min(0,0);
+	Vec2f max(box.size);
+	const UIBox* current = &box;
+	while (current->parent != nullptr) {
+		const UIContainer* parent = current->parent;
+		for (size_t axis = 0; axis < 2; ++axis) {
+			min[axis] += current->origin[axis];
+			max[axis] += current->origin[axis];
+			if (min[axis] < 0) {
+				min[axis] = 0;
 			}
-			case SDL_MOUSEBUTTONUP: {
-				// FIXME: Consider applying translation by (0.5,0.5), since that's the middle of the pixel.
-				const MouseState mouseState{Vec2f(float(event.button.x), mainWindowContainer->size[1] - event.button.y - 1), event.button.state};
-				mouseButtonState = event.motion.state;
-				MainWindow::staticType.onMouseUp(*mainWindowContainer, event.button.button, mouseState);
-				break;
+			if (max[axis] > parent->size[axis]) {
+				max[axis] = parent->size[axis];
 			}
-			case SDL_MOUSEWHEEL: {
-				float amount = event.wheel.y / 120.0f;
-				if (event.wheel.direction == SDL_MOUSEWHEEL_FLIPPED) {
-					amount = -amount;
-				}
-				const MouseState mouseState{Vec2f(event.wheel.x, event.wheel.y), mouseButtonState};
-				MainWindow::staticType.onMouseScroll(*mainWindowContainer, amount, mouseState);
-				break;
+			if (!(min[axis] < max[axis])) {
+				return false;
 			}
-			case SDL_WINDOWEVENT: {
-				switch (event.window.event) {
-					case SDL_WINDOWEVENT_SHOWN: {
-						setNeedRedraw();
-						break;
-					}
-					case SDL_WINDOWEVENT_HIDDEN:
-					case SDL_WINDOWEVENT_MINIMIZED: {
-						// FIXME: Call onMouseExit for mainWindowContainer if mouse was currently inside!!!
-						break;
-					}
-					case SDL_WINDOWEVENT_EXPOSED: {
-						setNeedRedraw();
-						break;
-					}
-					case SDL_WINDOWEVENT_RESIZED:
-					case SDL_WINDOWEVENT_SIZE_CHANGED:
-					case SDL_WINDOWEVENT_MAXIMIZED:
-					case SDL_WINDOWEVENT_RESTORED: {
-						// FIXME: Check whether the redraw has already been initiated, in case more than one of these is called!!!
-						setNeedRedraw();
-						break;
-					}
-					case SDL_WINDOWEVENT_ENTER: {
-						// FIXME: Call onMouseEnter for mainWindowContainer if mouse was currently outside!!!
-						// Consider debug warning if mouse was already inside?
-						break;
-					}
-					case SDL_WINDOWEVENT_LEAVE: {
-						// FIXME: Call onMouseExit for mainWindowContainer if mouse was currently inside!!!
-						// Consider debug warning if mouse was already outside?
-						break;
-					}
-					case SDL_WINDOWEVENT_CLOSE: {
-						// FIXME: If this is the main window, call window close callback,
-						// e.g. to check if the user wants to save the open file!!!
-						// Let everything know that the program is ending.
-						isExiting = true;
-						for (UIExitListener* listener : exitListeners) {
-							listener->uiExiting();
-						}
-						exitListeners.setCapacity(0);
-						if (mainWindowContainer != nullptr) {
-							MainWindow::staticType.destruct(mainWindowContainer);
-							mainWindowContainer = nullptr;
-						}
-						break;
-					}
-					// FIXME: Add any others that apply!!!
-				}
+		}
+		current = parent;
+	}
+	// The main window container's origin is its position on the screen,
+	// which isn't used for drawing, so it's not added.
+	if (current != mainWindowContainer) {
+		return false;
+	}
+	rectangle = Box2f(min, max);
+	return true;
+}
+
+// Rounds rectangle outward to whole pixels, limited to the window,
+// returning true if it was already exactly whole pixels.
+static bool toPixelRectangle(const Box2f& rectangle, Box2<size_t>& pixelRectangle) {
+	bool isExact = true;
+	for (size_t axis = 0; axis < 2; ++axis) {
+		const float windowSize = mainWindowContainer->size[axis];
+		float begin = floorf(rectangle[axis][0]);
+		float end = ceilf(rectangle[axis][1]);
+		isExact = isExact && (begin == rectangle[axis][0]) && (end == rectangle[axis][1]);
+		begin = (begin > 0) ? begin : 0;
+		end = (end < windowSize) ? end : windowSize;
+		if (!(begin < end)) {
+			begin = 0;
+			end = 0;
+		}
+		pixelRectangle[axis][0] = size_t(begin);
+		pixelRectangle[axis][1] = size_t(end);
+	}
+	return isExact;
+}
+
+void invalidateRectangle(const Box2f& rectangle) {
+	if (mainWindowContainer == nullptr) {
+		return;
+	}
+	Box2<size_t> pixelRectangle;
+	toPixelRectangle(rectangle, pixelRectangle);
+	if (isEmptyRectangle(pixelRectangle)) {
+		return;
+	}
+	if (!isFullRedrawNeeded.load(std::memory_order_relaxed)) {
+		addDamageRectangle(pendingDamageRectangles, pixelRectangle);
+	}
+	markUIChanged();
+}
+
+void invalidateBox(const UIBox& box) {
+	Box2f rectangle;
+	if (getVisibleWindowRectangle(box, rectangle)) {
+		invalidateRectangle(rectangle);
+	}
+}
+
+void scrollBoxContents(const UIBox& box, const Vec2f& offset) {
+	Box2f rectangle;
+	if (!getVisibleWindowRectangle(box, rectangle)) {
+		return;
+	}
+	Box2<size_t> pixelRectangle;
+	const bool isExact = toPixelRectangle(rectangle, pixelRectangle);
+	const ptrdiff_t offsets[2] = {ptrdiff_t(offset[0]), ptrdiff_t(offset[1])};
+	bool canMove = isExact && !isFullRedrawNeeded.load(std::memory_order_relaxed);
+	for (size_t axis = 0; axis < 2; ++axis) {
+		const ptrdiff_t extent = ptrdiff_t(pixelRectangle[axis][1] - pixelRectangle[axis][0]);
+		// The pixels can only be moved by whole pixels, and if the offset is
+		// as large as the box, none of the pixels stay visible.
+		canMove = canMove && (float(offsets[axis]) == offset[axis]) &&
+			(offsets[axis] < extent) && (-offsets[axis] < extent);
+	}
+	if (!canMove) {
+		invalidateRectangle(rectangle);
+		return;
+	}
+
+	// The pixels that stay visible are the ones that don't move outside the box.
+	PendingMove move;
+	for (size_t axis = 0; axis < 2; ++axis) {
+		const ptrdiff_t d = offsets[axis];
+		move.srcRectangle[axis][0] = pixelRectangle[axis][0] + ((d < 0) ? size_t(-d) : 0);
+		move.srcRectangle[axis][1] = pixelRectangle[axis][1] - ((d > 0) ? size_t(d) : 0);
+		move.destMin[axis] = size_t(ptrdiff_t(move.srcRectangle[axis][0]) + d);
+	}
 
+	// Damage already pending inside the moved pixels would be moved along
+	// with them before being redrawn, so it must also be redrawn where it moves to.
+	// Adding damage can merge pendingDamageRectangles, so the moved damage is
+	// only added after finding all of it.
+	Array<Box2<size_t>> movedRectangles;
+	for (const Box2<size_t>& rectangle : pendingDamageRectangles) {
+		Box2<size_t> moved(rectangle);
+		bool isEmpty = false;
+		for (size_t axis = 0; axis < 2; ++axis) {
+			const size_t begin = (moved[axis][0] > move.srcRectangle[axis][0]) ? moved[axis][0] : move.srcRectangle[axis][0];
+			const size_t end = (moved[axis][1] < move.srcRectangle[axis][1]) ? moved[axis][1] : move.srcRectangle[axis][1];
+			isEmpty = isEmpty || (begin >= end);
+			moved[axis][0] = size_t(ptrdiff_t(begin) + offsets[axis]);
+			moved[axis][1] = size_t(ptrdiff_t(end) + offsets[axis]);
+		}
+		if (!isEmpty) {
+			movedRectangles.append(moved);
+		}
+	}
+	addDamageRectangles(pendingDamageRectangles, movedRectangles);
+	pendingMoves.append(move);
+
+	// Only the strips exposed by the move need to be redrawn.
+	for (size_t axis = 0; axis < 2; ++axis) {
+		const ptrdiff_t d = offsets[axis];
+		if (d == 0) {
+			continue;
+		}
+		Box2<size_t> exposed(pixelRectangle);
+		if (d > 0) {
+			exposed[axis][1] = exposed[axis][0] + size_t(d);
+		}
+		else {
+			exposed[axis][0] = exposed[axis][1] - size_t(-d);
+		}
+		addDamageRectangle(pendingDamageRectangles, exposed);
+	}
+	markUIChanged();
+}
+
+void setKeyFocus(const UIBox* box) {
+	if (mainWindowContainer == nullptr) {
+		return;
+	}
+	if (box == nullptr) {
+		mainWindowContainer->keyFocusIndex = UIContainer::INVALID_INDEX;
+		markAcceleratorsChanged();
+		return;
+	}
+	// Boxes outside the main window can't have keyboard focus.
+	assert(box->getRoot() == mainWindowContainer);
+	if (box->getRoot() != mainWindowContainer) {
+		return;
+	}
+
+	// Point the keyFocusIndex of each ancestor at the next box on the path.
+	// Parents are const, since boxes shouldn't modify their parents,
+	// but this is setting the focus path, so it must.
+	const UIBox* current = box;
+	while (current->parent != nullptr) {
+		UIContainer* parent = const_cast<UIContainer*>(current->parent);
+		const Array<std::unique_ptr<UIBox>>& children = parent->children;
+		size_t index = UIContainer::INVALID_INDEX;
+		for (size_t i = 0, n = children.size(); i < n; ++i) {
+			if (children[i].get() == current) {
+				index = i;
 				break;
 			}
 		}
+		assert(index != UIContainer::INVALID_INDEX);
+		parent->keyFocusIndex = index;
+		current = parent;
 	}
+	markAcceleratorsChanged();
 }
 
-void setNeedRedraw() {
-	++uiStateModCount;
+void setTargetFrameRate(float framesPerSecond) {
+	targetFrameRate.store(framesPerSecond, std::memory_order_relaxed);
+	if (performanceFrequency == 0) {
+		// UIInit will call this again once the frequency is known.
+		return;
+	}
+	const uint64 interval = (framesPerSecond > 0) ? uint64(performanceFrequency/framesPerSecond) : 0;
+	frameIntervalCounts.store(interval, std::memory_order_relaxed);
 }
 
 UICOMMON_LIBRARY_NAMESPACE_END
@@ -0,0 +1,157 @@
+#include "UIAccelerators.h"
+#include "UIBox.h"
+
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Types.h>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+void UIAcceleratorTable::grow() {
+	Array<UIAccelerator> oldSlots;
+	oldSlots.setSize(slots.size());
+	for (size_t i = 0, n = slots.size(); i < n; ++i) {
+		oldSlots[i] = slots[i];
+	}
+	const size_t newCapacity = (oldSlots.size() == 0) ? 16 : 2*oldSlots.size();
+	slots.setSize(newCapacity);
+	for (size_t i = 0; i < newCapacity; ++i) {
+		slots[i].key = 0;
+	}
+	const size_t mask = newCapacity-1;
+	for (const UIAccelerator& accelerator : oldSlots) {
+		if (accelerator.key == 0) {
+			continue;
+		}
+		size_t i = hash(accelerator.key, accelerator.modifiers) & mask;
+		while (slots[i].key != 0) {
+			i = (i+1) & mask;
+		}
+		slots[i] = accelerator;
+	}
+}
+
+void UIAcceleratorTable::add(const UIAccelerator& accelerator) {
+	assert(accelerator.key != 0);
+	// Keep the load factor at most 1/2, so that probe sequences stay short.
+	if (2*(count+1) > slots.size()) {
+		grow();
+	}
+	const size_t mask = slots.size()-1;
+	size_t i = hash(accelerator.key, accelerator.modifiers) & mask;
+	while (slots[i].key != 0) {
+		if (slots[i].key == accelerator.key && slots[i].modifiers == accelerator.modifiers) {
+			slots[i] = accelerator;
+			markAcceleratorsChanged();
+			return;
+		}
+		i = (i+1) & mask;
+	}
+	slots[i] = accelerator;
+	++count;
+	markAcceleratorsChanged();
+}
+
+void UIAcceleratorTable::add(size_t key, uint32 modifiers, bool (*action)(UIContainer&, void*), void* data) {
+	UIAccelerator accelerator;
+	accelerator.key = key;
+	accelerator.modifiers = modifiers;
+	accelerator.action = action;
+	accelerator.data = data;
+	accelerator.container = nullptr;
+	add(accelerator);
+}
+
+bool UIAcceleratorTable::remove(size_t key, uint32 modifiers) {
+	if (count == 0) {
+		return false;
+	}
+	const size_t mask = slots.size()-1;
+	size_t i = hash(key, modifiers) & mask;
+	while (!(slots[i].key == key && slots[i].modifiers == modifiers)) {
+		if (slots[i].key == 0) {
+			return false;
+		}
+		i = (i+1) & mask;
+	}
+
+	// Shift back any later entries in the probe sequence that would no longer
+	// be found with slot i empty, instead of leaving a tombstone.
+	size_t empty = i;
+	for (size_t j = (i+1) & mask; slots[j].key != 0; j = (j+1) & mask) {
+		const size_t home = hash(slots[j].key, slots[j].modifiers) & mask;
+		// The entry at j can move to empty if its home isn't cyclically in (empty, j].
+		const bool homeInRange = (empty <= j) ? (home > empty && home <= j) : (home > empty || home <= j);
+		if (!homeInRange) {
+			slots[empty] = slots[j];
+			empty = j;
+		}
+	}
+	slots[empty].key = 0;
+	--count;
+	markAcceleratorsChanged();
+	return true;
+}
+
+void UIAcceleratorTable::clear() {
+	for (size_t i = 0, n = slots.size(); i < n; ++i) {
+		slots[i].key = 0;
+	}
+	count = 0;
+	markAcceleratorsChanged();
+}
+
+// The accelerators of all containers on the keyboard focus path, with
+// inner containers' accelerators replacing those of outer containers.
+static UIAcceleratorTable focusPathAccelerators;
+static bool isFocusPathCompiled = false;
+
+void markAcceleratorsChanged() {
+	isFocusPathCompiled = false;
+}
+
+void setAccelerators(UIContainer& container, const UIAcceleratorTable* table) {
+	container.accelerators = table;
+	markAcceleratorsChanged();
+}
+
+static void compileFocusPath(UIContainer& root) {
+	focusPathAccelerators.clear();
+	UIContainer* container = &root;
+	while (true) {
+		const UIAcceleratorTable* table = container->accelerators;
+		if (table != nullptr) {
+			table->forEach([container](const UIAccelerator& accelerator) {
+				UIAccelerator compiled(accelerator);
+				compiled.container = container;
+				focusPathAccelerators.add(compiled);
+			});
+		}
+		const size_t index = container->keyFocusIndex;
+		if (index == UIContainer::INVALID_INDEX) {
+			break;
+		}
+		UIBox& child = *container->children[index];
+		if (!child.type->isContainer) {
+			break;
+		}
+		container = static_cast<UIContainer*>(&child);
+	}
+	// Adding to focusPathAccelerators marked it as changed.
+	isFocusPathCompiled = true;
+}
+
+bool dispatchAccelerator(UIContainer& root, size_t key, uint32 modifiers) {
+	if (!isFocusPathCompiled) {
+		compileFocusPath(root);
+	}
+	const UIAccelerator* accelerator = focusPathAccelerators.find(key, modifiers);
+	if (accelerator == nullptr || accelerator->action == nullptr) {
+		return false;
+	}
+	return accelerator->action(*accelerator->container, accelerator->data);
+}
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
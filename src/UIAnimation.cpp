@@ -0,0 +1,191 @@
+#include "UIAnimation.h"
+#include "UIBox.h"
+#include "MainWindow.h"
+
+#include <SDL.h>
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Types.h>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+struct ActiveTween {
+	UITween tween;
+	UITweenID id;
+	uint64 startTime;
+};
+
+// Cancelled tweens have a null box, and are removed after stepping,
+// so that callbacks can start and cancel tweens while stepping.
+static Array<ActiveTween> activeTweens;
+static size_t numCancelledTweens = 0;
+static bool isSteppingAnimations = false;
+static UITweenID nextTweenID = 1;
+
+static void removeCancelledTweens() {
+	if (numCancelledTweens == 0) {
+		return;
+	}
+	size_t destIndex = 0;
+	for (size_t i = 0, n = activeTweens.size(); i < n; ++i) {
+		if (activeTweens[i].tween.box != nullptr) {
+			if (destIndex != i) {
+				activeTweens[destIndex] = activeTweens[i];
+			}
+			++destIndex;
+		}
+	}
+	activeTweens.setSize(destIndex);
+	numCancelledTweens = 0;
+}
+
+static void cancelActiveTween(ActiveTween& active) {
+	assert(active.tween.box != nullptr);
+	assert(active.tween.box->numTweens != 0);
+	--active.tween.box->numTweens;
+	active.tween.box = nullptr;
+	++numCancelledTweens;
+}
+
+static float applyEasing(UIEasing easing, float t) {
+	switch (easing) {
+		case UIEasing::LINEAR:
+			return t;
+		case UIEasing::EASE_IN:
+			return t*t;
+		case UIEasing::EASE_OUT:
+			return t*(2-t);
+		case UIEasing::EASE_IN_OUT:
+		default:
+			// Smoothstep, so the speed is zero at both ends.
+			return t*t*(3-2*t);
+	}
+}
+
+UITweenID startTween(const UITween& tween) {
+	assert(tween.box != nullptr);
+	if (tween.value != nullptr) {
+		for (ActiveTween& active : activeTweens) {
+			if (active.tween.box != nullptr && active.tween.value == tween.value) {
+				cancelActiveTween(active);
+			}
+		}
+	}
+	if (!isSteppingAnimations) {
+		removeCancelledTweens();
+	}
+
+	ActiveTween active;
+	active.tween = tween;
+	active.id = nextTweenID;
+	++nextTweenID;
+	active.startTime = SDL_GetPerformanceCounter();
+	activeTweens.append(active);
+	++tween.box->numTweens;
+	return active.id;
+}
+
+UITweenID animateValue(UIBox& box, float* value, float to, float duration, UIEasing easing) {
+	assert(value != nullptr);
+	UITween tween;
+	tween.box = &box;
+	tween.value = value;
+	tween.from = *value;
+	tween.to = to;
+	tween.duration = duration;
+	tween.easing = easing;
+	return startTween(tween);
+}
+
+void cancelTween(UITweenID id) {
+	for (ActiveTween& active : activeTweens) {
+		if (active.id == id) {
+			if (active.tween.box != nullptr) {
+				cancelActiveTween(active);
+			}
+			break;
+		}
+	}
+	if (!isSteppingAnimations) {
+		removeCancelledTweens();
+	}
+}
+
+void cancelAnimations(UIBox& box) {
+	for (size_t i = 0, n = activeTweens.size(); i < n && box.numTweens != 0; ++i) {
+		ActiveTween& active = activeTweens[i];
+		if (active.tween.box == &box) {
+			cancelActiveTween(active);
+		}
+	}
+	if (!isSteppingAnimations) {
+		removeCancelledTweens();
+	}
+}
+
+bool isAnimating() {
+	return activeTweens.size() != numCancelledTweens;
+}
+
+void stepAnimations(uint64 frameTime) {
+	if (activeTweens.size() == 0) {
+		return;
+	}
+	const float countsPerSecond = float(SDL_GetPerformanceFrequency());
+
+	isSteppingAnimations = true;
+	// Tweens started by callbacks are appended, and start on the next step.
+	for (size_t i = 0, n = activeTweens.size(); i < n; ++i) {
+		// NOTE: Callbacks may append to activeTweens, so this can't be a reference
+		// held across callbacks.
+		if (activeTweens[i].tween.box == nullptr) {
+			continue;
+		}
+		const UITween tween = activeTweens[i].tween;
+		const uint64 startTime = activeTweens[i].startTime;
+
+		float t = 1;
+		if (tween.duration > 0 && frameTime > startTime) {
+			t = float(frameTime - startTime)/(tween.duration*countsPerSecond);
+		}
+		else if (tween.duration > 0) {
+			t = 0;
+		}
+		bool isFinished = false;
+		if (t >= 1) {
+			if (tween.repeat && tween.duration > 0) {
+				// Keep the phase, even if steps were missed.
+				const uint64 durationCounts = uint64(tween.duration*countsPerSecond);
+				const uint64 numPasses = (durationCounts != 0) ? (frameTime - startTime)/durationCounts : 1;
+				activeTweens[i].startTime = startTime + numPasses*durationCounts;
+				t = float(frameTime - activeTweens[i].startTime)/(tween.duration*countsPerSecond);
+			}
+			else {
+				t = 1;
+				isFinished = true;
+			}
+		}
+
+		const float value = tween.from + (tween.to - tween.from)*applyEasing(tween.easing, t);
+		if (tween.value != nullptr) {
+			*tween.value = value;
+		}
+		// Only the animated box changed, so only its bounds need redrawing.
+		invalidateBox(*tween.box);
+		if (isFinished) {
+			cancelActiveTween(activeTweens[i]);
+		}
+		if (tween.onStep != nullptr) {
+			tween.onStep(*tween.box, value, tween.callbackData);
+		}
+		if (isFinished && tween.onFinished != nullptr) {
+			tween.onFinished(*tween.box, tween.callbackData);
+		}
+	}
+	isSteppingAnimations = false;
+	removeCancelledTweens();
+}
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
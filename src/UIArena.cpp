@@ -0,0 +1,138 @@
+#include "UIArena.h"
+
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Types.h>
+
+#include <new>
+#include <stdlib.h>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+static thread_local UIArena* currentArena = nullptr;
+
+UIArena* getCurrentUIArena() {
+	return currentArena;
+}
+
+UIArenaScope::UIArenaScope(UIArena* arena) : previous(currentArena) {
+	currentArena = arena;
+}
+
+UIArenaScope::~UIArenaScope() {
+	currentArena = previous;
+}
+
+UIArena::UIArena(size_t blockSize_) :
+	current(nullptr),
+	currentEnd(nullptr),
+	blockSize(blockSize_)
+{
+	for (size_t i = 0; i < NUM_SIZE_CLASSES; ++i) {
+		freeLists[i] = nullptr;
+	}
+}
+
+UIArena::~UIArena() {
+	// Any boxes still allocated from this arena would be left dangling.
+	assert(stats.numLiveAllocations == 0);
+	freeBlocks(0);
+}
+
+void UIArena::addBlock(size_t minSize) {
+	const size_t size = (minSize > blockSize) ? minSize : blockSize;
+	char* block = (char*)malloc(size);
+	if (block == nullptr) {
+		throw std::bad_alloc();
+	}
+	blocks.append(Block{block, size});
+	current = block;
+	currentEnd = block + size;
+	++stats.numBlocks;
+	stats.bytesReserved += size;
+}
+
+void UIArena::freeBlocks(size_t numToKeep) {
+	for (size_t i = numToKeep, n = blocks.size(); i < n; ++i) {
+		free(blocks[i].data);
+	}
+	if (blocks.size() > numToKeep) {
+		blocks.setSize(numToKeep);
+	}
+	stats.numBlocks = blocks.size();
+}
+
+void* UIArena::allocate(size_t size) {
+	// Round up, so that the next allocation is also aligned.
+	size = (size + ALIGNMENT-1) & ~(ALIGNMENT-1);
+	if (size == 0) {
+		size = ALIGNMENT;
+	}
+	const size_t totalSize = sizeof(UIAllocationHeader) + size;
+
+	UIAllocationHeader* header;
+	const size_t sizeClass = (size/ALIGNMENT) - 1;
+	if (size <= MAX_POOLED_SIZE && freeLists[sizeClass] != nullptr) {
+		FreeNode* node = freeLists[sizeClass];
+		freeLists[sizeClass] = node->next;
+		header = reinterpret_cast<UIAllocationHeader*>(node);
+		++stats.numReused;
+	}
+	else {
+		if (current == nullptr || size_t(currentEnd - current) < totalSize) {
+			// Any space left at the end of the previous block is wasted,
+			// but it's at most the size of one allocation.
+			addBlock(totalSize);
+		}
+		header = reinterpret_cast<UIAllocationHeader*>(current);
+		current += totalSize;
+	}
+
+	header->arena = this;
+	header->size = size;
+	stats.bytesAllocated += totalSize;
+	++stats.numAllocations;
+	++stats.numLiveAllocations;
+	return header + 1;
+}
+
+void UIArena::deallocate(void* p) {
+	UIAllocationHeader* header = static_cast<UIAllocationHeader*>(p) - 1;
+	assert(header->arena == this);
+	assert(stats.numLiveAllocations != 0);
+	--stats.numLiveAllocations;
+
+	const size_t size = header->size;
+	if (size > MAX_POOLED_SIZE) {
+		// Large allocations are only reclaimed by reset.
+		return;
+	}
+	const size_t sizeClass = (size/ALIGNMENT) - 1;
+	FreeNode* node = reinterpret_cast<FreeNode*>(header);
+	node->next = freeLists[sizeClass];
+	freeLists[sizeClass] = node;
+}
+
+void UIArena::reset() {
+	assert(stats.numLiveAllocations == 0);
+	for (size_t i = 0; i < NUM_SIZE_CLASSES; ++i) {
+		freeLists[i] = nullptr;
+	}
+	// Keep the first block, so that rebuilding a screen of similar size
+	// doesn't need to go back to the heap for most of it.
+	freeBlocks(1);
+	if (blocks.size() != 0) {
+		current = blocks[0].data;
+		currentEnd = current + blocks[0].size;
+		stats.bytesReserved = blocks[0].size;
+	}
+	else {
+		current = nullptr;
+		currentEnd = nullptr;
+		stats.bytesReserved = 0;
+	}
+}
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
@@ -0,0 +1,334 @@
+#include "UIBinaryLayout.h"
+#include "UIArena.h"
+#include "UIBox.h"
+#include "widgets/ImageButton.h"
+#include "widgets/ScrollContainer.h"
+#include "widgets/VirtualList.h"
+
+#include <SDL.h>
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Types.h>
+
+#include <string.h>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+// "UIL1" in memory
+constexpr static uint32 LAYOUT_FILE_MAGIC = 0x314C4955;
+constexpr static uint32 LAYOUT_FILE_VERSION = 1;
+
+struct LayoutFileHeader {
+	uint32 magic;
+	uint32 version;
+	uint32 numClasses;
+	uint32 numBoxes;
+};
+
+// Each class name is saved as a uint32 length, followed by that many bytes.
+// Then, the boxes are saved in depth-first order, each as a BoxRecord,
+// followed by dataSize bytes from writeData, followed by its children.
+struct BoxRecord {
+	uint32 classIndex;
+	uint32 numChildren;
+	uint32 dataSize;
+
+	float origin[2];
+	float size[2];
+
+	float preferredSize[2];
+	float minSize[2];
+	float maxSize[2];
+	float flexWeight;
+
+	// These are only used if the class is a container.
+	uint32 layoutKind;
+	uint32 layoutAxis;
+	uint32 numColumns;
+	float spacing[2];
+	float padding[2];
+	float backgroundColour[4];
+};
+
+static Array<const UIBoxClass*> registeredClasses;
+
+static void registerBuiltInClasses() {
+	if (registeredClasses.size() != 0) {
+		return;
+	}
+	registeredClasses.append(&UIBox::staticType);
+	registeredClasses.append(&UIContainer::staticType);
+	registeredClasses.append(&ImageButton::staticType);
+	registeredClasses.append(&ScrollContainer::staticType);
+	registeredClasses.append(&VirtualList::staticType);
+}
+
+const UIBoxClass* findUIBoxClass(const char* typeName) {
+	registerBuiltInClasses();
+	for (const UIBoxClass* c : registeredClasses) {
+		if (strcmp(c->typeName, typeName) == 0) {
+			return c;
+		}
+	}
+	return nullptr;
+}
+
+bool registerUIBoxClass(const UIBoxClass& c) {
+	if (c.typeName == nullptr || c.construct == nullptr) {
+		return false;
+	}
+	const UIBoxClass* existing = findUIBoxClass(c.typeName);
+	if (existing != nullptr) {
+		return (existing == &c);
+	}
+	registeredClasses.append(&c);
+	return true;
+}
+
+static void appendBytes(Array<uint8>& output, const void* data, size_t size) {
+	const size_t start = output.size();
+	output.setSize(start + size);
+	memcpy(output.data() + start, data, size);
+}
+
+static void copyVec(float* dest, const Vec2f& v) {
+	dest[0] = v[0];
+	dest[1] = v[1];
+}
+
+bool saveUILayout(const UIBox& root, Array<uint8>& output) {
+	// First, find the classes, so that the boxes can refer to them by index.
+	Array<const UIBoxClass*> classes;
+	Array<uint32> classIndices;
+	Array<const UIBox*> boxes;
+	Array<const UIBox*> stack;
+	stack.append(&root);
+	while (stack.size() != 0) {
+		const UIBox* box = stack.last();
+		stack.setSize(stack.size()-1);
+		const UIBoxClass* c = box->type;
+		if (c->typeName == nullptr) {
+			return false;
+		}
+		size_t classIndex = 0;
+		while (classIndex < classes.size() && classes[classIndex] != c) {
+			++classIndex;
+		}
+		if (classIndex == classes.size()) {
+			classes.append(c);
+		}
+		classIndices.append(uint32(classIndex));
+		boxes.append(box);
+
+		if (c->isContainer) {
+			// Push in reverse, so that the children are visited in order.
+			const Array<std::unique_ptr<UIBox>>& children = static_cast<const UIContainer*>(box)->children;
+			for (size_t i = children.size(); i > 0; ) {
+				--i;
+				stack.append(children[i].get());
+			}
+		}
+	}
+
+	const LayoutFileHeader header{LAYOUT_FILE_MAGIC, LAYOUT_FILE_VERSION, uint32(classes.size()), uint32(boxes.size())};
+	appendBytes(output, &header, sizeof(header));
+	for (const UIBoxClass* c : classes) {
+		const uint32 length = uint32(strlen(c->typeName));
+		appendBytes(output, &length, sizeof(length));
+		appendBytes(output, c->typeName, length);
+	}
+
+	Array<uint8> data;
+	for (size_t i = 0, n = boxes.size(); i < n; ++i) {
+		const UIBox& box = *boxes[i];
+		const UIBoxClass* c = box.type;
+
+		data.setSize(0);
+		if (c->writeData != nullptr) {
+			c->writeData(box, data);
+		}
+
+		BoxRecord record;
+		memset(&record, 0, sizeof(record));
+		record.classIndex = classIndices[i];
+		record.dataSize = uint32(data.size());
+		copyVec(record.origin, box.origin);
+		copyVec(record.size, box.size);
+		const UILayoutParams& params = box.layoutParams;
+		copyVec(record.preferredSize, params.preferredSize);
+		copyVec(record.minSize, params.minSize);
+		copyVec(record.maxSize, params.maxSize);
+		record.flexWeight = params.flexWeight;
+		if (c->isContainer) {
+			const UIContainer& container = static_cast<const UIContainer&>(box);
+			record.numChildren = uint32(container.children.size());
+			const UILayoutSettings& settings = container.layoutSettings;
+			record.layoutKind = uint32(settings.kind);
+			record.layoutAxis = settings.axis;
+			record.numColumns = settings.numColumns;
+			copyVec(record.spacing, settings.spacing);
+			copyVec(record.padding, settings.padding);
+			for (size_t j = 0; j < 4; ++j) {
+				record.backgroundColour[j] = container.backgroundColour[j];
+			}
+		}
+		appendBytes(output, &record, sizeof(record));
+		if (data.size() != 0) {
+			appendBytes(output, data.data(), data.size());
+		}
+	}
+	return true;
+}
+
+static bool invalidLayout(const char* message) {
+	SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Invalid UI layout data: %s\n", message);
+	return false;
+}
+
+// Reads the boxes, after the header and class table, into root.
+static bool loadBoxes(const uint8* data, const uint8* end, const Array<const UIBoxClass*>& classes, size_t numBoxes, std::unique_ptr<UIBox>& root) {
+	struct ContainerState {
+		UIContainer* container;
+		size_t remainingChildren;
+	};
+	Array<ContainerState> stack;
+
+	for (size_t boxIndex = 0; boxIndex < numBoxes; ++boxIndex) {
+		BoxRecord record;
+		if (size_t(end - data) < sizeof(record)) {
+			return invalidLayout("truncated box");
+		}
+		memcpy(&record, data, sizeof(record));
+		data += sizeof(record);
+		if (record.classIndex >= classes.size() || size_t(end - data) < record.dataSize) {
+			return invalidLayout("invalid box");
+		}
+		const UIBoxClass* c = classes[record.classIndex];
+		if (record.numChildren != 0 && !c->isContainer) {
+			return invalidLayout("children of a box that isn't a container");
+		}
+		// Each child is one of the remaining boxes, so this also limits the
+		// children array allocated below.
+		if (record.numChildren > numBoxes - boxIndex - 1) {
+			return invalidLayout("more children than remaining boxes");
+		}
+		if (record.layoutKind > uint32(UILayoutKind::GRID) || record.layoutAxis > 1) {
+			return invalidLayout("invalid layout settings");
+		}
+
+		std::unique_ptr<UIBox> box(c->construct());
+		if (!box || box->type != c) {
+			return invalidLayout("class constructed a box of a different class");
+		}
+		box->origin = Vec2f(record.origin[0], record.origin[1]);
+		box->size = Vec2f(record.size[0], record.size[1]);
+		UILayoutParams& params = box->layoutParams;
+		params.preferredSize = Vec2f(record.preferredSize[0], record.preferredSize[1]);
+		params.minSize = Vec2f(record.minSize[0], record.minSize[1]);
+		params.maxSize = Vec2f(record.maxSize[0], record.maxSize[1]);
+		params.flexWeight = record.flexWeight;
+		if (c->isContainer) {
+			UIContainer& container = static_cast<UIContainer&>(*box);
+			UILayoutSettings& settings = container.layoutSettings;
+			settings.kind = UILayoutKind(record.layoutKind);
+			settings.axis = uint8(record.layoutAxis);
+			settings.numColumns = record.numColumns;
+			settings.spacing = Vec2f(record.spacing[0], record.spacing[1]);
+			settings.padding = Vec2f(record.padding[0], record.padding[1]);
+			container.backgroundColour = Vec4f(record.backgroundColour[0], record.backgroundColour[1], record.backgroundColour[2], record.backgroundColour[3]);
+			// Allocate the children array once, instead of growing it.
+			container.children.setCapacity(record.numChildren);
+		}
+		if (c->readData != nullptr && !c->readData(*box, data, record.dataSize)) {
+			return invalidLayout("invalid class data");
+		}
+		data += record.dataSize;
+
+		UIBox* boxPointer = box.get();
+		if (stack.size() == 0) {
+			if (boxIndex != 0) {
+				return invalidLayout("more than one root");
+			}
+			root = std::move(box);
+		}
+		else {
+			ContainerState& state = stack.last();
+			box->parent = state.container;
+			state.container->children.append(std::move(box));
+			--state.remainingChildren;
+			if (state.remainingChildren == 0) {
+				stack.setSize(stack.size()-1);
+			}
+		}
+		if (record.numChildren != 0) {
+			stack.append(ContainerState{static_cast<UIContainer*>(boxPointer), record.numChildren});
+		}
+	}
+	if (stack.size() != 0) {
+		return invalidLayout("missing children");
+	}
+	if (data != end) {
+		return invalidLayout("trailing data after the last box");
+	}
+	return true;
+}
+
+std::unique_ptr<UIBox> loadUILayout(const uint8* data, size_t size, UIArena* arena) {
+	const uint8* end = data + size;
+	LayoutFileHeader header;
+	if (size < sizeof(header)) {
+		invalidLayout("truncated header");
+		return nullptr;
+	}
+	memcpy(&header, data, sizeof(header));
+	data += sizeof(header);
+	if (header.magic != LAYOUT_FILE_MAGIC || header.version != LAYOUT_FILE_VERSION || header.numBoxes == 0) {
+		invalidLayout("unsupported header");
+		return nullptr;
+	}
+
+	// Each class name has at least its 4-byte length, so this also limits
+	// the classes array allocated below.
+	if (header.numClasses > size_t(end - data)/sizeof(uint32)) {
+		invalidLayout("more classes than the data can hold");
+		return nullptr;
+	}
+
+	// Look up each class once, instead of once per box.
+	Array<const UIBoxClass*> classes;
+	classes.setCapacity(header.numClasses);
+	char name[256];
+	for (uint32 i = 0; i < header.numClasses; ++i) {
+		uint32 length;
+		if (size_t(end - data) < sizeof(length)) {
+			invalidLayout("truncated class table");
+			return nullptr;
+		}
+		memcpy(&length, data, sizeof(length));
+		data += sizeof(length);
+		if (length >= sizeof(name) || size_t(end - data) < length) {
+			invalidLayout("invalid class name");
+			return nullptr;
+		}
+		memcpy(name, data, length);
+		name[length] = 0;
+		data += length;
+		const UIBoxClass* c = findUIBoxClass(name);
+		if (c == nullptr) {
+			SDL_LogError(SDL_LOG_CATEGORY_ERROR, "UI layout data has unregistered class \"%s\"\n", name);
+			return nullptr;
+		}
+		classes.append(c);
+	}
+
+	UIArenaScope scope((arena != nullptr) ? arena : getCurrentUIArena());
+	std::unique_ptr<UIBox> root;
+	if (!loadBoxes(data, end, classes, header.numBoxes, root)) {
+		return nullptr;
+	}
+	return root;
+}
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
@@ -1,8 +1,13 @@
 #include "UIBox.h"
+#include "UIArena.h"
+#include "UIFlatTree.h"
 #include "Canvas.h"
 
 #include <Box.h>
 
+#include <new>
+#include <stdlib.h>
+
 OUTER_NAMESPACE_BEGIN
 UICOMMON_LIBRARY_NAMESPACE_BEGIN
 
@@ -21,25 +26,86 @@ UIBoxClass UIBox::initClass() {
 
 const UIBoxClass UIBox::staticType(UIBox::initClass());
 
-static size_t positionToChildIndex(const Vec2f& position, const Array<std::unique_ptr<UIBox>>& children) {
+void* UIBox::operator new(size_t size) {
+	UIArena* arena = getCurrentUIArena();
+	if (arena != nullptr) {
+		return arena->allocate(size);
+	}
+	UIAllocationHeader* header = (UIAllocationHeader*)malloc(sizeof(UIAllocationHeader) + size);
+	if (header == nullptr) {
+		throw std::bad_alloc();
+	}
+	header->arena = nullptr;
+	header->size = size;
+	return header + 1;
+}
+
+void UIBox::operator delete(void* p) {
+	if (p == nullptr) {
+		return;
+	}
+	UIAllocationHeader* header = static_cast<UIAllocationHeader*>(p) - 1;
+	if (header->arena != nullptr) {
+		header->arena->deallocate(p);
+		return;
+	}
+	free(header);
+}
+
+static bool isInsideChild(const Vec2f& position, UIBox& child) {
+	const Vec2f& c0 = child.origin;
+	const Vec2f& size = child.size;
+	if (position[0] >= c0[0] && position[0]-c0[0] < size[0] &&
+		position[1] >= c0[1] && position[1]-c0[1] < size[1]
+	) {
+		bool inside = child.type->consumesMouse;
+		auto childIsInside = child.type->isInside;
+		if (childIsInside != nullptr) {
+			inside = (*childIsInside)(child, position-c0);
+		}
+		return inside;
+	}
+	return false;
+}
+
+static size_t positionToChildIndex(const Vec2f& position, UIContainer& container) {
+	const Array<std::unique_ptr<UIBox>>& children = container.children;
+
+	UIGridIndex* spatialIndex = container.spatialIndex.get();
+	if (spatialIndex != nullptr) {
+		spatialIndex->ensureBuilt(container.size, children);
+		const Array<uint32>* candidates = spatialIndex->findCandidates(position);
+		if (candidates != nullptr) {
+			// Only check the children overlapping the cell, in reverse order,
+			// since it's the topmost-drawn first order.
+			for (size_t i = candidates->size(); i > 0; ) {
+				--i;
+				const size_t childIndex = (*candidates)[i];
+				if (isInsideChild(position, *children[childIndex])) {
+					return childIndex;
+				}
+			}
+			return UIContainer::INVALID_INDEX;
+		}
+		// The position is outside the grid, so any child might contain it.
+	}
+
+	// Read the children's bounds from the current UIFlatTree if it's up to date,
+	// instead of from each child.
+	const UIFlatTree* tree = getCurrentUIFlatTree();
+	if (tree != nullptr) {
+		const uint32 node = tree->findContainer(container);
+		if (node != UIFlatTree::INVALID_NODE) {
+			return tree->positionToChildIndex(node, position);
+		}
+	}
+
 	// Check if any child boxes contain the mouse position, in reverse order,
 	// since it's the topmost-drawn first order.
 	for (size_t i = children.size(); i > 0; ) {
 		--i;
-		UIBox& child = *children[i];
-		const Vec2f& c0 = child.origin;
-		const Vec2f& size = child.size;
-		if (position[0] >= c0[0] && position[0]-c0[0] < size[0] &&
-			position[1] >= c0[1] && position[1]-c0[1] < size[1]
-		) {
-			bool inside = child.type->consumesMouse;
-			auto childIsInside = child.type->isInside;
-			if (childIsInside != nullptr) {
-				inside = (*childIsInside)(child, position-c0);
-			}
-			if (inside) {
-				return i;
-			}
+		if (isInsideChild(position, *children[i])) {
+			return i;
 		}
 	}
 	return UIContainer::INVALID_INDEX;
@@ -59,9 +125,14 @@ UIContainerClass UIContainer::initClass() {
 	c.onMouseDown = &onMouseDown;
 	c.onMouseUp = &onMouseUp;
 	c.onMouseScroll = &onMouseScroll;
+	c.onKeyDown = &onKeyDown;
+	c.onKeyUp = &onKeyUp;
 
 	c.draw = &draw;
 
+	c.measure = &measureContainerChildren;
+	c.layout = &layoutContainerChildren;
+
 	return c;
 }
 
@@ -87,7 +158,7 @@ void UIContainer::updateMouseFocusIndex(UIContainer& container, const MouseState
 
 	size_t childIndex = INVALID_INDEX;
 	if (insideContainer) {
-		childIndex = positionToChildIndex(position, children);
+		childIndex = positionToChildIndex(position, container);
 	}
 
 	// If the mouse focus child index hasn't changed, there's nothing more to do.
@@ -129,7 +200,68 @@ UIBox* UIContainer::construct() {
 void UIContainer::destruct(UIBox* box) {
 	assert(box->type != nullptr);
 	assert(box->type->isContainer);
-	static_cast<UIContainer*>(box)->children.setCapacity(0);
+	UIContainer* container = static_cast<UIContainer*>(box);
+	if (container->accelerators != nullptr || container->keyFocusIndex != INVALID_INDEX) {
+		// The compiled accelerators may refer to this or its descendants.
+		markAcceleratorsChanged();
+	}
+	container->children.setCapacity(0);
+	container->spatialIndex.reset();
+}
+
+void UIContainer::enableSpatialIndex(const Vec2f& cellSize) {
+	spatialIndex.reset(new UIGridIndex(cellSize));
+}
+
+void UIContainer::disableSpatialIndex() {
+	spatialIndex.reset();
+}
+
+void UIContainer::childBoundsChanged(size_t childIndex) {
+	if (spatialIndex) {
+		spatialIndex->updateChild(childIndex, *children[childIndex]);
+	}
+	markUITreeBoundsChanged();
+}
+
+void UIContainer::addChild(std::unique_ptr<UIBox>&& child) {
+	assert(child);
+	child->parent = this;
+	UIBox& childRef = *child;
+	children.append(std::move(child));
+	childrenChanged();
+	markLayoutDirty(childRef);
+}
+
+std::unique_ptr<UIBox> UIContainer::removeChild(size_t childIndex) {
+	const size_t n = children.size();
+	assert(childIndex < n);
+	std::unique_ptr<UIBox> child(std::move(children[childIndex]));
+	for (size_t i = childIndex+1; i < n; ++i) {
+		children[i-1] = std::move(children[i]);
+	}
+	children.setSize(n-1);
+
+	// Keep the focus indices referring to the same children.
+	if (keyFocusIndex == childIndex) {
+		keyFocusIndex = INVALID_INDEX;
+		markAcceleratorsChanged();
+	}
+	else if (keyFocusIndex != INVALID_INDEX && keyFocusIndex > childIndex) {
+		--keyFocusIndex;
+	}
+	assert(mouseFocusIndex != childIndex);
+	if (mouseFocusIndex == childIndex) {
+		mouseFocusIndex = INVALID_INDEX;
+	}
+	else if (mouseFocusIndex != INVALID_INDEX && mouseFocusIndex > childIndex) {
+		--mouseFocusIndex;
+	}
+
+	child->parent = nullptr;
+	childrenChanged();
+	markLayoutDirty(*this);
+	return child;
 }
 
 bool UIContainer::isInside(UIBox& box, const Vec2f& position) {
@@ -144,8 +276,7 @@ bool UIContainer::isInside(UIBox& box, const Vec2f& position) {
 
 	// Otherwise, inside if inside any child box.
 	// NOTE: Order doesn't matter
-	Array<std::unique_ptr<UIBox>>& children = container.children;
-	size_t index = positionToChildIndex(position, children);
+	size_t index = positionToChildIndex(position, container);
 
 	return (index != INVALID_INDEX);
 }
@@ -160,7 +291,7 @@ void UIContainer::onMouseEnter(UIBox& box, const MouseState& state) {
 	// No child should have mouse focus in a container that hasn't been entered yet.
 	assert(container.mouseFocusIndex == INVALID_INDEX);
 
-	size_t index = positionToChildIndex(state.position, children);
+	size_t index = positionToChildIndex(state.position, container);
 	container.mouseFocusIndex = index;
 
 	if (index != INVALID_INDEX) {
@@ -329,6 +460,49 @@ void UIContainer::onMouseScroll(UIBox& box, float scrollAmount, const MouseState
 	// Scrolling the mouse wheel never changes mouse focus, so that's all.
 }
 
+void UIContainer::onKeyDown(UIBox& box, size_t key, const KeyState& state) {
+	assert(box.type != nullptr);
+	assert(box.type->isContainer);
+	UIContainer* container = static_cast<UIContainer*>(&box);
+
+	// Recurse on the keyFocusIndex child.
+	while (container->keyFocusIndex != INVALID_INDEX) {
+		UIBox& child = *container->children[container->keyFocusIndex];
+		auto childOnKeyDown = child.type->onKeyDown;
+		// Avoid actual recursion if child just has regular container behaviour.
+		if (childOnKeyDown == UIContainer::onKeyDown) {
+			assert(child.type->isContainer);
+			container = static_cast<UIContainer*>(&child);
+			continue;
+		}
+		if (childOnKeyDown != nullptr) {
+			(*childOnKeyDown)(child, key, state);
+		}
+		break;
+	}
+}
+
+void UIContainer::onKeyUp(UIBox& box, size_t key, const KeyState& state) {
+	assert(box.type != nullptr);
+	assert(box.type->isContainer);
+	UIContainer* container = static_cast<UIContainer*>(&box);
+
+	// Recurse on the keyFocusIndex child.
+	while (container->keyFocusIndex != INVALID_INDEX) {
+		UIBox& child = *container->children[container->keyFocusIndex];
+		auto childOnKeyUp = child.type->onKeyUp;
+		if (childOnKeyUp == UIContainer::onKeyUp) {
+			assert(child.type->isContainer);
+			container = static_cast<UIContainer*>(&child);
+			continue;
+		}
+		if (childOnKeyUp != nullptr) {
+			(*childOnKeyUp)(child, key, state);
+		}
+		break;
+	}
+}
+
 void UIContainer::draw(const UIBox& box, const Box2f& clipRectangle, const Box2f& targetRectangle, Canvas& target) {
 	assert(box.type != nullptr);
 	assert(box.type->isContainer);
@@ -336,7 +510,18 @@ void UIContainer::draw(const UIBox& box, const Box2f& clipRectangle, const Box2f
 
 	if (container.backgroundColour[3] != 0) {
 		// Fill the targetRectangle with the background colour.
-		target.image.applyRectangle(targetRectangle, container.backgroundColour);
+		target.applyRectangle(targetRectangle, container.backgroundColour);
+	}
+
+	// If the current UIFlatTree is up to date, draw the children from it,
+	// which also draws any descendant containers without recursing.
+	const UIFlatTree* tree = getCurrentUIFlatTree();
+	if (tree != nullptr) {
+		const uint32 node = tree->findContainer(container);
+		if (node != UIFlatTree::INVALID_NODE) {
+			tree->drawChildren(node, clipRectangle, targetRectangle, target);
+			return;
+		}
 	}
 
 	const Array<std::unique_ptr<UIBox>>& children = container.children;
@@ -355,44 +540,14 @@ void UIContainer::draw(const UIBox& box, const Box2f& clipRectangle, const Box2f
 		if (childDraw == nullptr) {
 			continue;
 		}
-		
-		Box2f childClipRectangle(clipRectangle);
-		bool empty = false;
-		// Clip the rectangle.
-		for (size_t axis = 0; axis < 2; ++axis) {
-			// The min of the parent clip rectangle in the child's space is usually
-			// negative, so it must be forced up to zero.
-			if (childClipRectangle[axis][0] < child.origin[axis]) {
-				childClipRectangle[axis][0] = child.origin[axis];
-			}
-			// The max of the parent clip rectangle in the child's space is usually
-			// past the max of the child, so it must be forced down to that.
-			if (childClipRectangle[axis][1] > child.origin[axis]+child.size[axis]) {
-				childClipRectangle[axis][1] = child.origin[axis]+child.size[axis];
-			}
-
-			if (childClipRectangle[axis][1] <= childClipRectangle[axis][0]) {
-				empty = true;
-				break;
-			}
-		}
 
-		// Clip rectangle is empty, so there's nothing to draw.
-		if (empty) {
+		Box2f childClipRectangle;
+		Box2f childTargetRectangle;
+		if (!computeChildRectangles(child.origin, child.size, clipRectangle, targetRectangle, scale, childClipRectangle, childTargetRectangle)) {
+			// Clip rectangle is empty, so there's nothing to draw.
 			continue;
 		}
 
-		// Compute corresponding child target rectangle based on
-		// childClipRectangle's relation to clipRectangle and targetRectangle.
-		// This takes into account if there's been a simple scale along the way.
-		Box2f childTargetRectangle(
-			targetRectangle.min() + (childClipRectangle.min() - clipRectangle.min())*scale,
-			targetRectangle.max() + (childClipRectangle.max() - clipRectangle.max())*scale
-		);
-
-		// Shift the rectangle.
-		childClipRectangle -= child.origin;
-
 		childDraw(child, childClipRectangle, childTargetRectangle, target);
 	}
 }
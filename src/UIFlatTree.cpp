@@ -0,0 +1,232 @@
+#include "UIFlatTree.h"
+#include "UIBox.h"
+#include "Canvas.h"
+
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Box.h>
+#include <Vec.h>
+#include <Types.h>
+
+#include <atomic>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+// These start at 1, so that a UIFlatTree that was never updated isn't up to date.
+static std::atomic<uint64> structureChangeCount(1);
+static std::atomic<uint64> boundsChangeCount(1);
+
+static thread_local UIFlatTree* currentTree = nullptr;
+
+void markUITreeStructureChanged() {
+	structureChangeCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void markUITreeBoundsChanged() {
+	boundsChangeCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void setCurrentUIFlatTree(UIFlatTree* tree) {
+	currentTree = tree;
+}
+
+UIFlatTree* getCurrentUIFlatTree() {
+	return currentTree;
+}
+
+UIFlatTree::~UIFlatTree() {
+	if (currentTree == this) {
+		currentTree = nullptr;
+	}
+}
+
+void UIFlatTree::update(UIContainer& root) {
+	// Read the counts first, so that any changes during the update
+	// make this out of date again.
+	const uint64 structureCount = structureChangeCount.load(std::memory_order_relaxed);
+	const uint64 boundsCount = boundsChangeCount.load(std::memory_order_relaxed);
+	if (structureCount != builtStructureCount || boxes.size() == 0 || boxes[0] != &root) {
+		clear();
+		addSubtree(root, INVALID_NODE, 0);
+	}
+	else if (boundsCount != builtBoundsCount) {
+		updateBounds();
+	}
+	builtStructureCount = structureCount;
+	builtBoundsCount = boundsCount;
+}
+
+bool UIFlatTree::isUpToDate() const {
+	return boxes.size() != 0 &&
+		structureChangeCount.load(std::memory_order_relaxed) == builtStructureCount &&
+		boundsChangeCount.load(std::memory_order_relaxed) == builtBoundsCount;
+}
+
+void UIFlatTree::clear() {
+	origins.setSize(0);
+	sizes.setSize(0);
+	types.setSize(0);
+	parents.setSize(0);
+	subtreeEnds.setSize(0);
+	lastChildren.setSize(0);
+	previousSiblings.setSize(0);
+	indicesInParent.setSize(0);
+	flags.setSize(0);
+	backgroundColours.setSize(0);
+	boxes.setSize(0);
+	builtStructureCount = 0;
+	builtBoundsCount = 0;
+}
+
+uint32 UIFlatTree::findContainer(const UIContainer& container) const {
+	// The node stored in the container may be from another tree, so check
+	// that it's this tree's node.  If this is up to date, none of the boxes
+	// have been destroyed, so comparing the pointers is safe.
+	const uint32 node = container.flatTreeNode;
+	if (node >= boxes.size() || boxes[node] != &container || !isUpToDate()) {
+		return INVALID_NODE;
+	}
+	return node;
+}
+
+void UIFlatTree::addSubtree(UIBox& box, uint32 parent, uint32 indexInParent) {
+	const UIBoxClass* type = box.type;
+	const uint32 node = uint32(boxes.size());
+
+	uint32 nodeFlags = 0;
+	Vec4f backgroundColour(0,0,0,0);
+	if (type->isContainer) {
+		UIContainer& container = static_cast<UIContainer&>(box);
+		container.flatTreeNode = node;
+		backgroundColour = container.backgroundColour;
+		if (type->draw == &UIContainer::draw) {
+			nodeFlags |= DRAW_CHILDREN_BIT;
+		}
+	}
+
+	origins.append(box.origin);
+	sizes.append(box.size);
+	types.append(type);
+	parents.append(parent);
+	// The end of the subtree and the last child are filled in after adding
+	// the descendants.
+	subtreeEnds.append(node+1);
+	lastChildren.append(INVALID_NODE);
+	previousSiblings.append(INVALID_NODE);
+	indicesInParent.append(indexInParent);
+	flags.append(nodeFlags);
+	backgroundColours.append(backgroundColour);
+	boxes.append(&box);
+
+	if (type->isContainer) {
+		// The children are still added if the container has its own drawing
+		// or hit testing, so that parents are complete.
+		UIContainer& container = static_cast<UIContainer&>(box);
+		uint32 previousChild = INVALID_NODE;
+		for (size_t i = 0, n = container.children.size(); i < n; ++i) {
+			const uint32 child = uint32(boxes.size());
+			addSubtree(*container.children[i], node, uint32(i));
+			previousSiblings[child] = previousChild;
+			previousChild = child;
+		}
+		lastChildren[node] = previousChild;
+	}
+
+	subtreeEnds[node] = uint32(boxes.size());
+}
+
+void UIFlatTree::updateBounds() {
+	for (size_t node = 0, n = boxes.size(); node < n; ++node) {
+		const UIBox& box = *boxes[node];
+		origins[node] = box.origin;
+		sizes[node] = box.size;
+		if (types[node]->isContainer) {
+			backgroundColours[node] = static_cast<const UIContainer&>(box).backgroundColour;
+		}
+	}
+}
+
+static Vec2f computeScale(const Box2f& clipRectangle, const Box2f& targetRectangle) {
+	Vec2f scale(1.0f, 1.0f);
+	const Vec2f clipSize = clipRectangle.size();
+	const Vec2f targetSize = targetRectangle.size();
+	if (clipSize != targetSize) {
+		scale = (targetSize / clipSize);
+	}
+	return scale;
+}
+
+void UIFlatTree::drawChildren(uint32 parent, const Box2f& clipRectangle, const Box2f& targetRectangle, Canvas& target) const {
+	// The containers whose children are currently being drawn,
+	// from parent down, so that UIContainer::draw doesn't need to recurse.
+	struct ContainerState {
+		uint32 end;
+		Box2f clipRectangle;
+		Box2f targetRectangle;
+		Vec2f scale;
+	};
+	Array<ContainerState> stack;
+	stack.append(ContainerState{subtreeEnds[parent], clipRectangle, targetRectangle, computeScale(clipRectangle, targetRectangle)});
+
+	uint32 node = parent+1;
+	while (stack.size() != 0) {
+		if (node >= stack.last().end) {
+			stack.setSize(stack.size()-1);
+			continue;
+		}
+
+		auto childDraw = types[node]->draw;
+		if (childDraw == nullptr) {
+			node = subtreeEnds[node];
+			continue;
+		}
+
+		// Copy the state, since appending to the stack may reallocate it.
+		const ContainerState state = stack.last();
+		Box2f childClipRectangle;
+		Box2f childTargetRectangle;
+		if (!UIContainer::computeChildRectangles(origins[node], sizes[node], state.clipRectangle, state.targetRectangle, state.scale, childClipRectangle, childTargetRectangle)) {
+			// Clip rectangle is empty, so there's nothing to draw.
+			node = subtreeEnds[node];
+			continue;
+		}
+
+		if (!(flags[node] & DRAW_CHILDREN_BIT)) {
+			childDraw(*boxes[node], childClipRectangle, childTargetRectangle, target);
+			node = subtreeEnds[node];
+			continue;
+		}
+
+		// Regular container, so draw its background and continue into its children.
+		if (backgroundColours[node][3] != 0) {
+			target.applyRectangle(childTargetRectangle, backgroundColours[node]);
+		}
+		stack.append(ContainerState{subtreeEnds[node], childClipRectangle, childTargetRectangle, computeScale(childClipRectangle, childTargetRectangle)});
+		++node;
+	}
+}
+
+size_t UIFlatTree::positionToChildIndex(uint32 parent, const Vec2f& position) const {
+	// Check the children in reverse order, since it's the topmost-drawn first order.
+	for (uint32 child = lastChildren[parent]; child != INVALID_NODE; child = previousSiblings[child]) {
+		const Vec2f& c0 = origins[child];
+		const Vec2f& size = sizes[child];
+		if (position[0] >= c0[0] && position[0]-c0[0] < size[0] &&
+			position[1] >= c0[1] && position[1]-c0[1] < size[1]
+		) {
+			const UIBoxClass* type = types[child];
+			bool inside = type->consumesMouse;
+			if (type->isInside != nullptr) {
+				inside = (*type->isInside)(*boxes[child], position-c0);
+			}
+			if (inside) {
+				return indicesInParent[child];
+			}
+		}
+	}
+	return UIContainer::INVALID_INDEX;
+}
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
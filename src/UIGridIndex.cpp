@@ -0,0 +1,185 @@
+#include "UIGridIndex.h"
+#include "UIBox.h"
+
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Types.h>
+
+#include <math.h>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+void UIGridIndex::build(const Vec2f& currentContainerSize, const Array<std::unique_ptr<UIBox>>& children) {
+	containerSize = currentContainerSize;
+	needsRebuild = false;
+	const size_t numChildren = children.size();
+
+	cellSize = requestedCellSize;
+	if (!(cellSize[0] > 0) || !(cellSize[1] > 0)) {
+		// Use the average child size, so that each child overlaps only a few
+		// cells, and each cell overlaps only a few children.
+		Vec2f total(0,0);
+		size_t count = 0;
+		for (size_t i = 0; i < numChildren; ++i) {
+			const Vec2f& size = children[i]->size;
+			if (size[0] > 0 && size[1] > 0) {
+				total[0] += size[0];
+				total[1] += size[1];
+				++count;
+			}
+		}
+		if (count != 0) {
+			cellSize = Vec2f(total[0]/count, total[1]/count);
+		}
+		else {
+			cellSize = containerSize;
+		}
+	}
+
+	for (size_t axis = 0; axis < 2; ++axis) {
+		if (!(cellSize[axis] > 0)) {
+			cellSize[axis] = 1.0f;
+		}
+		numCells[axis] = (containerSize[axis] > 0) ? size_t(ceilf(containerSize[axis]/cellSize[axis])) : 1;
+		if (numCells[axis] == 0) {
+			numCells[axis] = 1;
+		}
+	}
+
+	// Avoid having far more cells than children, e.g. if a few children are
+	// much smaller than the container, since that would waste memory.
+	const size_t maxCells = 4*numChildren + 16;
+	while (numCells[0]*numCells[1] > maxCells) {
+		for (size_t axis = 0; axis < 2; ++axis) {
+			cellSize[axis] *= 2;
+			numCells[axis] = (numCells[axis] + 1)/2;
+		}
+	}
+
+	const size_t totalCells = numCells[0]*numCells[1];
+	cells.setSize(totalCells);
+	for (size_t i = 0; i < totalCells; ++i) {
+		cells[i].setSize(0);
+	}
+
+	childCellRanges.setSize(numChildren);
+	for (size_t i = 0; i < numChildren; ++i) {
+		const CellRange range = computeCellRange(*children[i]);
+		childCellRanges[i] = range;
+		// Children are added in increasing order, so this only appends.
+		addToCells(uint32(i), range);
+	}
+}
+
+void UIGridIndex::updateChild(size_t childIndex, const UIBox& child) {
+	if (needsRebuild || childIndex >= childCellRanges.size()) {
+		// Everything will be recomputed when the index is rebuilt.
+		needsRebuild = true;
+		return;
+	}
+	const CellRange newRange = computeCellRange(child);
+	const CellRange& oldRange = childCellRanges[childIndex];
+	if (newRange.min[0] == oldRange.min[0] && newRange.min[1] == oldRange.min[1] &&
+		newRange.max[0] == oldRange.max[0] && newRange.max[1] == oldRange.max[1]
+	) {
+		// Still in the same cells, so nothing to change.
+		return;
+	}
+	removeFromCells(uint32(childIndex), oldRange);
+	addToCells(uint32(childIndex), newRange);
+	childCellRanges[childIndex] = newRange;
+}
+
+const Array<uint32>* UIGridIndex::findCandidates(const Vec2f& position) const {
+	assert(!needsRebuild);
+	size_t cellCoords[2];
+	for (size_t axis = 0; axis < 2; ++axis) {
+		// This is written this way to also return for NaN positions.
+		if (!(position[axis] >= 0) || !(position[axis] < containerSize[axis])) {
+			return nullptr;
+		}
+		size_t cell = size_t(position[axis]/cellSize[axis]);
+		// Rounding could put positions at the very end past the last cell.
+		if (cell >= numCells[axis]) {
+			cell = numCells[axis]-1;
+		}
+		cellCoords[axis] = cell;
+	}
+	return &cells[cellCoords[1]*numCells[0] + cellCoords[0]];
+}
+
+UIGridIndex::CellRange UIGridIndex::computeCellRange(const UIBox& child) const {
+	CellRange range;
+	for (size_t axis = 0; axis < 2; ++axis) {
+		const float begin = child.origin[axis];
+		const float end = begin + child.size[axis];
+		if (!(child.size[axis] > 0) || !(end > 0) || !(begin < containerSize[axis])) {
+			// Not in any cells, since no position in the container can be inside it.
+			range.min[0] = 0;
+			range.min[1] = 0;
+			range.max[0] = 0;
+			range.max[1] = 0;
+			return range;
+		}
+		size_t minCell = (begin > 0) ? size_t(begin/cellSize[axis]) : 0;
+		size_t maxCell = size_t(ceilf(end/cellSize[axis]));
+		if (maxCell > numCells[axis]) {
+			maxCell = numCells[axis];
+		}
+		if (minCell >= maxCell) {
+			minCell = maxCell-1;
+		}
+		range.min[axis] = uint32(minCell);
+		range.max[axis] = uint32(maxCell);
+	}
+	return range;
+}
+
+void UIGridIndex::addToCells(uint32 childIndex, const CellRange& range) {
+	for (size_t y = range.min[1]; y < range.max[1]; ++y) {
+		for (size_t x = range.min[0]; x < range.max[0]; ++x) {
+			Array<uint32>& cell = cells[y*numCells[0] + x];
+			// Insert in sorted order, shifting any larger indices up.
+			size_t i = cell.size();
+			cell.setSize(i+1);
+			for (; i > 0 && cell[i-1] > childIndex; --i) {
+				cell[i] = cell[i-1];
+			}
+			cell[i] = childIndex;
+		}
+	}
+}
+
+void UIGridIndex::removeFromCells(uint32 childIndex, const CellRange& range) {
+	for (size_t y = range.min[1]; y < range.max[1]; ++y) {
+		for (size_t x = range.min[0]; x < range.max[0]; ++x) {
+			Array<uint32>& cell = cells[y*numCells[0] + x];
+			// Binary search for childIndex.
+			size_t begin = 0;
+			size_t end = cell.size();
+			while (begin < end) {
+				const size_t mid = (begin + end)/2;
+				if (cell[mid] < childIndex) {
+					begin = mid+1;
+				}
+				else {
+					end = mid;
+				}
+			}
+			assert(begin < cell.size() && cell[begin] == childIndex);
+			if (begin >= cell.size() || cell[begin] != childIndex) {
+				continue;
+			}
+			// Shift any larger indices down.
+			const size_t n = cell.size();
+			for (size_t i = begin+1; i < n; ++i) {
+				cell[i-1] = cell[i];
+			}
+			cell.setSize(n-1);
+		}
+	}
+}
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
@@ -0,0 +1,305 @@
+#include "UILayout.h"
+#include "UIBox.h"
+#include "MainWindow.h"
+
+#include <Vec.h>
+#include <Types.h>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+// Box parents are const, since boxes shouldn't modify their parents,
+// but the layout state of the ancestors must be updated here.
+static UILayoutState& parentLayoutState(const UIContainer* parent) {
+	return const_cast<UIContainer*>(parent)->layoutState;
+}
+
+void markLayoutDirty(UIBox& box) {
+	box.layoutState.flags |= LAYOUT_MEASURE_DIRTY_BIT | LAYOUT_CHILDREN_DIRTY_BIT;
+
+	// The measured size of every ancestor might change, so they all need
+	// to lay out their children again.  If an ancestor is already marked,
+	// its ancestors must be too, so propagation can stop there.
+	constexpr uint32 allBits = LAYOUT_MEASURE_DIRTY_BIT | LAYOUT_CHILDREN_DIRTY_BIT | LAYOUT_DESCENDANT_DIRTY_BIT;
+	for (const UIContainer* parent = box.parent; parent != nullptr; parent = parent->parent) {
+		UILayoutState& state = parentLayoutState(parent);
+		if ((state.flags & allBits) == allBits) {
+			break;
+		}
+		state.flags |= allBits;
+	}
+
+	setNeedRedraw();
+}
+
+void markChildLayoutDirty(UIContainer& container) {
+	container.layoutState.flags |= LAYOUT_CHILDREN_DIRTY_BIT;
+
+	for (const UIContainer* parent = container.parent; parent != nullptr; parent = parent->parent) {
+		UILayoutState& state = parentLayoutState(parent);
+		if (state.flags & LAYOUT_DESCENDANT_DIRTY_BIT) {
+			break;
+		}
+		state.flags |= LAYOUT_DESCENDANT_DIRTY_BIT;
+	}
+
+	setNeedRedraw();
+}
+
+static float clamp(float value, float minValue, float maxValue) {
+	if (value > maxValue) {
+		value = maxValue;
+	}
+	if (value < minValue) {
+		value = minValue;
+	}
+	return value;
+}
+
+Vec2f measureBox(UIBox& box, const Vec2f& availableSize) {
+	UILayoutState& state = box.layoutState;
+	if (!(state.flags & LAYOUT_MEASURE_DIRTY_BIT) && availableSize == state.availableSize) {
+		return state.measuredSize;
+	}
+
+	const UILayoutParams& params = box.layoutParams;
+	Vec2f size = params.preferredSize;
+	if (box.type->isContainer) {
+		auto measure = static_cast<const UIContainerClass*>(box.type)->measure;
+		if (measure != nullptr) {
+			size = measure(static_cast<UIContainer&>(box), availableSize);
+		}
+	}
+	for (size_t axis = 0; axis < 2; ++axis) {
+		size[axis] = clamp(size[axis], params.minSize[axis], params.maxSize[axis]);
+	}
+
+	state.availableSize = availableSize;
+	state.measuredSize = size;
+	state.flags &= ~LAYOUT_MEASURE_DIRTY_BIT;
+	return size;
+}
+
+// Sets the bounds of a child, notifying it and the container's spatial index
+// if they changed.
+static void setChildBounds(UIContainer& container, size_t childIndex, const Vec2f& origin, const Vec2f& size) {
+	UIBox& child = *container.children[childIndex];
+	if (origin == child.origin && size == child.size) {
+		return;
+	}
+	const Vec2f prevOrigin = child.origin;
+	const Vec2f prevSize = child.size;
+	child.origin = origin;
+	child.size = size;
+	if (size != prevSize) {
+		// The child's children only need repositioning if its size changed.
+		child.layoutState.flags |= LAYOUT_CHILDREN_DIRTY_BIT;
+	}
+	container.childBoundsChanged(childIndex);
+	auto onResize = child.type->onResize;
+	if (onResize != nullptr) {
+		onResize(child, prevOrigin, prevSize);
+	}
+}
+
+// Returns the size inside the padding, which is never negative.
+static Vec2f innerSize(const Vec2f& size, const UILayoutSettings& settings) {
+	Vec2f inner;
+	for (size_t axis = 0; axis < 2; ++axis) {
+		inner[axis] = size[axis] - 2*settings.padding[axis];
+		if (!(inner[axis] > 0)) {
+			inner[axis] = 0;
+		}
+	}
+	return inner;
+}
+
+// Returns the width of each column of a GRID container whose inner width is given.
+static float gridColumnWidth(float innerWidth, const UILayoutSettings& settings, size_t numColumns) {
+	const float width = (innerWidth - settings.spacing[0]*(numColumns-1))/numColumns;
+	return (width > 0) ? width : 0;
+}
+
+Vec2f measureContainerChildren(UIContainer& container, const Vec2f& availableSize) {
+	const UILayoutSettings& settings = container.layoutSettings;
+	const Array<std::unique_ptr<UIBox>>& children = container.children;
+	const size_t numChildren = children.size();
+
+	if (settings.kind == UILayoutKind::NONE || numChildren == 0) {
+		// The size doesn't depend on the children.
+		return container.layoutParams.preferredSize;
+	}
+
+	const Vec2f available = innerSize(availableSize, settings);
+	Vec2f size(0,0);
+	if (settings.kind == UILayoutKind::STACK) {
+		const size_t axis = settings.axis;
+		const size_t crossAxis = 1-axis;
+		for (size_t i = 0; i < numChildren; ++i) {
+			const Vec2f childSize = measureBox(*children[i], available);
+			size[axis] += childSize[axis];
+			if (childSize[crossAxis] > size[crossAxis]) {
+				size[crossAxis] = childSize[crossAxis];
+			}
+		}
+		size[axis] += settings.spacing[axis]*(numChildren-1);
+	}
+	else {
+		assert(settings.kind == UILayoutKind::GRID);
+		const size_t numColumns = (settings.numColumns != 0) ? settings.numColumns : 1;
+		const Vec2f childAvailable(gridColumnWidth(available[0], settings, numColumns), available[1]);
+		float maxWidth = 0;
+		size_t numRows = 0;
+		for (size_t rowStart = 0; rowStart < numChildren; rowStart += numColumns, ++numRows) {
+			const size_t rowEnd = (rowStart + numColumns < numChildren) ? (rowStart + numColumns) : numChildren;
+			float rowHeight = 0;
+			for (size_t i = rowStart; i < rowEnd; ++i) {
+				const Vec2f childSize = measureBox(*children[i], childAvailable);
+				if (childSize[0] > maxWidth) {
+					maxWidth = childSize[0];
+				}
+				if (childSize[1] > rowHeight) {
+					rowHeight = childSize[1];
+				}
+			}
+			size[1] += rowHeight;
+		}
+		const size_t usedColumns = (numChildren < numColumns) ? numChildren : numColumns;
+		size[0] = maxWidth*usedColumns + settings.spacing[0]*(usedColumns-1);
+		size[1] += settings.spacing[1]*(numRows-1);
+	}
+
+	for (size_t axis = 0; axis < 2; ++axis) {
+		size[axis] += 2*settings.padding[axis];
+	}
+	return size;
+}
+
+static void layoutStack(UIContainer& container, const Vec2f& inner) {
+	const UILayoutSettings& settings = container.layoutSettings;
+	const Array<std::unique_ptr<UIBox>>& children = container.children;
+	const size_t numChildren = children.size();
+	const size_t axis = settings.axis;
+	const size_t crossAxis = 1-axis;
+
+	// First, find how much space is left for the flexible children.
+	float fixedSize = settings.spacing[axis]*(numChildren-1);
+	float totalWeight = 0;
+	for (size_t i = 0; i < numChildren; ++i) {
+		UIBox& child = *children[i];
+		const float weight = child.layoutParams.flexWeight;
+		if (weight > 0) {
+			totalWeight += weight;
+		}
+		else {
+			fixedSize += measureBox(child, inner)[axis];
+		}
+	}
+	float remaining = inner[axis] - fixedSize;
+	if (!(remaining > 0)) {
+		remaining = 0;
+	}
+
+	// The y axis points up, so vertical stacks start at the top and go down,
+	// and horizontal stacks start at the left and go right.
+	const bool isReversed = (axis == 1);
+	float position = isReversed ? (container.size[axis] - settings.padding[axis]) : settings.padding[axis];
+	for (size_t i = 0; i < numChildren; ++i) {
+		UIBox& child = *children[i];
+		const UILayoutParams& params = child.layoutParams;
+
+		Vec2f size;
+		if (params.flexWeight > 0) {
+			size[axis] = clamp(remaining*(params.flexWeight/totalWeight), params.minSize[axis], params.maxSize[axis]);
+		}
+		else {
+			// This was already measured above, so it's cached.
+			size[axis] = measureBox(child, inner)[axis];
+		}
+		size[crossAxis] = clamp(inner[crossAxis], params.minSize[crossAxis], params.maxSize[crossAxis]);
+
+		Vec2f origin;
+		origin[axis] = isReversed ? (position - size[axis]) : position;
+		origin[crossAxis] = settings.padding[crossAxis];
+
+		setChildBounds(container, i, origin, size);
+		const float step = size[axis] + settings.spacing[axis];
+		position += isReversed ? -step : step;
+	}
+}
+
+static void layoutGrid(UIContainer& container, const Vec2f& inner) {
+	const UILayoutSettings& settings = container.layoutSettings;
+	const Array<std::unique_ptr<UIBox>>& children = container.children;
+	const size_t numChildren = children.size();
+	const size_t numColumns = (settings.numColumns != 0) ? settings.numColumns : 1;
+	const float columnWidth = gridColumnWidth(inner[0], settings, numColumns);
+	const Vec2f childAvailable(columnWidth, inner[1]);
+
+	// The y axis points up, so the first row is at the top.
+	float top = container.size[1] - settings.padding[1];
+	for (size_t rowStart = 0; rowStart < numChildren; rowStart += numColumns) {
+		const size_t rowEnd = (rowStart + numColumns < numChildren) ? (rowStart + numColumns) : numChildren;
+		float rowHeight = 0;
+		for (size_t i = rowStart; i < rowEnd; ++i) {
+			const float height = measureBox(*children[i], childAvailable)[1];
+			if (height > rowHeight) {
+				rowHeight = height;
+			}
+		}
+		for (size_t i = rowStart; i < rowEnd; ++i) {
+			const float x = settings.padding[0] + (i-rowStart)*(columnWidth + settings.spacing[0]);
+			setChildBounds(container, i, Vec2f(x, top - rowHeight), Vec2f(columnWidth, rowHeight));
+		}
+		top -= rowHeight + settings.spacing[1];
+	}
+}
+
+void layoutContainerChildren(UIContainer& container) {
+	const UILayoutSettings& settings = container.layoutSettings;
+	if (settings.kind == UILayoutKind::NONE || container.children.size() == 0) {
+		return;
+	}
+	const Vec2f inner = innerSize(container.size, settings);
+	if (settings.kind == UILayoutKind::STACK) {
+		layoutStack(container, inner);
+	}
+	else {
+		assert(settings.kind == UILayoutKind::GRID);
+		layoutGrid(container, inner);
+	}
+}
+
+void updateLayout(UIBox& box) {
+	UILayoutState& state = box.layoutState;
+	const uint32 flags = state.flags;
+	state.flags &= ~(LAYOUT_CHILDREN_DIRTY_BIT | LAYOUT_DESCENDANT_DIRTY_BIT);
+	if (!box.type->isContainer) {
+		return;
+	}
+	UIContainer& container = static_cast<UIContainer&>(box);
+
+	bool visitChildren = (flags & LAYOUT_DESCENDANT_DIRTY_BIT) != 0;
+	if (flags & LAYOUT_CHILDREN_DIRTY_BIT) {
+		auto layout = static_cast<const UIContainerClass*>(box.type)->layout;
+		if (layout != nullptr) {
+			layout(container);
+			// Any children whose size changed were marked.
+			visitChildren = true;
+		}
+	}
+	if (!visitChildren) {
+		return;
+	}
+
+	const Array<std::unique_ptr<UIBox>>& children = container.children;
+	for (size_t i = 0, n = children.size(); i < n; ++i) {
+		UIBox& child = *children[i];
+		if (child.layoutState.flags & (LAYOUT_CHILDREN_DIRTY_BIT | LAYOUT_DESCENDANT_DIRTY_BIT)) {
+			updateLayout(child);
+		}
+	}
+}
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
@@ -7,15 +7,95 @@
 #include <Types.h>
 #include <text/TextFunctions.h>
 
+#include <string.h>
+
 OUTER_NAMESPACE_BEGIN
 UICOMMON_LIBRARY_NAMESPACE_BEGIN
 
-void LineArray::getText(const Position& begin, const Position& end, Array<char>& text) const {
+LineArray::LineArray() : LineArray(&staticType) {
+	// There's always at least one line.
+	lines.setSize(1);
+	lineOffsets.append(1);
+}
+
+void LineArray::destruct(LineArray* lineArray) {
+	lineArray->lines.setCapacity(0);
+	lineArray->lineOffsets.clear();
+	// The lines no longer borrow from the file or the arena.
+	unmapFile(lineArray->mappedFile);
+	lineArray->textArena.clear();
+	lineArray->numDeadArenaBytes = 0;
+}
+
+size_t LineArray::getNumLinesImpl(const LineArray& lineArray) {
+	return lineArray.lines.size();
+}
+
+size_t LineArray::getLineSizeImpl(const LineArray& lineArray, size_t line) {
+	return lineArray.lines[line].size();
+}
+
+size_t LineArray::getTotalSizeImpl(const LineArray& lineArray) {
+	// The last line doesn't have a line break.
+	return lineArray.lineOffsets.total() - 1;
+}
+
+size_t LineArray::positionToOffsetImpl(const LineArray& lineArray, const Position& position) {
+	assert(position.line < lineArray.lines.size());
+	return lineArray.lineOffsets.prefixSum(position.line) + position.col;
+}
+
+LineArray::Position LineArray::offsetToPositionImpl(const LineArray& lineArray, size_t offset) {
+	assert(offset <= getTotalSizeImpl(lineArray));
+	const size_t line = lineArray.lineOffsets.findIndex(offset);
+	return Position{line, offset - lineArray.lineOffsets.prefixSum(line)};
+}
+
+void LineArray::updateLineOffsets(size_t firstLine, size_t numChangedLines, size_t numOldLines) {
+	const size_t numLines = lines.size();
+	if (numLines == numOldLines) {
+		for (size_t line = firstLine; line < firstLine + numChangedLines; ++line) {
+			const size_t value = lines[line].size() + 1;
+			lineOffsets.add(line, value - lineOffsets.get(line));
+		}
+		return;
+	}
+	// Lines were inserted or removed, so every later line moved to a different
+	// index.  The lines were already all moved, so this is O(n) too.
+	Array<size_t> values;
+	values.setSize(numLines - firstLine);
+	for (size_t line = firstLine; line < numLines; ++line) {
+		values[line - firstLine] = lines[line].size() + 1;
+	}
+	lineOffsets.replaceFrom(firstLine, values.data(), values.size());
+}
+
+LineArrayClass LineArray::initClass() {
+	LineArrayClass c;
+	c.typeName = "LineArray";
+	c.destruct = &destruct;
+	c.getNumLines = &getNumLinesImpl;
+	c.getLineSize = &getLineSizeImpl;
+	c.getTotalSize = &getTotalSizeImpl;
+	c.positionToOffset = &positionToOffsetImpl;
+	c.offsetToPosition = &offsetToPositionImpl;
+	c.getText = &getTextImpl;
+	c.visitText = &visitTextImpl;
+	c.replace = &replaceImpl;
+	c.replaceMany = &replaceManyImpl;
+	c.setText = &setTextImpl;
+	c.setMappedText = &setMappedTextImpl;
+	return c;
+}
+
+const LineArrayClass LineArray::staticType(LineArray::initClass());
+
+void LineArray::getTextImpl(const LineArray& lineArray, const Position& begin, const Position& end, Array<char>& text) {
+	const BufArray<TextLine, 1>& lines = lineArray.lines;
 	if (end.line == begin.line) {
 		// Single line, possibly partial
 		if (end.col > begin.col) {
-			const Array<char>& line = lines[begin.line];
-			text.append(line.data()+begin.col, line.data()+end.col);
+			lines[begin.line].appendTo(text, begin.col, end.col);
 		}
 	}
 	else if (end.line > begin.line) {
@@ -23,42 +103,139 @@ void LineArray::getText(const Position& begin, const Position& end, Array<char>&
 		size_t linei = begin.line;
 		if (begin.col > 0) {
 			// First partial line
-			const Array<char>& line = lines[begin.line];
-			text.append(line.data()+begin.col, line.end());
+			const TextLine& line = lines[begin.line];
+			line.appendTo(text, begin.col, line.size());
 			text.append('\n');
 			++linei;
 		}
 		// Middle full lines
 		for (; linei < end.line; ++linei) {
-			const Array<char>& line = lines[begin.line];
-			text.append(line.begin(), line.end());
+			lines[linei].appendTo(text);
 			text.append('\n');
 		}
 		if (end.col > 0) {
 			// Final partial line
-			const Array<char>& line = lines[end.line];
-			text.append(line.begin(), line.data()+end.col);
+			lines[end.line].appendTo(text, 0, end.col);
 		}
 	}
 }
 
-void LineArray::replace(
+// Line breaks aren't stored, so visitText passes this between lines.
+static const char LINE_BREAK = '\n';
+
+bool LineArray::visitTextImpl(
+	const LineArray& lineArray,
+	const Position& begin,
+	const Position& end,
+	TextVisitor visitor,
+	void* data
+) {
+	const BufArray<TextLine, 1>& lines = lineArray.lines;
+	if (end.line == begin.line) {
+		return (end.col <= begin.col) || lines[begin.line].visit(begin.col, end.col, visitor, data);
+	}
+	if (end.line < begin.line) {
+		return true;
+	}
+	const TextLine& firstLine = lines[begin.line];
+	if (!firstLine.visit(begin.col, firstLine.size(), visitor, data) || !visitor(&LINE_BREAK, 1, data)) {
+		return false;
+	}
+	for (size_t line = begin.line+1; line < end.line; ++line) {
+		if (!lines[line].visit(0, lines[line].size(), visitor, data) || !visitor(&LINE_BREAK, 1, data)) {
+			return false;
+		}
+	}
+	return lines[end.line].visit(0, end.col, visitor, data);
+}
+
+LineArray::Position LineArray::findTextEnd(
+	const Position& begin,
+	const char* textBegin,
+	const char* textEnd
+) {
+	// The end is after the last line break in the text, if any.
+	size_t numLineBreaks = 0;
+	const char* lastLineBegin = textBegin;
+	for (const char* text = textBegin; text != textEnd; ++text) {
+		if (*text == '\n') {
+			++numLineBreaks;
+			lastLineBegin = text+1;
+		}
+	}
+	const size_t lastLineSize = textEnd - lastLineBegin;
+	if (numLineBreaks == 0) {
+		return Position{begin.line, begin.col + lastLineSize};
+	}
+	return Position{begin.line + numLineBreaks, lastLineSize};
+}
+
+void LineArray::setUndoEventEnd(
+	TextReplacementEvent& undoEvent,
+	const Position& begin,
+	const char* newTextBegin,
+	const char* newTextEnd
+) {
+	undoEvent.end = findTextEnd(begin, newTextBegin, newTextEnd);
+}
+
+void LineArray::prepareBatchUndoEvent(
+	const LineArray& lineArray,
+	const Replacement* replacements,
+	size_t numReplacements,
+	TextBatchReplacementEvent& undoEvent
+) {
+	undoEvent.lineArray = const_cast<LineArray*>(&lineArray);
+	undoEvent.ranges.setSize(numReplacements);
+	undoEvent.previousText.setSize(0);
+
+	// The text between replacements isn't changed, but it moves by the
+	// change from the old end of the previous replacement to its new end.
+	Position oldEnd{0, 0};
+	Position newEnd{0, 0};
+	for (size_t i = 0; i < numReplacements; ++i) {
+		const Replacement& replacement = replacements[i];
+		assert(i == 0 || replacement.begin.line > oldEnd.line || (replacement.begin.line == oldEnd.line && replacement.begin.col >= oldEnd.col));
+		lineArray.getText(replacement.begin, replacement.end, undoEvent.previousText);
+
+		TextBatchReplacementEvent::Range& range = undoEvent.ranges[i];
+		if (replacement.begin.line == oldEnd.line) {
+			range.begin = Position{newEnd.line, newEnd.col + (replacement.begin.col - oldEnd.col)};
+		}
+		else {
+			range.begin = Position{replacement.begin.line + (newEnd.line - oldEnd.line), replacement.begin.col};
+		}
+		range.end = findTextEnd(range.begin, replacement.newTextBegin, replacement.newTextEnd);
+		range.previousTextEnd = undoEvent.previousText.size();
+
+		oldEnd = replacement.end;
+		newEnd = range.end;
+	}
+}
+
+void LineArray::replaceImpl(
+	LineArray& lineArray,
 	const Position& begin,
 	const Position& end,
 	const char* newTextBegin,
 	const char* newTextEnd,
 	TextReplacementEvent* undoEvent
 ) {
+	BufArray<TextLine, 1>& lines = lineArray.lines;
 	if (undoEvent != nullptr) {
 		// Save the previous text before replacing it, so that it can be undone.
-		undoEvent->lineArray = this;
+		undoEvent->lineArray = &lineArray;
 		undoEvent->previousText.setSize(0);
-		getText(begin, end, undoEvent->previousText);
+		getTextImpl(lineArray, begin, end, undoEvent->previousText);
 		undoEvent->begin = begin;
 		// End must be set below.
 	}
 
-	Array<char>* currentLine = &lines[begin.line];
+	// All of the lines in the range are about to be edited or removed.
+	lineArray.releaseArenaLines(begin.line, end.line + 1);
+
+	TextLine* currentLine = &lines[begin.line];
+	const size_t numOldLines = lines.size();
 
 	// Split new text into lines, keeping empty lines.
 	BufArray<Span<size_t>, 8> newTextLines;
@@ -74,6 +251,8 @@ void LineArray::replace(
 		if (numOriginalLines == 1) {
 			// Editing a single line, so can just use replaceSingleHelper.
 			const size_t newEndCol = replaceSingleHelper(lines[begin.line], begin.col, end.col, newTextBegin, newTextEnd);
+			lineArray.updateLineOffsets(begin.line, 1, numOldLines);
+			lineArray.compactTextArena();
 			if (undoEvent != nullptr) {
 				undoEvent->end = Position{end.line, newEndCol};
 			}
@@ -82,7 +261,7 @@ void LineArray::replace(
 
 		// Don't need to keep the end of currentLine, so can just truncate and append.
 		assert(begin.col <= currentLine->size());
-		currentLine->setSize(begin.col);
+		currentLine->truncate(begin.col);
 		currentLine->append(newTextBegin, newTextEnd);
 		if (undoEvent != nullptr) {
 			const size_t newEndCol = begin.col + (newTextEnd - newTextBegin);
@@ -90,32 +269,36 @@ void LineArray::replace(
 		}
 
 		// Append the end of the line at the end of the caret, if it's not empty.
-		Array<char>& caretEndLine = lines[end.line];
-		if (end.col < caretEndLine.size()) {
-			currentLine->append(caretEndLine.data()+end.col, caretEndLine.end());
+		TextLine& caretEndLine = lines[end.line];
+		const size_t caretEndLineSize = caretEndLine.size();
+		if (end.col < caretEndLineSize) {
+			const char* caretEndText = caretEndLine.data();
+			currentLine->append(caretEndText+end.col, caretEndText+caretEndLineSize);
 		}
 
 		// Remove lines after begin.line, up to and including end.line
 		size_t desti = begin.line + 1;
-		for (size_t srci = end.line, numLines = lines.size(); srci < numLines; ++srci, ++desti) {
+		for (size_t srci = end.line + 1, numLines = lines.size(); srci < numLines; ++srci, ++desti) {
 			lines[desti] = std::move(lines[srci]);
 		}
 		lines.setSize(desti);
+		lineArray.updateLineOffsets(begin.line, 1, numOldLines);
+		lineArray.compactTextArena();
 		return;
 	}
 
 	// Multiple lines in new text.
 
 	Array<char> endOfCaretEndLine;
-	Array<char>* caretEndLine = &lines[end.line];
-	if (end.col < caretEndLine->size()) {
+	const TextLine& caretEndLine = lines[end.line];
+	if (end.col < caretEndLine.size()) {
 		// Need to save the last part of the line, since it may be overwritten.
-		endOfCaretEndLine.append(caretEndLine->data()+end.col, caretEndLine->end());
+		caretEndLine.appendTo(endOfCaretEndLine, end.col, caretEndLine.size());
 	}
 
 	// Already save the end of currentLine if needed, so can just truncate and append.
 	assert(begin.col <= currentLine->size());
-	currentLine->setSize(begin.col);
+	currentLine->truncate(begin.col);
 	currentLine->append(newTextBegin, newTextBegin + newTextLines[0][1]);
 
 	// Shift lines if needed.
@@ -140,16 +323,16 @@ void LineArray::replace(
 	// Deal with full lines in middle
 	currentLine = &lines[begin.line + 1];
 	for (size_t newTexti = 1; newTexti < numNewLines-1; ++newTexti, ++currentLine) {
-		currentLine->setSize(0);
-		currentLine->append(newTextBegin + newTextLines[newTexti][0], newTextBegin + newTextLines[newTexti][1]);
+		currentLine->assign(newTextBegin + newTextLines[newTexti][0], newTextBegin + newTextLines[newTexti][1]);
 	}
 
 	// Handle partial last line
-	currentLine->setSize(0);
-	currentLine->append(newTextBegin + newTextLines.last()[0], newTextBegin + newTextLines.last()[1]);
+	currentLine->assign(newTextBegin + newTextLines.last()[0], newTextBegin + newTextLines.last()[1]);
 	if (endOfCaretEndLine.size() != 0) {
 		currentLine->append(endOfCaretEndLine.begin(), endOfCaretEndLine.end());
 	}
+	lineArray.updateLineOffsets(begin.line, numNewLines, numOldLines);
+	lineArray.compactTextArena();
 
 	if (undoEvent != nullptr) {
 		const size_t newEndCol = newTextLines.last()[1];
@@ -157,8 +340,210 @@ void LineArray::replace(
 	}
 }
 
+// Appends the text of source from beginCol to endCol to dest.
+static void appendLineText(TextLine& dest, TextLine& source, size_t beginCol, size_t endCol) {
+	if (endCol > beginCol) {
+		const char* text = source.data();
+		dest.append(text + beginCol, text + endCol);
+	}
+}
+
+void LineArray::replaceManyImpl(
+	LineArray& lineArray,
+	const Replacement* replacements,
+	size_t numReplacements,
+	TextBatchReplacementEvent* undoEvent
+) {
+	if (undoEvent != nullptr) {
+		prepareBatchUndoEvent(lineArray, replacements, numReplacements, *undoEvent);
+	}
+	if (numReplacements == 0) {
+		return;
+	}
+
+	// All of the lines in the ranges are about to be edited or removed.
+	// Multiple ranges can be on the same line, so only release each line once.
+	size_t nextLineToRelease = 0;
+	for (size_t i = 0; i < numReplacements; ++i) {
+		const Replacement& replacement = replacements[i];
+		const size_t beginLine = (replacement.begin.line > nextLineToRelease) ? replacement.begin.line : nextLineToRelease;
+		if (replacement.end.line >= beginLine) {
+			lineArray.releaseArenaLines(beginLine, replacement.end.line + 1);
+			nextLineToRelease = replacement.end.line + 1;
+		}
+	}
+
+	// Build the new lines in one pass, instead of shifting all of the later
+	// lines for each replacement.  Unchanged lines are just moved.
+	BufArray<TextLine, 1>& lines = lineArray.lines;
+	const size_t numOldLines = lines.size();
+	Array<TextLine> newLines;
+	newLines.setCapacity(numOldLines);
+	TextLine currentLine;
+	Position source{0, 0};
+	for (size_t i = 0; i < numReplacements; ++i) {
+		const Replacement& replacement = replacements[i];
+		const Position& begin = replacement.begin;
+
+		// Copy the unchanged text up to the beginning of the replacement.
+		if (begin.line == source.line) {
+			appendLineText(currentLine, lines[source.line], source.col, begin.col);
+		}
+		else {
+			TextLine& sourceLine = lines[source.line];
+			appendLineText(currentLine, sourceLine, source.col, sourceLine.size());
+			newLines.append(std::move(currentLine));
+			for (size_t line = source.line + 1; line < begin.line; ++line) {
+				newLines.append(std::move(lines[line]));
+			}
+			if (replacement.end.line != begin.line) {
+				// The rest of the line isn't needed, so keep its buffer.
+				currentLine = std::move(lines[begin.line]);
+				currentLine.truncate(begin.col);
+			}
+			else {
+				appendLineText(currentLine, lines[begin.line], 0, begin.col);
+			}
+		}
+
+		// Add the new text, starting a new line after each line break.
+		const char* text = replacement.newTextBegin;
+		const char* const textEnd = replacement.newTextEnd;
+		while (true) {
+			const char* lineBreak = (text != textEnd) ? (const char*)memchr(text, '\n', textEnd - text) : nullptr;
+			if (lineBreak == nullptr) {
+				currentLine.append(text, textEnd);
+				break;
+			}
+			currentLine.append(text, lineBreak);
+			newLines.append(std::move(currentLine));
+			text = lineBreak + 1;
+		}
+		source = replacement.end;
+	}
+	// Copy the unchanged text after the last replacement.
+	TextLine& sourceLine = lines[source.line];
+	appendLineText(currentLine, sourceLine, source.col, sourceLine.size());
+	newLines.append(std::move(currentLine));
+	for (size_t line = source.line + 1; line < numOldLines; ++line) {
+		newLines.append(std::move(lines[line]));
+	}
+
+	const size_t numNewLines = newLines.size();
+	lines.setSize(numNewLines);
+	Array<size_t> lineOffsetValues;
+	lineOffsetValues.setSize(numNewLines);
+	for (size_t line = 0; line < numNewLines; ++line) {
+		lines[line] = std::move(newLines[line]);
+		lineOffsetValues[line] = lines[line].size() + 1;
+	}
+	lineArray.lineOffsets.build(lineOffsetValues.data(), numNewLines);
+	lineArray.compactTextArena();
+}
+
+void LineArray::setLines(
+	const char* text,
+	size_t size,
+	const size_t* lineBreaks,
+	size_t numLineBreaks,
+	size_t lineBreakSize,
+	bool borrow
+) {
+	const size_t numLines = numLineBreaks + 1;
+
+	// Free the old lines first, to reduce peak memory use.  No lines
+	// borrow from the arena after this.
+	lines.setCapacity(0);
+	lines.setSize(numLines);
+	textArena.clear();
+	numDeadArenaBytes = 0;
+
+	// Short lines are stored inline, and the text of long lines is either
+	// borrowed from text, or copied into the arena, so there's no
+	// allocation per line.
+	Array<size_t> lineOffsetValues;
+	lineOffsetValues.setSize(numLines);
+	size_t lineBegin = 0;
+	for (size_t i = 0; i < numLines; ++i) {
+		const bool isLastLine = (i == numLineBreaks);
+		assert(isLastLine || lineBreaks[i] + 1 >= lineBegin + lineBreakSize);
+		const size_t lineEnd = isLastLine ? size : (lineBreaks[i] + 1 - lineBreakSize);
+		const size_t lineSize = lineEnd - lineBegin;
+		const char* lineText = text + lineBegin;
+		if (!borrow && lineSize > TextLine::INLINE_CAPACITY) {
+			char* arenaText = textArena.allocate(lineSize);
+			memcpy(arenaText, lineText, lineSize);
+			lineText = arenaText;
+		}
+		lines[i].borrow(lineText, lineText + lineSize);
+		lineOffsetValues[i] = lineSize + 1;
+		lineBegin = lineEnd + lineBreakSize;
+	}
+	lineOffsets.build(lineOffsetValues.data(), numLines);
+}
+
+void LineArray::releaseArenaLines(size_t beginLine, size_t endLine) {
+	if (textArena.size() == 0) {
+		return;
+	}
+	for (size_t line = beginLine; line < endLine; ++line) {
+		if (lines[line].isBorrowed()) {
+			numDeadArenaBytes += lines[line].size();
+		}
+	}
+}
+
+// Compacting takes time proportional to the number of lines, so only do it
+// once a lot of memory can be freed.
+constexpr static size_t MIN_ARENA_BYTES_TO_FREE = 4*TextArena::CHUNK_SIZE;
+
+void LineArray::compactTextArena() {
+	const size_t arenaSize = textArena.size();
+	if (numDeadArenaBytes < MIN_ARENA_BYTES_TO_FREE || 2*numDeadArenaBytes < arenaSize) {
+		return;
+	}
+	TextArena newArena;
+	for (TextLine& line : lines) {
+		if (line.isBorrowed()) {
+			const size_t lineSize = line.size();
+			char* arenaText = newArena.allocate(lineSize);
+			memcpy(arenaText, line.data(), lineSize);
+			line.borrow(arenaText, arenaText + lineSize);
+		}
+	}
+	textArena.swap(newArena);
+	numDeadArenaBytes = 0;
+}
+
+void LineArray::setTextImpl(
+	LineArray& lineArray,
+	const char* text,
+	size_t size,
+	const size_t* lineBreaks,
+	size_t numLineBreaks,
+	size_t lineBreakSize
+) {
+	lineArray.setLines(text, size, lineBreaks, numLineBreaks, lineBreakSize, false);
+	// No lines borrow from the previous file anymore.
+	unmapFile(lineArray.mappedFile);
+}
+
+void LineArray::setMappedTextImpl(
+	LineArray& lineArray,
+	MappedFile& file,
+	const size_t* lineBreaks,
+	size_t numLineBreaks,
+	size_t lineBreakSize
+) {
+	lineArray.setLines(file.data, file.size, lineBreaks, numLineBreaks, lineBreakSize, true);
+	// No lines borrow from the previous file anymore.
+	unmapFile(lineArray.mappedFile);
+	lineArray.mappedFile = file;
+	file = MappedFile();
+}
+
 size_t LineArray::replaceSingleHelper(
-	Array<char>& line,
+	TextLine& line,
 	size_t beginCol,
 	size_t endCol,
 	const char* beginText,
@@ -167,36 +552,47 @@ size_t LineArray::replaceSingleHelper(
 	assert(beginCol <= endCol);
 	assert(endCol <= line.size());
 	assert(beginText <= endText);
-	const size_t newTextLength = endText-beginText;
-	const size_t oldTextLength = endCol-beginCol;
-	if (newTextLength > oldTextLength) {
-		const size_t diff = newTextLength - oldTextLength;
-		const size_t oldSize = line.size();
-		line.setSize(oldSize + diff);
-		// Shift text forward.
-		for (size_t i = oldSize; i > endCol; ) {
-			--i;
-			line[i + diff] = line[i];
-		}
-	}
-	else if (oldTextLength > newTextLength) {
-		const size_t diff = oldTextLength - newTextLength;
-		const size_t oldSize = line.size();
-		// Shift text backward.
-		for (size_t i = endCol; i < oldSize; ++i) {
-			line[i - diff] = line[i];
-		}
-		line.setSize(oldSize - diff);
-	}
+	// The gap buffer only moves the text between the previous edit and
+	// this one, so typing is amortized O(1), regardless of the line length.
+	return line.replace(beginCol, endCol, beginText, endText);
+}
+
+const UndoEventClass TextBatchReplacementEvent::staticType(TextBatchReplacementEvent::initClass());
+
+UndoEventClass TextBatchReplacementEvent::initClass() {
+	UndoEventClass c;
+	c.typeName = "TextBatchReplacementEvent";
+	c.construct = &construct;
+	c.destruct = &destruct;
+	c.undo = &undo;
+	c.getDescription = &getDescription;
+	return c;
+}
+
+std::unique_ptr<UndoEvent> TextBatchReplacementEvent::undo(std::unique_ptr<UndoEvent>&& original) {
+	assert(original);
+	assert(original->type == &staticType);
+	TextBatchReplacementEvent& event = static_cast<TextBatchReplacementEvent&>(*original);
 
-	// Copy text into place.
-	size_t i = beginCol;
-	for (const char* text = beginText; text != endText; ++text, ++i) {
-		line[i] = *text;
+	// Replace the new text of each range with its previous text,
+	// which fills in the inverse.
+	const size_t numRanges = event.ranges.size();
+	Array<LineArray::Replacement> replacements;
+	replacements.setSize(numRanges);
+	const char* previousText = event.previousText.data();
+	size_t previousTextBegin = 0;
+	for (size_t i = 0; i < numRanges; ++i) {
+		const Range& range = event.ranges[i];
+		replacements[i] = LineArray::Replacement{range.begin, range.end, previousText + previousTextBegin, previousText + range.previousTextEnd};
+		previousTextBegin = range.previousTextEnd;
 	}
+	TextBatchReplacementEvent inverse;
+	event.lineArray->replaceMany(replacements.data(), numRanges, &inverse);
 
-	// Return index at end of new text.
-	return i;
+	// Return the same UndoEvent as the inverse.
+	event.ranges = std::move(inverse.ranges);
+	event.previousText = std::move(inverse.previousText);
+	return std::move(original);
 }
 
 UICOMMON_LIBRARY_NAMESPACE_END
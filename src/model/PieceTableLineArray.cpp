@@ -0,0 +1,480 @@
+#include "model/PieceTableLineArray.h"
+#include "TextScanning.h"
+
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Types.h>
+
+#include <string.h>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+// Returns the index of the first value in the sorted array that is at least value.
+static size_t lowerBound(const Array<size_t>& values, size_t value) {
+	size_t begin = 0;
+	size_t end = values.size();
+	while (begin < end) {
+		const size_t mid = begin + (end-begin)/2;
+		if (values[mid] < value) {
+			begin = mid+1;
+		}
+		else {
+			end = mid;
+		}
+	}
+	return begin;
+}
+
+PieceTableLineArray::PieceTableLineArray() : LineArray(&staticType), root(NO_NODE), randomState(0x9E3779B9) {}
+
+PieceTableLineArray::PieceTableLineArray(const char* textBegin, const char* textEnd) : PieceTableLineArray() {
+	const size_t size = textEnd - textBegin;
+	if (size == 0) {
+		return;
+	}
+	Buffer& original = buffers[ORIGINAL_BUFFER];
+	original.text.setSize(size);
+	memcpy(original.text.data(), textBegin, size);
+	findLineBreaksInRange(original.text.data(), 0, size, original.lineBreaks);
+	root = newNode(ORIGINAL_BUFFER, 0, size);
+}
+
+size_t PieceTableLineArray::countLineBreaks(uint32 buffer, size_t begin, size_t end) const {
+	const Array<size_t>& lineBreaks = buffers[buffer].lineBreaks;
+	return lowerBound(lineBreaks, end) - lowerBound(lineBreaks, begin);
+}
+
+uint32 PieceTableLineArray::newNode(uint32 buffer, size_t start, size_t length) {
+	uint32 index;
+	if (freeNodes.size() != 0) {
+		index = freeNodes.last();
+		freeNodes.setSize(freeNodes.size()-1);
+	}
+	else {
+		index = uint32(nodes.size());
+		nodes.setSize(nodes.size()+1);
+	}
+
+	// xorshift32, which is plenty random for balancing.
+	uint32 random = randomState;
+	random ^= random << 13;
+	random ^= random >> 17;
+	random ^= random << 5;
+	randomState = random;
+
+	Node& node = nodes[index];
+	node.buffer = buffer;
+	node.start = start;
+	node.length = length;
+	node.numLineBreaks = countLineBreaks(buffer, start, start + length);
+	node.left = NO_NODE;
+	node.right = NO_NODE;
+	node.priority = random;
+	node.totalSize = length;
+	node.totalLineBreaks = node.numLineBreaks;
+	return index;
+}
+
+void PieceTableLineArray::freeSubtree(uint32 node) {
+	if (node == NO_NODE) {
+		return;
+	}
+	freeSubtree(nodes[node].left);
+	freeSubtree(nodes[node].right);
+	freeNodes.append(node);
+}
+
+void PieceTableLineArray::updateTotals(uint32 index) {
+	Node& node = nodes[index];
+	node.totalSize = subtreeSize(node.left) + node.length + subtreeSize(node.right);
+	node.totalLineBreaks = subtreeLineBreaks(node.left) + node.numLineBreaks + subtreeLineBreaks(node.right);
+}
+
+void PieceTableLineArray::split(uint32 index, size_t offset, uint32& left, uint32& right) {
+	if (index == NO_NODE) {
+		left = NO_NODE;
+		right = NO_NODE;
+		return;
+	}
+	const size_t leftSize = subtreeSize(nodes[index].left);
+	const size_t length = nodes[index].length;
+	// NOTE: split may reallocate nodes when splitting a piece, so references
+	// to nodes can't be passed to it.
+	if (offset <= leftSize) {
+		uint32 leftOfLeft;
+		uint32 rightOfLeft;
+		split(nodes[index].left, offset, leftOfLeft, rightOfLeft);
+		nodes[index].left = rightOfLeft;
+		updateTotals(index);
+		left = leftOfLeft;
+		right = index;
+		return;
+	}
+	if (offset >= leftSize + length) {
+		uint32 leftOfRight;
+		uint32 rightOfRight;
+		split(nodes[index].right, offset - leftSize - length, leftOfRight, rightOfRight);
+		nodes[index].right = leftOfRight;
+		updateTotals(index);
+		left = index;
+		right = rightOfRight;
+		return;
+	}
+
+	// offset is inside this piece, so split the piece into two nodes.
+	// NOTE: newNode may reallocate nodes, so no references are kept across it.
+	const size_t pieceOffset = offset - leftSize;
+	const uint32 suffix = newNode(nodes[index].buffer, nodes[index].start + pieceOffset, length - pieceOffset);
+	Node& node = nodes[index];
+	node.length = pieceOffset;
+	node.numLineBreaks -= nodes[suffix].numLineBreaks;
+	// The suffix takes the place of this node in the right tree, so it gets
+	// the same priority, so that it's still no higher than the priority of
+	// the ancestors that the right tree is attached to, and no lower than
+	// the priorities in the right subtree, so that can be its right child.
+	nodes[suffix].priority = node.priority;
+	nodes[suffix].right = node.right;
+	node.right = NO_NODE;
+	updateTotals(index);
+	updateTotals(suffix);
+	left = index;
+	right = suffix;
+}
+
+uint32 PieceTableLineArray::merge(uint32 left, uint32 right) {
+	if (left == NO_NODE) {
+		return right;
+	}
+	if (right == NO_NODE) {
+		return left;
+	}
+	if (nodes[left].priority > nodes[right].priority) {
+		const uint32 merged = merge(nodes[left].right, right);
+		nodes[left].right = merged;
+		updateTotals(left);
+		return left;
+	}
+	const uint32 merged = merge(left, nodes[right].left);
+	nodes[right].left = merged;
+	updateTotals(right);
+	return right;
+}
+
+size_t PieceTableLineArray::lineBeginOffset(size_t line) const {
+	if (line == 0) {
+		return 0;
+	}
+	assert(line <= subtreeLineBreaks(root));
+
+	// Find the line break before the line, i.e. line break number "line",
+	// counting from 1.
+	size_t remaining = line;
+	size_t offset = 0;
+	uint32 index = root;
+	while (index != NO_NODE) {
+		const Node& node = nodes[index];
+		const size_t leftLineBreaks = subtreeLineBreaks(node.left);
+		if (remaining <= leftLineBreaks) {
+			index = node.left;
+			continue;
+		}
+		remaining -= leftLineBreaks;
+		offset += subtreeSize(node.left);
+		if (remaining <= node.numLineBreaks) {
+			const Array<size_t>& lineBreaks = buffers[node.buffer].lineBreaks;
+			const size_t lineBreak = lineBreaks[lowerBound(lineBreaks, node.start) + remaining - 1];
+			return offset + (lineBreak - node.start) + 1;
+		}
+		remaining -= node.numLineBreaks;
+		offset += node.length;
+		index = node.right;
+	}
+	assert(0);
+	return offset;
+}
+
+size_t PieceTableLineArray::findOffset(const Position& position) const {
+	assert(position.line < getNumLinesImpl(*this));
+	const size_t offset = lineBeginOffset(position.line) + position.col;
+	assert(offset <= subtreeSize(root));
+	return offset;
+}
+
+LineArray::Position PieceTableLineArray::findPosition(size_t offset) const {
+	assert(offset <= subtreeSize(root));
+
+	// Count the line breaks before offset.
+	size_t line = 0;
+	size_t remaining = offset;
+	uint32 index = root;
+	while (index != NO_NODE) {
+		const Node& node = nodes[index];
+		const size_t leftSize = subtreeSize(node.left);
+		if (remaining < leftSize) {
+			index = node.left;
+			continue;
+		}
+		line += subtreeLineBreaks(node.left);
+		remaining -= leftSize;
+		if (remaining < node.length) {
+			line += countLineBreaks(node.buffer, node.start, node.start + remaining);
+			break;
+		}
+		line += node.numLineBreaks;
+		remaining -= node.length;
+		index = node.right;
+	}
+	return Position{line, offset - lineBeginOffset(line)};
+}
+
+void PieceTableLineArray::appendText(uint32 index, size_t nodeOffset, size_t begin, size_t end, Array<char>& text) const {
+	// Skip subtrees entirely outside of the range, so this only visits
+	// O(log n) nodes plus the nodes in the range.
+	if (index == NO_NODE || end <= nodeOffset || begin >= nodeOffset + nodes[index].totalSize) {
+		return;
+	}
+	const Node& node = nodes[index];
+	appendText(node.left, nodeOffset, begin, end, text);
+	const size_t pieceOffset = nodeOffset + subtreeSize(node.left);
+	if (end <= pieceOffset) {
+		return;
+	}
+	const size_t pieceBegin = (begin > pieceOffset) ? (begin - pieceOffset) : 0;
+	const size_t pieceEnd = (end < pieceOffset + node.length) ? (end - pieceOffset) : node.length;
+	if (pieceBegin < pieceEnd) {
+		const char* pieceText = buffers[node.buffer].text.data() + node.start;
+		text.append(pieceText + pieceBegin, pieceText + pieceEnd);
+	}
+	appendText(node.right, pieceOffset + node.length, begin, end, text);
+}
+
+bool PieceTableLineArray::visitPieces(uint32 index, size_t nodeOffset, size_t begin, size_t end, TextVisitor visitor, void* data) const {
+	if (index == NO_NODE || end <= nodeOffset || begin >= nodeOffset + nodes[index].totalSize) {
+		return true;
+	}
+	const Node& node = nodes[index];
+	if (!visitPieces(node.left, nodeOffset, begin, end, visitor, data)) {
+		return false;
+	}
+	const size_t pieceOffset = nodeOffset + subtreeSize(node.left);
+	if (end <= pieceOffset) {
+		return true;
+	}
+	const size_t pieceBegin = (begin > pieceOffset) ? (begin - pieceOffset) : 0;
+	const size_t pieceEnd = (end < pieceOffset + node.length) ? (end - pieceOffset) : node.length;
+	if (pieceBegin < pieceEnd) {
+		// Each piece is contiguous in its buffer, so it can be passed directly.
+		const char* pieceText = buffers[node.buffer].text.data() + node.start;
+		if (!visitor(pieceText + pieceBegin, pieceEnd - pieceBegin, data)) {
+			return false;
+		}
+	}
+	return visitPieces(node.right, pieceOffset + node.length, begin, end, visitor, data);
+}
+
+size_t PieceTableLineArray::appendToAddedBuffer(const char* textBegin, const char* textEnd) {
+	Buffer& added = buffers[ADDED_BUFFER];
+	const size_t start = added.text.size();
+	const size_t size = textEnd - textBegin;
+	added.text.setSize(start + size);
+	memcpy(added.text.data() + start, textBegin, size);
+	findLineBreaksInRange(added.text.data(), start, start + size, added.lineBreaks);
+	return start;
+}
+
+void PieceTableLineArray::destruct(LineArray* lineArray) {
+	PieceTableLineArray* pieceTable = static_cast<PieceTableLineArray*>(lineArray);
+	for (Buffer& buffer : pieceTable->buffers) {
+		buffer.text.setCapacity(0);
+		buffer.lineBreaks.setCapacity(0);
+	}
+	pieceTable->nodes.setCapacity(0);
+	pieceTable->freeNodes.setCapacity(0);
+	pieceTable->root = NO_NODE;
+}
+
+size_t PieceTableLineArray::getNumLinesImpl(const LineArray& lineArray) {
+	const PieceTableLineArray& pieceTable = static_cast<const PieceTableLineArray&>(lineArray);
+	return pieceTable.subtreeLineBreaks(pieceTable.root) + 1;
+}
+
+size_t PieceTableLineArray::getLineSizeImpl(const LineArray& lineArray, size_t line) {
+	const PieceTableLineArray& pieceTable = static_cast<const PieceTableLineArray&>(lineArray);
+	const size_t begin = pieceTable.lineBeginOffset(line);
+	const bool isLastLine = (line == pieceTable.subtreeLineBreaks(pieceTable.root));
+	// The line ends just before the line break that begins the next line.
+	const size_t end = isLastLine ? pieceTable.subtreeSize(pieceTable.root) : (pieceTable.lineBeginOffset(line+1) - 1);
+	return end - begin;
+}
+
+size_t PieceTableLineArray::getTotalSizeImpl(const LineArray& lineArray) {
+	const PieceTableLineArray& pieceTable = static_cast<const PieceTableLineArray&>(lineArray);
+	return pieceTable.subtreeSize(pieceTable.root);
+}
+
+size_t PieceTableLineArray::positionToOffsetImpl(const LineArray& lineArray, const Position& position) {
+	return static_cast<const PieceTableLineArray&>(lineArray).findOffset(position);
+}
+
+LineArray::Position PieceTableLineArray::offsetToPositionImpl(const LineArray& lineArray, size_t offset) {
+	return static_cast<const PieceTableLineArray&>(lineArray).findPosition(offset);
+}
+
+void PieceTableLineArray::getTextImpl(const LineArray& lineArray, const Position& begin, const Position& end, Array<char>& text) {
+	const PieceTableLineArray& pieceTable = static_cast<const PieceTableLineArray&>(lineArray);
+	const size_t beginOffset = pieceTable.findOffset(begin);
+	const size_t endOffset = pieceTable.findOffset(end);
+	if (beginOffset < endOffset) {
+		pieceTable.appendText(pieceTable.root, 0, beginOffset, endOffset, text);
+	}
+}
+
+bool PieceTableLineArray::visitTextImpl(
+	const LineArray& lineArray,
+	const Position& begin,
+	const Position& end,
+	TextVisitor visitor,
+	void* data
+) {
+	const PieceTableLineArray& pieceTable = static_cast<const PieceTableLineArray&>(lineArray);
+	const size_t beginOffset = pieceTable.findOffset(begin);
+	const size_t endOffset = pieceTable.findOffset(end);
+	if (beginOffset >= endOffset) {
+		return true;
+	}
+	return pieceTable.visitPieces(pieceTable.root, 0, beginOffset, endOffset, visitor, data);
+}
+
+void PieceTableLineArray::replaceImpl(
+	LineArray& lineArray,
+	const Position& begin,
+	const Position& end,
+	const char* newTextBegin,
+	const char* newTextEnd,
+	TextReplacementEvent* undoEvent
+) {
+	PieceTableLineArray& pieceTable = static_cast<PieceTableLineArray&>(lineArray);
+	const size_t beginOffset = pieceTable.findOffset(begin);
+	const size_t endOffset = pieceTable.findOffset(end);
+	assert(beginOffset <= endOffset);
+
+	if (undoEvent != nullptr) {
+		// Save the previous text before replacing it, so that it can be undone.
+		undoEvent->lineArray = &lineArray;
+		undoEvent->previousText.setSize(0);
+		getTextImpl(lineArray, begin, end, undoEvent->previousText);
+		undoEvent->begin = begin;
+		setUndoEventEnd(*undoEvent, begin, newTextBegin, newTextEnd);
+	}
+
+	// Remove the pieces in the range, splitting pieces at its ends.
+	uint32 left;
+	uint32 middle;
+	uint32 right;
+	uint32 beforeEnd;
+	pieceTable.split(pieceTable.root, endOffset, beforeEnd, right);
+	pieceTable.split(beforeEnd, beginOffset, left, middle);
+	pieceTable.freeSubtree(middle);
+
+	if (newTextBegin != newTextEnd) {
+		Buffer& added = pieceTable.buffers[ADDED_BUFFER];
+		const size_t previousAddedSize = added.text.size();
+		const size_t newStart = pieceTable.appendToAddedBuffer(newTextBegin, newTextEnd);
+		const size_t newLength = newTextEnd - newTextBegin;
+
+		// When typing, each insertion directly follows the previous one,
+		// in both the document and the added buffer, so extend the previous
+		// piece, instead of adding a piece per keystroke.
+		uint32 last = left;
+		while (last != NO_NODE && pieceTable.nodes[last].right != NO_NODE) {
+			last = pieceTable.nodes[last].right;
+		}
+		if (last != NO_NODE &&
+			pieceTable.nodes[last].buffer == ADDED_BUFFER &&
+			pieceTable.nodes[last].start + pieceTable.nodes[last].length == previousAddedSize
+		) {
+			const size_t newLineBreaks = pieceTable.countLineBreaks(ADDED_BUFFER, newStart, newStart + newLength);
+			pieceTable.nodes[last].length += newLength;
+			pieceTable.nodes[last].numLineBreaks += newLineBreaks;
+			// Every node on the right spine contains the last node.
+			for (uint32 index = left; index != NO_NODE; index = pieceTable.nodes[index].right) {
+				pieceTable.nodes[index].totalSize += newLength;
+				pieceTable.nodes[index].totalLineBreaks += newLineBreaks;
+			}
+		}
+		else {
+			const uint32 newPiece = pieceTable.newNode(ADDED_BUFFER, newStart, newLength);
+			left = pieceTable.merge(left, newPiece);
+		}
+	}
+	pieceTable.root = pieceTable.merge(left, right);
+}
+
+void PieceTableLineArray::setTextImpl(
+	LineArray& lineArray,
+	const char* text,
+	size_t size,
+	const size_t* lineBreaks,
+	size_t numLineBreaks,
+	size_t lineBreakSize
+) {
+	PieceTableLineArray& pieceTable = static_cast<PieceTableLineArray&>(lineArray);
+	destruct(&pieceTable);
+
+	// The new text becomes the original buffer, with only '\n' line breaks.
+	Buffer& original = pieceTable.buffers[ORIGINAL_BUFFER];
+	const size_t removedSize = numLineBreaks*(lineBreakSize-1);
+	assert(removedSize <= size);
+	const size_t newSize = size - removedSize;
+	original.text.setSize(newSize);
+	original.lineBreaks.setSize(numLineBreaks);
+	if (lineBreakSize == 1) {
+		if (newSize != 0) {
+			memcpy(original.text.data(), text, newSize);
+		}
+		if (numLineBreaks != 0) {
+			memcpy(original.lineBreaks.data(), lineBreaks, numLineBreaks*sizeof(size_t));
+		}
+	}
+	else {
+		char* dest = original.text.data();
+		size_t lineBegin = 0;
+		for (size_t i = 0; i <= numLineBreaks; ++i) {
+			const bool isLastLine = (i == numLineBreaks);
+			const size_t lineEnd = isLastLine ? size : (lineBreaks[i] + 1 - lineBreakSize);
+			memcpy(dest, text + lineBegin, lineEnd - lineBegin);
+			dest += lineEnd - lineBegin;
+			if (!isLastLine) {
+				original.lineBreaks[i] = dest - original.text.data();
+				*dest = '\n';
+				++dest;
+			}
+			lineBegin = lineEnd + lineBreakSize;
+		}
+	}
+	if (newSize != 0) {
+		pieceTable.root = pieceTable.newNode(ORIGINAL_BUFFER, 0, newSize);
+	}
+}
+
+LineArrayClass PieceTableLineArray::initClass() {
+	LineArrayClass c;
+	c.typeName = "PieceTableLineArray";
+	c.destruct = &destruct;
+	c.getNumLines = &getNumLinesImpl;
+	c.getLineSize = &getLineSizeImpl;
+	c.getTotalSize = &getTotalSizeImpl;
+	c.positionToOffset = &positionToOffsetImpl;
+	c.offsetToPosition = &offsetToPositionImpl;
+	c.getText = &getTextImpl;
+	c.visitText = &visitTextImpl;
+	c.replace = &replaceImpl;
+	c.setText = &setTextImpl;
+	return c;
+}
+
+const LineArrayClass PieceTableLineArray::staticType(PieceTableLineArray::initClass());
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
@@ -0,0 +1,403 @@
+#include "model/TailLineArray.h"
+
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Types.h>
+
+#include <string.h>
+#include <utility>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+constexpr static size_t MIN_RING_SIZE = 16;
+
+TailLineArray::TailLineArray(size_t maxLines, size_t maxBytes) :
+	LineArray(&staticType),
+	firstIndex(0),
+	numLines(1),
+	firstLineNumber(0),
+	maxLines((maxLines == 0) ? 1 : maxLines),
+	maxBytes(maxBytes)
+{
+	// There's always at least one line.
+	ring.setSize(MIN_RING_SIZE);
+	ring[0].beginOffset = 0;
+}
+
+void TailLineArray::setLimits(size_t newMaxLines, size_t newMaxBytes) {
+	maxLines = (newMaxLines == 0) ? 1 : newMaxLines;
+	maxBytes = newMaxBytes;
+	evict();
+}
+
+void TailLineArray::append(const char* textBegin, const char* textEnd) {
+	const size_t lastLine = numLines-1;
+	const Position end{lastLine, entry(lastLine).text.size()};
+	replaceText(end, end, textBegin, textEnd);
+	evict();
+}
+
+void TailLineArray::reserve(size_t minLines) {
+	const size_t oldSize = ring.size();
+	if (minLines <= oldSize) {
+		return;
+	}
+	size_t newSize = 2*oldSize;
+	while (newSize < minLines) {
+		newSize *= 2;
+	}
+	// Unwrap the lines into the beginning of the new ring.
+	Array<Entry> newRing;
+	newRing.setSize(newSize);
+	for (size_t line = 0; line < numLines; ++line) {
+		Entry& oldEntry = entry(line);
+		newRing[line].text = std::move(oldEntry.text);
+		newRing[line].beginOffset = oldEntry.beginOffset;
+	}
+	ring = std::move(newRing);
+	firstIndex = 0;
+}
+
+void TailLineArray::insertLines(size_t line, size_t count) {
+	assert(line <= numLines);
+	reserve(numLines + count);
+	const size_t oldNumLines = numLines;
+	numLines += count;
+	// Move the later lines back, starting from the end, so that nothing is
+	// overwritten.  Appending at the end doesn't move anything.
+	for (size_t i = oldNumLines; i > line; --i) {
+		Entry& from = entry(i-1);
+		Entry& to = entry(i-1 + count);
+		to.text = std::move(from.text);
+		to.beginOffset = from.beginOffset;
+	}
+}
+
+void TailLineArray::removeLines(size_t line, size_t count) {
+	assert(count < numLines && line + count <= numLines);
+	for (size_t i = line; i + count < numLines; ++i) {
+		Entry& from = entry(i + count);
+		Entry& to = entry(i);
+		to.text = std::move(from.text);
+		to.beginOffset = from.beginOffset;
+	}
+	for (size_t i = numLines - count; i < numLines; ++i) {
+		entry(i).text.clear();
+	}
+	numLines -= count;
+}
+
+void TailLineArray::updateOffsetsAfter(size_t line) {
+	uint64 offset = entry(line).beginOffset;
+	for (size_t i = line+1; i < numLines; ++i) {
+		offset += entry(i-1).text.size() + 1;
+		entry(i).beginOffset = offset;
+	}
+}
+
+size_t TailLineArray::evict(size_t maxNumEvicted) {
+	size_t numEvicted = 0;
+	while (numLines - numEvicted > 1 && numEvicted < maxNumEvicted) {
+		const Entry& first = entry(numEvicted);
+		const Entry& last = entry(numLines-1);
+		const uint64 numBytes = last.beginOffset + last.text.size() + 1 - first.beginOffset;
+		if (numLines - numEvicted <= maxLines && numBytes <= maxBytes) {
+			break;
+		}
+		++numEvicted;
+	}
+	if (numEvicted == 0) {
+		return 0;
+	}
+	// The later lines stay where they are, so evicting is just freeing the
+	// text of the evicted lines and moving the beginning of the ring.
+	for (size_t line = 0; line < numEvicted; ++line) {
+		entry(line).text.clear();
+	}
+	firstIndex = (firstIndex + numEvicted) & (ring.size()-1);
+	numLines -= numEvicted;
+	firstLineNumber += numEvicted;
+	return numEvicted;
+}
+
+void TailLineArray::replaceText(const Position& begin, const Position& end, const char* newTextBegin, const char* newTextEnd) {
+	assert(begin.line < end.line || (begin.line == end.line && begin.col <= end.col));
+	assert(end.line < numLines && end.col <= entry(end.line).text.size());
+
+	const size_t numOldLines = end.line - begin.line + 1;
+	size_t numNewLines = 1;
+	for (const char* text = newTextBegin; text != newTextEnd; ++numNewLines) {
+		text = (const char*)memchr(text, '\n', newTextEnd - text);
+		if (text == nullptr) {
+			break;
+		}
+		++text;
+	}
+
+	if (numOldLines == 1 && numNewLines == 1) {
+		// Editing a single line, which is a very common case, e.g. for a single letter.
+		entry(begin.line).text.replace(begin.col, end.col, newTextBegin, newTextEnd);
+		updateOffsetsAfter(begin.line);
+		return;
+	}
+
+	// Save the end of the last line, since it goes after the new text.
+	Array<char> endOfLastLine;
+	{
+		const TextLine& endLine = entry(end.line).text;
+		endLine.appendTo(endOfLastLine, end.col, endLine.size());
+	}
+
+	// Every line in the range other than the first is about to be replaced,
+	// so the new lines can go anywhere after the first.
+	if (numNewLines > numOldLines) {
+		insertLines(end.line + 1, numNewLines - numOldLines);
+	}
+	else if (numNewLines < numOldLines) {
+		removeLines(begin.line + numNewLines, numOldLines - numNewLines);
+	}
+
+	TextLine& firstLine = entry(begin.line).text;
+	firstLine.truncate(begin.col);
+	const char* lineBegin = newTextBegin;
+	for (size_t i = 0; i < numNewLines; ++i) {
+		const char* lineEnd = (lineBegin != newTextEnd) ? (const char*)memchr(lineBegin, '\n', newTextEnd - lineBegin) : nullptr;
+		if (lineEnd == nullptr) {
+			lineEnd = newTextEnd;
+		}
+		if (i == 0) {
+			firstLine.append(lineBegin, lineEnd);
+		}
+		else {
+			entry(begin.line + i).text.assign(lineBegin, lineEnd);
+		}
+		lineBegin = lineEnd + 1;
+	}
+	const size_t lastLine = begin.line + numNewLines - 1;
+	entry(lastLine).text.append(endOfLastLine.data(), endOfLastLine.data() + endOfLastLine.size());
+
+	updateOffsetsAfter(begin.line);
+}
+
+void TailLineArray::destruct(LineArray* lineArray) {
+	TailLineArray& tail = *static_cast<TailLineArray*>(lineArray);
+	tail.ring.setCapacity(0);
+	tail.numLines = 0;
+}
+
+size_t TailLineArray::getNumLinesImpl(const LineArray& lineArray) {
+	return static_cast<const TailLineArray&>(lineArray).numLines;
+}
+
+size_t TailLineArray::getLineSizeImpl(const LineArray& lineArray, size_t line) {
+	return static_cast<const TailLineArray&>(lineArray).entry(line).text.size();
+}
+
+size_t TailLineArray::getTotalSizeImpl(const LineArray& lineArray) {
+	// The last line doesn't have a line break.
+	return size_t(static_cast<const TailLineArray&>(lineArray).getNumBytes() - 1);
+}
+
+size_t TailLineArray::positionToOffsetImpl(const LineArray& lineArray, const Position& position) {
+	const TailLineArray& tail = static_cast<const TailLineArray&>(lineArray);
+	return size_t(tail.entry(position.line).beginOffset - tail.entry(0).beginOffset) + position.col;
+}
+
+LineArray::Position TailLineArray::offsetToPositionImpl(const LineArray& lineArray, size_t offset) {
+	const TailLineArray& tail = static_cast<const TailLineArray&>(lineArray);
+	assert(offset <= getTotalSizeImpl(lineArray));
+	const uint64 target = tail.entry(0).beginOffset + offset;
+	// Find the last line beginning at or before the offset.
+	size_t begin = 0;
+	size_t end = tail.numLines;
+	while (end - begin > 1) {
+		const size_t mid = begin + (end-begin)/2;
+		if (tail.entry(mid).beginOffset <= target) {
+			begin = mid;
+		}
+		else {
+			end = mid;
+		}
+	}
+	return Position{begin, size_t(target - tail.entry(begin).beginOffset)};
+}
+
+void TailLineArray::getTextImpl(const LineArray& lineArray, const Position& begin, const Position& end, Array<char>& text) {
+	const TailLineArray& tail = static_cast<const TailLineArray&>(lineArray);
+	if (end.line == begin.line) {
+		if (end.col > begin.col) {
+			tail.entry(begin.line).text.appendTo(text, begin.col, end.col);
+		}
+		return;
+	}
+	if (end.line < begin.line) {
+		return;
+	}
+	const TextLine& firstLine = tail.entry(begin.line).text;
+	firstLine.appendTo(text, begin.col, firstLine.size());
+	text.append('\n');
+	for (size_t line = begin.line+1; line < end.line; ++line) {
+		tail.entry(line).text.appendTo(text);
+		text.append('\n');
+	}
+	tail.entry(end.line).text.appendTo(text, 0, end.col);
+}
+
+// Line breaks aren't stored, so visitText passes this between lines.
+static const char LINE_BREAK = '\n';
+
+bool TailLineArray::visitTextImpl(
+	const LineArray& lineArray,
+	const Position& begin,
+	const Position& end,
+	TextVisitor visitor,
+	void* data
+) {
+	const TailLineArray& tail = static_cast<const TailLineArray&>(lineArray);
+	if (end.line == begin.line) {
+		return (end.col <= begin.col) || tail.entry(begin.line).text.visit(begin.col, end.col, visitor, data);
+	}
+	if (end.line < begin.line) {
+		return true;
+	}
+	const TextLine& firstLine = tail.entry(begin.line).text;
+	if (!firstLine.visit(begin.col, firstLine.size(), visitor, data) || !visitor(&LINE_BREAK, 1, data)) {
+		return false;
+	}
+	for (size_t line = begin.line+1; line < end.line; ++line) {
+		const TextLine& text = tail.entry(line).text;
+		if (!text.visit(0, text.size(), visitor, data) || !visitor(&LINE_BREAK, 1, data)) {
+			return false;
+		}
+	}
+	return tail.entry(end.line).text.visit(0, end.col, visitor, data);
+}
+
+void TailLineArray::replaceImpl(
+	LineArray& lineArray,
+	const Position& begin,
+	const Position& end,
+	const char* newTextBegin,
+	const char* newTextEnd,
+	TextReplacementEvent* undoEvent
+) {
+	TailLineArray& tail = static_cast<TailLineArray&>(lineArray);
+	if (undoEvent != nullptr) {
+		// Save the previous text before replacing it, so that it can be undone.
+		undoEvent->lineArray = &lineArray;
+		undoEvent->previousText.setSize(0);
+		getTextImpl(lineArray, begin, end, undoEvent->previousText);
+		undoEvent->begin = begin;
+		setUndoEventEnd(*undoEvent, begin, newTextBegin, newTextEnd);
+	}
+	tail.replaceText(begin, end, newTextBegin, newTextEnd);
+
+	// Only the lines before the edit are evicted, so that the undo event
+	// never refers to evicted text, and those lines have the same indices
+	// before and after the edit, so the event just moves up by that many.
+	const size_t numEvicted = tail.evict(begin.line);
+	if (undoEvent != nullptr) {
+		undoEvent->begin.line -= numEvicted;
+		undoEvent->end.line -= numEvicted;
+	}
+}
+
+void TailLineArray::replaceManyImpl(
+	LineArray& lineArray,
+	const Replacement* replacements,
+	size_t numReplacements,
+	TextBatchReplacementEvent* undoEvent
+) {
+	TailLineArray& tail = static_cast<TailLineArray&>(lineArray);
+	if (undoEvent != nullptr) {
+		prepareBatchUndoEvent(lineArray, replacements, numReplacements, *undoEvent);
+	}
+	if (numReplacements == 0) {
+		return;
+	}
+	// Replacing from the end doesn't change the positions of the earlier ones,
+	// but evicting would, so only evict after all of the replacements.
+	for (size_t i = numReplacements; i > 0;) {
+		--i;
+		const Replacement& replacement = replacements[i];
+		tail.replaceText(replacement.begin, replacement.end, replacement.newTextBegin, replacement.newTextEnd);
+	}
+
+	// Like replaceImpl, only the lines before the first replacement are
+	// evicted, so every range in the undo event moves up by the same amount.
+	const size_t numEvicted = tail.evict(replacements[0].begin.line);
+	if (undoEvent != nullptr) {
+		for (TextBatchReplacementEvent::Range& range : undoEvent->ranges) {
+			range.begin.line -= numEvicted;
+			range.end.line -= numEvicted;
+		}
+	}
+}
+
+void TailLineArray::setTextImpl(
+	LineArray& lineArray,
+	const char* text,
+	size_t size,
+	const size_t* lineBreaks,
+	size_t numLineBreaks,
+	size_t lineBreakSize
+) {
+	TailLineArray& tail = static_cast<TailLineArray&>(lineArray);
+
+	// Only the lines at the end that fit within the limits are kept,
+	// so find the first of them before copying anything.
+	const size_t numTextLines = numLineBreaks + 1;
+	size_t firstTextLine = numTextLines - 1;
+	uint64 numBytes = (size - (numLineBreaks == 0 ? 0 : lineBreaks[numLineBreaks-1] + 1)) + 1;
+	while (firstTextLine > 0 && numTextLines - firstTextLine < tail.maxLines) {
+		const size_t lineBegin = (firstTextLine == 1) ? 0 : lineBreaks[firstTextLine-2] + 1;
+		const size_t lineEnd = lineBreaks[firstTextLine-1] + 1 - lineBreakSize;
+		if (numBytes + (lineEnd - lineBegin) + 1 > tail.maxBytes) {
+			break;
+		}
+		numBytes += (lineEnd - lineBegin) + 1;
+		--firstTextLine;
+	}
+
+	for (size_t line = 0; line < tail.numLines; ++line) {
+		tail.entry(line).text.clear();
+	}
+	tail.firstIndex = 0;
+	tail.numLines = 0;
+	tail.reserve(numTextLines - firstTextLine);
+	tail.numLines = numTextLines - firstTextLine;
+	tail.firstLineNumber = firstTextLine;
+	for (size_t line = firstTextLine; line < numTextLines; ++line) {
+		const size_t lineBegin = (line == 0) ? 0 : lineBreaks[line-1] + 1;
+		const size_t lineEnd = (line == numLineBreaks) ? size : lineBreaks[line] + 1 - lineBreakSize;
+		tail.entry(line - firstTextLine).text.assign(text + lineBegin, text + lineEnd);
+	}
+	tail.entry(0).beginOffset = 0;
+	tail.updateOffsetsAfter(0);
+}
+
+LineArrayClass TailLineArray::initClass() {
+	LineArrayClass c;
+	c.typeName = "TailLineArray";
+	c.destruct = &destruct;
+	c.getNumLines = &getNumLinesImpl;
+	c.getLineSize = &getLineSizeImpl;
+	c.getTotalSize = &getTotalSizeImpl;
+	c.positionToOffset = &positionToOffsetImpl;
+	c.offsetToPosition = &offsetToPositionImpl;
+	c.getText = &getTextImpl;
+	c.visitText = &visitTextImpl;
+	c.replace = &replaceImpl;
+	c.replaceMany = &replaceManyImpl;
+	c.setText = &setTextImpl;
+	// There's no setMappedText, since the file could be much larger than
+	// the limits, and lines are evicted from the front, so it's better to
+	// only copy the lines that are kept.
+	return c;
+}
+
+const LineArrayClass TailLineArray::staticType(TailLineArray::initClass());
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
@@ -0,0 +1,64 @@
+#include "model/TextArena.h"
+
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Types.h>
+
+#include <new>
+#include <stdlib.h>
+#include <utility>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+char* TextArena::allocate(size_t size) {
+	numBytes += size;
+	if (size_t(currentEnd - current) >= size) {
+		char* text = current;
+		current += size;
+		return text;
+	}
+
+	// Large allocations get their own chunk, so that the rest of
+	// the current chunk isn't wasted.
+	const bool isLarge = (size > CHUNK_SIZE/4);
+	const size_t chunkSize = isLarge ? size : CHUNK_SIZE;
+	char* chunk = (char*)malloc(chunkSize);
+	if (chunk == nullptr) {
+		throw std::bad_alloc();
+	}
+	chunks.append(chunk);
+	if (!isLarge) {
+		current = chunk + size;
+		currentEnd = chunk + chunkSize;
+	}
+	return chunk;
+}
+
+void TextArena::clear() {
+	for (char* chunk : chunks) {
+		free(chunk);
+	}
+	chunks.setCapacity(0);
+	current = nullptr;
+	currentEnd = nullptr;
+	numBytes = 0;
+}
+
+void TextArena::swap(TextArena& that) {
+	Array<char*> tempChunks(std::move(chunks));
+	chunks = std::move(that.chunks);
+	that.chunks = std::move(tempChunks);
+	char* const tempCurrent = current;
+	char* const tempCurrentEnd = currentEnd;
+	const size_t tempNumBytes = numBytes;
+	current = that.current;
+	currentEnd = that.currentEnd;
+	numBytes = that.numBytes;
+	that.current = tempCurrent;
+	that.currentEnd = tempCurrentEnd;
+	that.numBytes = tempNumBytes;
+}
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
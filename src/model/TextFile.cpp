@@ -0,0 +1,439 @@
+#include "model/TextFile.h"
+#include "model/LineArray.h"
+#include "TextScanning.h"
+
+#include <SDL.h>
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Types.h>
+
+#include <string.h>
+#include <emmintrin.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+#ifdef _WIN32
+// Filenames are UTF-8, like in SDL, so convert to UTF-16 for Windows,
+// including the terminating zero.
+static bool toWideFilename(const char* filename, Array<wchar_t>& wideFilename) {
+	const int wideLength = MultiByteToWideChar(CP_UTF8, 0, filename, -1, nullptr, 0);
+	if (wideLength <= 0) {
+		return false;
+	}
+	wideFilename.setSize(wideLength);
+	MultiByteToWideChar(CP_UTF8, 0, filename, -1, wideFilename.data(), wideLength);
+	return true;
+}
+
+bool mapFile(const char* filename, MappedFile& file) {
+	file = MappedFile();
+	Array<wchar_t> wideFilename;
+	if (!toWideFilename(filename, wideFilename)) {
+		return false;
+	}
+
+	HANDLE fileHandle = CreateFileW(wideFilename.data(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (fileHandle == INVALID_HANDLE_VALUE) {
+		SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Unable to open file \"%s\"\n", filename);
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(fileHandle, &size)) {
+		SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Unable to get the size of file \"%s\"\n", filename);
+		CloseHandle(fileHandle);
+		return false;
+	}
+	if (size.QuadPart == 0) {
+		// Empty files can't be mapped, but there's nothing to map anyway.
+		CloseHandle(fileHandle);
+		return true;
+	}
+	HANDLE mappingHandle = CreateFileMappingW(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	const void* data = (mappingHandle != nullptr) ? MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (data == nullptr) {
+		SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Unable to map file \"%s\" into memory\n", filename);
+		if (mappingHandle != nullptr) {
+			CloseHandle(mappingHandle);
+		}
+		CloseHandle(fileHandle);
+		return false;
+	}
+	file.data = (const char*)data;
+	file.size = size_t(size.QuadPart);
+	file.fileHandle = fileHandle;
+	file.mappingHandle = mappingHandle;
+	return true;
+}
+
+void unmapFile(MappedFile& file) {
+	if (file.data != nullptr) {
+		UnmapViewOfFile(file.data);
+		CloseHandle(file.mappingHandle);
+		CloseHandle(file.fileHandle);
+	}
+	file = MappedFile();
+}
+#else
+bool mapFile(const char* filename, MappedFile& file) {
+	file = MappedFile();
+	const int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Unable to open file \"%s\"\n", filename);
+		return false;
+	}
+	struct stat fileStats;
+	if (fstat(fd, &fileStats) != 0) {
+		SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Unable to get the size of file \"%s\"\n", filename);
+		close(fd);
+		return false;
+	}
+	const size_t size = size_t(fileStats.st_size);
+	if (size == 0) {
+		// Empty files can't be mapped, but there's nothing to map anyway.
+		close(fd);
+		return true;
+	}
+	void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping stays valid after closing the file.
+	close(fd);
+	if (data == MAP_FAILED) {
+		SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Unable to map file \"%s\" into memory\n", filename);
+		return false;
+	}
+	file.data = (const char*)data;
+	file.size = size;
+	return true;
+}
+
+void unmapFile(MappedFile& file) {
+	if (file.data != nullptr) {
+		munmap(const_cast<char*>(file.data), file.size);
+	}
+	file = MappedFile();
+}
+#endif
+
+void findLineBreaksInRange(const char* text, size_t begin, size_t end, Array<size_t>& lineBreaks) {
+	const __m128i lineBreakBytes = _mm_set1_epi8('\n');
+	size_t i = begin;
+	for (; i + 16 <= end; i += 16) {
+		const __m128i bytes = _mm_loadu_si128((const __m128i*)(text + i));
+		uint32 mask = uint32(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, lineBreakBytes)));
+		while (mask != 0) {
+			lineBreaks.append(i + lowestBitIndex(mask));
+			// Clear the lowest set bit.
+			mask &= mask - 1;
+		}
+	}
+	for (; i < end; ++i) {
+		if (text[i] == '\n') {
+			lineBreaks.append(i);
+		}
+	}
+}
+
+struct LineBreakChunk {
+	const char* text;
+	size_t begin;
+	size_t end;
+	Array<size_t> lineBreaks;
+};
+
+static int lineBreakThreadFunction(void* data) {
+	LineBreakChunk& chunk = *(LineBreakChunk*)data;
+	findLineBreaksInRange(chunk.text, chunk.begin, chunk.end, chunk.lineBreaks);
+	return 0;
+}
+
+void findLineBreaks(const char* text, size_t size, Array<size_t>& lineBreaks) {
+	const size_t numChunks = getNumParallelChunks(size);
+	if (numChunks <= 1) {
+		findLineBreaksInRange(text, 0, size, lineBreaks);
+		return;
+	}
+
+	Array<LineBreakChunk> chunks;
+	chunks.setSize(numChunks);
+	for (size_t i = 0; i < numChunks; ++i) {
+		LineBreakChunk& chunk = chunks[i];
+		chunk.text = text;
+		chunk.begin = (size*i)/numChunks;
+		chunk.end = (size*(i+1))/numChunks;
+	}
+	runChunksInParallel(chunks, lineBreakThreadFunction, "Line Break Thread");
+
+	// The chunks are in order, so the line breaks are too.
+	appendChunkResults(chunks, &LineBreakChunk::lineBreaks, lineBreaks);
+}
+
+LineEnding detectLineEnding(const char* text, const Array<size_t>& lineBreaks) {
+	if (lineBreaks.size() == 0) {
+		return LineEnding::LF;
+	}
+	for (size_t lineBreak : lineBreaks) {
+		if (lineBreak == 0 || text[lineBreak-1] != '\r') {
+			return LineEnding::LF;
+		}
+	}
+	return LineEnding::CRLF;
+}
+
+bool loadTextFile(const char* filename, LineArray& lineArray, LineEnding* lineEnding) {
+	MappedFile file;
+	if (!mapFile(filename, file)) {
+		return false;
+	}
+
+	Array<size_t> lineBreaks;
+	findLineBreaks(file.data, file.size, lineBreaks);
+	const LineEnding ending = detectLineEnding(file.data, lineBreaks);
+	const size_t lineBreakSize = (ending == LineEnding::CRLF) ? 2 : 1;
+	lineArray.setText(file.data, file.size, lineBreaks.data(), lineBreaks.size(), lineBreakSize);
+
+	unmapFile(file);
+	if (lineEnding != nullptr) {
+		*lineEnding = ending;
+	}
+	return true;
+}
+
+bool mapTextFile(const char* filename, LineArray& lineArray, LineEnding* lineEnding) {
+	MappedFile file;
+	if (!mapFile(filename, file)) {
+		return false;
+	}
+
+	Array<size_t> lineBreaks;
+	findLineBreaks(file.data, file.size, lineBreaks);
+	const LineEnding ending = detectLineEnding(file.data, lineBreaks);
+	const size_t lineBreakSize = (ending == LineEnding::CRLF) ? 2 : 1;
+	if (!lineArray.setMappedText(file, lineBreaks.data(), lineBreaks.size(), lineBreakSize)) {
+		// The LineArray class needs its own copy of the text.
+		lineArray.setText(file.data, file.size, lineBreaks.data(), lineBreaks.size(), lineBreakSize);
+		unmapFile(file);
+	}
+
+	if (lineEnding != nullptr) {
+		*lineEnding = ending;
+	}
+	return true;
+}
+
+// Spans of text for saveTextFile, which are written in batches.
+struct TextFileWriter {
+#ifdef _WIN32
+	HANDLE file;
+	// Small spans are copied into this, so that each write isn't tiny.
+	Array<char> buffer;
+#else
+	int fd;
+	Array<struct iovec> spans;
+#endif
+	bool isCRLF;
+	// True if the spans are only valid until saveSpan returns, so they must
+	// be written before then, instead of being batched with later spans.
+	bool isTextTemporary;
+};
+
+#ifdef _WIN32
+// Spans at least this large are written directly, instead of being buffered.
+constexpr static size_t WRITE_BUFFER_SIZE = 1 << 16;
+
+static bool writeAll(HANDLE file, const char* text, size_t size) {
+	while (size != 0) {
+		// WriteFile takes a 32-bit size.
+		const DWORD chunkSize = (size > (size_t(1) << 30)) ? DWORD(1) << 30 : DWORD(size);
+		DWORD numWritten;
+		if (!WriteFile(file, text, chunkSize, &numWritten, nullptr)) {
+			return false;
+		}
+		text += numWritten;
+		size -= numWritten;
+	}
+	return true;
+}
+
+static bool flushSpans(TextFileWriter& writer) {
+	const bool success = writeAll(writer.file, writer.buffer.data(), writer.buffer.size());
+	writer.buffer.setSize(0);
+	return success;
+}
+
+static bool addSpan(TextFileWriter& writer, const char* text, size_t size) {
+	if (size >= WRITE_BUFFER_SIZE) {
+		return flushSpans(writer) && writeAll(writer.file, text, size);
+	}
+	if (writer.buffer.size() + size > WRITE_BUFFER_SIZE && !flushSpans(writer)) {
+		return false;
+	}
+	writer.buffer.append(text, text + size);
+	return true;
+}
+#else
+// POSIX only guarantees that writev accepts 16 spans, but every common
+// system accepts at least this many.
+constexpr static size_t MAX_WRITE_SPANS = 1024;
+
+static bool flushSpans(TextFileWriter& writer) {
+	struct iovec* spans = writer.spans.data();
+	size_t numSpans = writer.spans.size();
+	while (numSpans != 0) {
+		const ssize_t numWritten = writev(writer.fd, spans, int(numSpans));
+		if (numWritten < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		// Less than everything may have been written, so skip what was.
+		size_t remaining = size_t(numWritten);
+		while (numSpans != 0 && remaining >= spans->iov_len) {
+			remaining -= spans->iov_len;
+			++spans;
+			--numSpans;
+		}
+		if (remaining != 0) {
+			spans->iov_base = (char*)spans->iov_base + remaining;
+			spans->iov_len -= remaining;
+		}
+	}
+	writer.spans.setSize(0);
+	return true;
+}
+
+static bool addSpan(TextFileWriter& writer, const char* text, size_t size) {
+	struct iovec span;
+	span.iov_base = const_cast<char*>(text);
+	span.iov_len = size;
+	writer.spans.append(span);
+	return (writer.spans.size() < MAX_WRITE_SPANS) || flushSpans(writer);
+}
+#endif
+
+static bool addSpanWithLineEndings(TextFileWriter& writer, const char* text, size_t size) {
+	if (!writer.isCRLF) {
+		return addSpan(writer, text, size);
+	}
+	// Replace each '\n' with "\r\n", still without copying the text between them.
+	static const char CRLF[2] = {'\r', '\n'};
+	const char* const end = text + size;
+	while (text != end) {
+		const char* lineBreak = (const char*)memchr(text, '\n', end - text);
+		if (lineBreak == nullptr) {
+			return addSpan(writer, text, end - text);
+		}
+		if (lineBreak != text && !addSpan(writer, text, lineBreak - text)) {
+			return false;
+		}
+		if (!addSpan(writer, CRLF, 2)) {
+			return false;
+		}
+		text = lineBreak + 1;
+	}
+	return true;
+}
+
+static bool saveSpan(const char* text, size_t size, void* data) {
+	TextFileWriter& writer = *(TextFileWriter*)data;
+	return addSpanWithLineEndings(writer, text, size) && (!writer.isTextTemporary || flushSpans(writer));
+}
+
+static bool writeLineArray(TextFileWriter& writer, const LineArray& lineArray) {
+	const size_t lastLine = lineArray.getNumLines()-1;
+	const LineArray::Position end{lastLine, lineArray.getLineSize(lastLine)};
+	writer.isTextTemporary = !lineArray.hasStableVisitedText();
+	return lineArray.visitText(LineArray::Position{0, 0}, end, &saveSpan, &writer) && flushSpans(writer);
+}
+
+#ifdef _WIN32
+bool saveTextFile(const char* filename, const LineArray& lineArray, LineEnding lineEnding) {
+	Array<wchar_t> wideFilename;
+	if (!toWideFilename(filename, wideFilename)) {
+		return false;
+	}
+	Array<wchar_t> tempFilename;
+	const wchar_t suffix[] = L".tmp";
+	const size_t filenameLength = wideFilename.size()-1;
+	tempFilename.setSize(filenameLength + sizeof(suffix)/sizeof(suffix[0]));
+	memcpy(tempFilename.data(), wideFilename.data(), filenameLength*sizeof(wchar_t));
+	memcpy(tempFilename.data() + filenameLength, suffix, sizeof(suffix));
+
+	TextFileWriter writer;
+	writer.file = CreateFileW(tempFilename.data(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (writer.file == INVALID_HANDLE_VALUE) {
+		SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Unable to create a temporary file to save \"%s\"\n", filename);
+		return false;
+	}
+	writer.isCRLF = (lineEnding == LineEnding::CRLF);
+	bool success = writeLineArray(writer, lineArray);
+	if (!CloseHandle(writer.file)) {
+		success = false;
+	}
+	if (success && !MoveFileExW(tempFilename.data(), wideFilename.data(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+		success = false;
+	}
+	if (!success) {
+		SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Unable to save file \"%s\"\n", filename);
+		DeleteFileW(tempFilename.data());
+	}
+	return success;
+}
+#else
+bool saveTextFile(const char* filename, const LineArray& lineArray, LineEnding lineEnding) {
+	Array<char> tempFilename;
+	const char suffix[] = ".XXXXXX";
+	const size_t filenameLength = strlen(filename);
+	tempFilename.setSize(filenameLength + sizeof(suffix));
+	memcpy(tempFilename.data(), filename, filenameLength);
+	memcpy(tempFilename.data() + filenameLength, suffix, sizeof(suffix));
+
+	TextFileWriter writer;
+	writer.fd = mkstemp(tempFilename.data());
+	if (writer.fd < 0) {
+		SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Unable to create a temporary file to save \"%s\"\n", filename);
+		return false;
+	}
+	// mkstemp only gives the owner access, so use the permissions of the
+	// file being replaced, or the usual permissions for a new file.
+	struct stat fileStats;
+	if (stat(filename, &fileStats) == 0) {
+		fchmod(writer.fd, fileStats.st_mode & 07777);
+	}
+	else {
+		const mode_t mask = umask(0);
+		umask(mask);
+		fchmod(writer.fd, 0666 & ~mask);
+	}
+	writer.isCRLF = (lineEnding == LineEnding::CRLF);
+	bool success = writeLineArray(writer, lineArray) && (fsync(writer.fd) == 0);
+	if (close(writer.fd) != 0) {
+		success = false;
+	}
+	if (success && rename(tempFilename.data(), filename) != 0) {
+		success = false;
+	}
+	if (!success) {
+		SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Unable to save file \"%s\"\n", filename);
+		unlink(tempFilename.data());
+	}
+	return success;
+}
+#endif
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
@@ -0,0 +1,193 @@
+#include "model/TextLine.h"
+
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Types.h>
+
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+// Growing by at least this much avoids reallocating on every keystroke
+// in short lines.
+constexpr static size_t MIN_GAP_SIZE = 16;
+
+static char* allocateText(size_t capacity) {
+	char* text = (char*)malloc(capacity);
+	if (text == nullptr) {
+		throw std::bad_alloc();
+	}
+	return text;
+}
+
+TextLine::TextLine(const char* textBegin, const char* textEnd) {
+	const size_t size = textEnd - textBegin;
+	if (size <= INLINE_CAPACITY) {
+		small.storage = Storage::SMALL;
+		if (size != 0) {
+			memcpy(small.text, textBegin, size);
+		}
+		gapBegin = size;
+		gapEnd = INLINE_CAPACITY;
+		return;
+	}
+	external.storage = Storage::OWNED;
+	external.text = allocateText(size);
+	external.capacity = size;
+	memcpy(external.text, textBegin, size);
+	gapBegin = size;
+	gapEnd = size;
+}
+
+void TextLine::freeBuffer() {
+	if (storage() == Storage::OWNED) {
+		free(external.text);
+	}
+}
+
+void TextLine::borrow(const char* textBegin, const char* textEnd) {
+	freeBuffer();
+	const size_t size = textEnd - textBegin;
+	if (size <= INLINE_CAPACITY) {
+		small.storage = Storage::SMALL;
+		if (size != 0) {
+			memcpy(small.text, textBegin, size);
+		}
+		gapBegin = size;
+		gapEnd = INLINE_CAPACITY;
+		return;
+	}
+	external.storage = Storage::BORROWED;
+	external.text = const_cast<char*>(textBegin);
+	external.capacity = size;
+	gapBegin = size;
+	gapEnd = size;
+}
+
+void TextLine::appendTo(Array<char>& text, size_t beginCol, size_t endCol) const {
+	assert(beginCol <= endCol && endCol <= size());
+	const char* lineText = buffer();
+	if (beginCol < gapBegin) {
+		const size_t end = (endCol < gapBegin) ? endCol : gapBegin;
+		text.append(lineText + beginCol, lineText + end);
+	}
+	if (endCol > gapBegin) {
+		const size_t gapSize = gapEnd - gapBegin;
+		const size_t begin = (beginCol > gapBegin) ? beginCol : gapBegin;
+		text.append(lineText + begin + gapSize, lineText + endCol + gapSize);
+	}
+}
+
+bool TextLine::visit(
+	size_t beginCol,
+	size_t endCol,
+	bool (*visitor)(const char* text, size_t size, void* data),
+	void* data
+) const {
+	assert(beginCol <= endCol && endCol <= size());
+	const char* lineText = buffer();
+	if (beginCol < gapBegin) {
+		const size_t end = (endCol < gapBegin) ? endCol : gapBegin;
+		if (end > beginCol && !visitor(lineText + beginCol, end - beginCol, data)) {
+			return false;
+		}
+	}
+	if (endCol > gapBegin) {
+		const size_t gapSize = gapEnd - gapBegin;
+		const size_t begin = (beginCol > gapBegin) ? beginCol : gapBegin;
+		if (endCol > begin && !visitor(lineText + begin + gapSize, endCol - begin, data)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+const char* TextLine::data() {
+	if (!isBorrowed()) {
+		moveGap(size());
+	}
+	return buffer();
+}
+
+void TextLine::copyBorrowedText() {
+	assert(isBorrowed() && gapBegin == gapEnd && gapEnd == external.capacity);
+	const char* text = external.text;
+	const size_t size = gapBegin;
+	// Borrowed text is always too long to fit inline.
+	assert(size > INLINE_CAPACITY);
+	external.storage = Storage::OWNED;
+	external.text = allocateText(size);
+	memcpy(external.text, text, size);
+}
+
+void TextLine::moveGap(size_t col) {
+	assert(col <= size());
+	assert(!isBorrowed());
+	if (col == gapBegin) {
+		return;
+	}
+	const size_t gapSize = gapEnd - gapBegin;
+	char* text = buffer();
+	if (col < gapBegin) {
+		// Move the text from col to the gap to the end of the gap.
+		memmove(text + col + gapSize, text + col, gapBegin - col);
+	}
+	else {
+		// Move the text from the gap to col to the beginning of the gap.
+		memmove(text + gapBegin, text + gapEnd, col - gapBegin);
+	}
+	gapBegin = col;
+	gapEnd = col + gapSize;
+}
+
+void TextLine::grow(size_t minGapSize) {
+	// Double the capacity, so that the number of reallocations
+	// is logarithmic in the final size.
+	const size_t oldCapacity = capacity();
+	const size_t textSize = oldCapacity - (gapEnd - gapBegin);
+	size_t newCapacity = 2*oldCapacity;
+	if (newCapacity < textSize + minGapSize + MIN_GAP_SIZE) {
+		newCapacity = textSize + minGapSize + MIN_GAP_SIZE;
+	}
+	const size_t afterGapSize = oldCapacity - gapEnd;
+	const char* oldText = buffer();
+	char* newText = allocateText(newCapacity);
+	memcpy(newText, oldText, gapBegin);
+	memcpy(newText + newCapacity - afterGapSize, oldText + gapEnd, afterGapSize);
+	freeBuffer();
+
+	external.storage = Storage::OWNED;
+	external.text = newText;
+	external.capacity = newCapacity;
+	gapEnd = newCapacity - afterGapSize;
+}
+
+size_t TextLine::replace(size_t beginCol, size_t endCol, const char* textBegin, const char* textEnd) {
+	assert(beginCol <= endCol && endCol <= size());
+	assert(textBegin <= textEnd);
+
+	if (isBorrowed()) {
+		copyBorrowedText();
+	}
+
+	// Removing the old text just widens the gap.
+	moveGap(beginCol);
+	gapEnd += endCol - beginCol;
+
+	const size_t newSize = textEnd - textBegin;
+	if (newSize > gapEnd - gapBegin) {
+		grow(newSize);
+	}
+
+	if (newSize != 0) {
+		memcpy(buffer() + gapBegin, textBegin, newSize);
+	}
+	gapBegin += newSize;
+	return gapBegin;
+}
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
@@ -0,0 +1,100 @@
+#pragma once
+
+// This file contains helpers shared by the text model implementations for
+// scanning large amounts of text quickly, using SSE2 masks, and splitting
+// the work into chunks that are processed in parallel.  It's internal to
+// the library, so it isn't in the include directory.
+
+#include "UICommon.h"
+
+#include <SDL.h>
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Types.h>
+
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+// Chunks smaller than this aren't worth the overhead of a thread.
+constexpr static size_t MIN_PARALLEL_CHUNK_SIZE = size_t(1) << 22;
+
+// Returns the index of the lowest set bit in mask, which must be non-zero,
+// e.g. to find the first matching byte from _mm_movemask_epi8.
+static INLINE uint32 lowestBitIndex(uint32 mask) {
+	assert(mask != 0);
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return uint32(index);
+#else
+	return uint32(__builtin_ctz(mask));
+#endif
+}
+
+// Appends the offset of every '\n' in text[begin, end) to lineBreaks,
+// checking 16 bytes at a time, since lines are often shorter than the
+// overhead of calling memchr for each one.
+void findLineBreaksInRange(const char* text, size_t begin, size_t end, Array<size_t>& lineBreaks);
+
+// Returns the number of chunks that size bytes of work should be split into,
+// which is at most the number of CPUs, or 1 if it isn't worth using threads.
+static INLINE size_t getNumParallelChunks(size_t size) {
+	size_t numChunks = size / MIN_PARALLEL_CHUNK_SIZE;
+	const int numCPUs = SDL_GetCPUCount();
+	if (numChunks > size_t(numCPUs)) {
+		numChunks = size_t(numCPUs);
+	}
+	return (numChunks == 0) ? 1 : numChunks;
+}
+
+// Calls function on every chunk, with the first on this thread, and the
+// others on new threads, returning once all of them are done.  If a thread
+// can't be created, its chunk is processed on this thread instead.
+template<typename CHUNK>
+static void runChunksInParallel(Array<CHUNK>& chunks, int (*function)(void*), const char* threadName) {
+	const size_t numChunks = chunks.size();
+	Array<SDL_Thread*> threads;
+	threads.setSize(numChunks);
+	for (size_t i = 0; i < numChunks; ++i) {
+		// This thread processes the first chunk, so it doesn't need a new thread.
+		threads[i] = (i == 0) ? nullptr : SDL_CreateThread(function, threadName, &chunks[i]);
+	}
+	for (size_t i = 0; i < numChunks; ++i) {
+		if (threads[i] != nullptr) {
+			SDL_WaitThread(threads[i], nullptr);
+		}
+		else {
+			// Either the first chunk, or creating the thread failed.
+			function(&chunks[i]);
+		}
+	}
+}
+
+// Appends the results array of every chunk to output, in order.
+// T must be trivially copyable.
+template<typename CHUNK, typename T>
+static void appendChunkResults(const Array<CHUNK>& chunks, Array<T> CHUNK::*results, Array<T>& output) {
+	size_t total = output.size();
+	for (const CHUNK& chunk : chunks) {
+		total += (chunk.*results).size();
+	}
+	size_t index = output.size();
+	output.setSize(total);
+	for (const CHUNK& chunk : chunks) {
+		const Array<T>& chunkResults = chunk.*results;
+		const size_t numResults = chunkResults.size();
+		if (numResults != 0) {
+			memcpy(output.data() + index, chunkResults.data(), numResults*sizeof(T));
+		}
+		index += numResults;
+	}
+}
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
@@ -0,0 +1,313 @@
+#include "model/TextSearch.h"
+#include "model/LineArray.h"
+#include "TextScanning.h"
+
+#include <SDL.h>
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Types.h>
+
+#include <string.h>
+#include <emmintrin.h>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+using Position = LineArray::Position;
+
+// Lines are copied out of the LineArray in blocks of about this size,
+// so that the copy stays in cache while it's searched.
+constexpr static size_t SEARCH_BLOCK_SIZE = 64*1024;
+
+static INLINE char toLowerASCII(char c) {
+	return (c >= 'A' && c <= 'Z') ? char(c + ('a' - 'A')) : c;
+}
+
+static INLINE char toUpperASCII(char c) {
+	return (c >= 'a' && c <= 'z') ? char(c - ('a' - 'A')) : c;
+}
+
+// If caseSensitive is false, pattern must already be lowercase.
+static INLINE bool matchesPattern(const char* text, const char* pattern, size_t patternSize, bool caseSensitive) {
+	if (caseSensitive) {
+		return memcmp(text, pattern, patternSize) == 0;
+	}
+	for (size_t i = 0; i < patternSize; ++i) {
+		if (toLowerASCII(text[i]) != pattern[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Appends the offset of every non-overlapping match of pattern in text to
+// offsets.  Only positions where both the first and last bytes of the pattern
+// match are compared in full, and those are found 16 at a time using SSE2,
+// so most of the text is only looked at twice.
+static void findInText(
+	const char* text,
+	size_t size,
+	const char* pattern,
+	size_t patternSize,
+	bool caseSensitive,
+	Array<size_t>& offsets
+) {
+	assert(patternSize != 0);
+	if (size < patternSize) {
+		return;
+	}
+	const size_t numStarts = size - patternSize + 1;
+	const char first = pattern[0];
+	const char last = pattern[patternSize-1];
+	const char firstOther = caseSensitive ? first : toUpperASCII(first);
+	const char lastOther = caseSensitive ? last : toUpperASCII(last);
+	const __m128i firstBytes = _mm_set1_epi8(first);
+	const __m128i firstOtherBytes = _mm_set1_epi8(firstOther);
+	const __m128i lastBytes = _mm_set1_epi8(last);
+	const __m128i lastOtherBytes = _mm_set1_epi8(lastOther);
+
+	// Matches can't overlap, so a match can't start before this.
+	size_t nextStart = 0;
+	size_t start = 0;
+	for (; start + 16 <= numStarts; start += 16) {
+		const __m128i firstCandidates = _mm_loadu_si128((const __m128i*)(text + start));
+		const __m128i lastCandidates = _mm_loadu_si128((const __m128i*)(text + start + patternSize-1));
+		const __m128i firstMatches = _mm_or_si128(_mm_cmpeq_epi8(firstCandidates, firstBytes), _mm_cmpeq_epi8(firstCandidates, firstOtherBytes));
+		const __m128i lastMatches = _mm_or_si128(_mm_cmpeq_epi8(lastCandidates, lastBytes), _mm_cmpeq_epi8(lastCandidates, lastOtherBytes));
+		uint32 mask = uint32(_mm_movemask_epi8(_mm_and_si128(firstMatches, lastMatches)));
+		while (mask != 0) {
+			const size_t candidate = start + lowestBitIndex(mask);
+			// Clear the lowest set bit.
+			mask &= mask - 1;
+			if (candidate >= nextStart && matchesPattern(text + candidate, pattern, patternSize, caseSensitive)) {
+				offsets.append(candidate);
+				nextStart = candidate + patternSize;
+			}
+		}
+	}
+	if (start < nextStart) {
+		start = nextStart;
+	}
+	while (start < numStarts) {
+		if (matchesPattern(text + start, pattern, patternSize, caseSensitive)) {
+			offsets.append(start);
+			start += patternSize;
+		}
+		else {
+			++start;
+		}
+	}
+}
+
+// Returns the index of the first match at or after position.
+static size_t lowerBound(const Array<Position>& matches, const Position& position) {
+	size_t begin = 0;
+	size_t end = matches.size();
+	while (begin < end) {
+		const size_t mid = begin + (end-begin)/2;
+		const Position& match = matches[mid];
+		if (match.line < position.line || (match.line == position.line && match.col < position.col)) {
+			begin = mid+1;
+		}
+		else {
+			end = mid;
+		}
+	}
+	return begin;
+}
+
+void TextSearch::setPattern(const char* patternBegin, const char* patternEnd, bool newCaseSensitive) {
+	assert(memchr(patternBegin, '\n', patternEnd - patternBegin) == nullptr);
+	const size_t size = patternEnd - patternBegin;
+	pattern.setSize(size);
+	for (size_t i = 0; i < size; ++i) {
+		pattern[i] = newCaseSensitive ? patternBegin[i] : toLowerASCII(patternBegin[i]);
+	}
+	caseSensitive = newCaseSensitive;
+	matches.setSize(0);
+}
+
+void TextSearch::findInLines(const LineArray& lineArray, size_t beginLine, size_t endLine, Array<Position>& lineMatches) const {
+	const size_t patternSize = pattern.size();
+	if (patternSize == 0) {
+		return;
+	}
+	Array<char> text;
+	Array<size_t> lineSizes;
+	Array<size_t> offsets;
+	size_t line = beginLine;
+	while (line < endLine) {
+		// Copy whole lines until the block is large enough.  Matches can't
+		// contain line breaks, so none can cross from one block to the next.
+		const size_t blockBeginLine = line;
+		size_t blockSize = 0;
+		lineSizes.setSize(0);
+		do {
+			const size_t lineSize = lineArray.getLineSize(line);
+			lineSizes.append(lineSize);
+			blockSize += lineSize + 1;
+			++line;
+		} while (line < endLine && blockSize < SEARCH_BLOCK_SIZE);
+
+		text.setSize(0);
+		lineArray.getText(Position{blockBeginLine, 0}, Position{line-1, lineSizes.last()}, text);
+		offsets.setSize(0);
+		findInText(text.data(), text.size(), pattern.data(), patternSize, caseSensitive, offsets);
+
+		// The offsets are in increasing order, so walk forward through the lines.
+		size_t lineIndex = 0;
+		size_t lineBeginOffset = 0;
+		for (size_t offset : offsets) {
+			while (offset > lineBeginOffset + lineSizes[lineIndex]) {
+				lineBeginOffset += lineSizes[lineIndex] + 1;
+				++lineIndex;
+			}
+			lineMatches.append(Position{blockBeginLine + lineIndex, offset - lineBeginOffset});
+		}
+	}
+}
+
+struct SearchChunk {
+	const TextSearch* search;
+	const LineArray* lineArray;
+	size_t beginLine;
+	size_t endLine;
+	Array<Position> matches;
+};
+
+static int searchThreadFunction(void* data) {
+	SearchChunk& chunk = *(SearchChunk*)data;
+	chunk.search->findInLines(*chunk.lineArray, chunk.beginLine, chunk.endLine, chunk.matches);
+	return 0;
+}
+
+void TextSearch::findAll(const LineArray& lineArray) {
+	matches.setSize(0);
+	if (pattern.size() == 0) {
+		return;
+	}
+	const size_t numLines = lineArray.getNumLines();
+	const size_t totalSize = lineArray.getTotalSize();
+	const size_t numChunks = getNumParallelChunks(totalSize);
+	if (numChunks <= 1) {
+		findInLines(lineArray, 0, numLines, matches);
+		return;
+	}
+
+	// Split at lines, so that no match crosses from one chunk to the next,
+	// with roughly the same amount of text in each chunk.
+	Array<SearchChunk> chunks;
+	chunks.setSize(numChunks);
+	size_t beginLine = 0;
+	for (size_t i = 0; i < numChunks; ++i) {
+		SearchChunk& chunk = chunks[i];
+		chunk.search = this;
+		chunk.lineArray = &lineArray;
+		chunk.beginLine = beginLine;
+		if (i == numChunks-1) {
+			chunk.endLine = numLines;
+		}
+		else {
+			const size_t endLine = lineArray.offsetToPosition((totalSize*(i+1))/numChunks).line;
+			chunk.endLine = (endLine > beginLine) ? endLine : beginLine;
+		}
+		beginLine = chunk.endLine;
+	}
+	runChunksInParallel(chunks, searchThreadFunction, "Text Search Thread");
+
+	// The chunks are in order, so the matches are too.
+	appendChunkResults(chunks, &SearchChunk::matches, matches);
+}
+
+void TextSearch::update(
+	const LineArray& lineArray,
+	const Position& begin,
+	const Position& oldEnd,
+	const Position& newEnd
+) {
+	if (pattern.size() == 0) {
+		return;
+	}
+	// Matches are within lines, so only matches in the edited lines changed,
+	// and the later ones just moved by the change in the number of lines.
+	const size_t beginIndex = lowerBound(matches, Position{begin.line, 0});
+	const size_t endIndex = lowerBound(matches, Position{oldEnd.line+1, 0});
+	Array<Position> newMatches;
+	findInLines(lineArray, begin.line, newEnd.line+1, newMatches);
+
+	const size_t numOldMatches = endIndex - beginIndex;
+	const size_t numNewMatches = newMatches.size();
+	const size_t numAfter = matches.size() - endIndex;
+	if (numNewMatches > numOldMatches) {
+		matches.setSize(matches.size() + (numNewMatches - numOldMatches));
+		memmove(matches.data() + beginIndex + numNewMatches, matches.data() + endIndex, numAfter*sizeof(Position));
+	}
+	else if (numNewMatches < numOldMatches) {
+		memmove(matches.data() + beginIndex + numNewMatches, matches.data() + endIndex, numAfter*sizeof(Position));
+		matches.setSize(matches.size() - (numOldMatches - numNewMatches));
+	}
+	if (numNewMatches != 0) {
+		memcpy(matches.data() + beginIndex, newMatches.data(), numNewMatches*sizeof(Position));
+	}
+
+	if (newEnd.line != oldEnd.line) {
+		// Unsigned wrapping makes this correct even if lines were removed.
+		const size_t lineChange = newEnd.line - oldEnd.line;
+		for (size_t i = beginIndex + numNewMatches; i < matches.size(); ++i) {
+			matches[i].line += lineChange;
+		}
+	}
+}
+
+// Returns the position after text that has '\n' between lines, if it started at begin.
+static Position findTextEnd(Position begin, const char* text, const char* const textEnd) {
+	while (text != textEnd) {
+		const char* lineBreak = (const char*)memchr(text, '\n', textEnd - text);
+		if (lineBreak == nullptr) {
+			begin.col += textEnd - text;
+			break;
+		}
+		++begin.line;
+		begin.col = 0;
+		text = lineBreak + 1;
+	}
+	return begin;
+}
+
+void TextSearch::update(const TextBatchReplacementEvent& undoEvent) {
+	// The ranges are in order, so updating for them from first to last means
+	// that the matches before each range are already at their final lines,
+	// and the ones after it are only offset by the lines added or removed
+	// by the earlier ranges, the same as the range's old end.
+	const char* const previousText = undoEvent.previousText.data();
+	size_t previousTextBegin = 0;
+	for (const TextBatchReplacementEvent::Range& range : undoEvent.ranges) {
+		const Position oldEnd = findTextEnd(range.begin, previousText + previousTextBegin, previousText + range.previousTextEnd);
+		update(*undoEvent.lineArray, range.begin, oldEnd, range.end);
+		previousTextBegin = range.previousTextEnd;
+	}
+}
+
+void TextSearch::removeFirstLines(size_t numLines) {
+	if (numLines == 0) {
+		return;
+	}
+	const size_t numRemoved = lowerBound(matches, Position{numLines, 0});
+	const size_t numRemaining = matches.size() - numRemoved;
+	for (size_t i = 0; i < numRemaining; ++i) {
+		matches[i] = Position{matches[numRemoved + i].line - numLines, matches[numRemoved + i].col};
+	}
+	matches.setSize(numRemaining);
+}
+
+bool TextSearch::findNext(const Position& position, size_t& matchIndex) const {
+	const size_t index = lowerBound(matches, position);
+	if (index == matches.size()) {
+		return false;
+	}
+	matchIndex = index;
+	return true;
+}
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
@@ -115,7 +115,7 @@ void ImageButton::onMouseDown(UIBox& box, size_t button, const MouseState& state
 	assert(box.type != nullptr);
 	ImageButton& imageButton = static_cast<ImageButton&>(box);
 	imageButton.isMouseDown = true;
-	setNeedRedraw();
+	invalidateBox(imageButton);
 }
 
 void ImageButton::onMouseUp(UIBox& box, size_t button, const MouseState& state) {
@@ -125,21 +125,21 @@ void ImageButton::onMouseUp(UIBox& box, size_t button, const MouseState& state)
 	if (imageButton.isMouseInside && imageButton.actionCallback != nullptr) {
 		imageButton.actionCallback(imageButton);
 	}
-	setNeedRedraw();
+	invalidateBox(imageButton);
 }
 
 void ImageButton::onMouseEnter(UIBox& box, const MouseState& state) {
 	assert(box.type != nullptr);
 	ImageButton& imageButton = static_cast<ImageButton&>(box);
 	imageButton.isMouseInside = true;
-	setNeedRedraw();
+	invalidateBox(imageButton);
 }
 
 void ImageButton::onMouseExit(UIBox& box, const MouseState& state) {
 	assert(box.type != nullptr);
 	ImageButton& imageButton = static_cast<ImageButton&>(box);
 	imageButton.isMouseInside = false;
-	setNeedRedraw();
+	invalidateBox(imageButton);
 }
 
 void ImageButton::draw(const UIBox& box, const Box2f& clipRectangle, const Box2f& targetRectangle,Canvas& target) {
@@ -158,7 +158,7 @@ void ImageButton::draw(const UIBox& box, const Box2f& clipRectangle, const Box2f
 	else {
 		image = &button.downImage;
 	}
-	target.image.applyImage(targetRectangle, *image, clipRectangle);
+	target.applyImage(targetRectangle, *image, clipRectangle);
 }
 
 UIBoxClass ImageButton::initClass() {
@@ -0,0 +1,132 @@
+#include "widgets/ScrollContainer.h"
+#include "MainWindow.h"
+
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Types.h>
+
+#include <math.h>
+#include <string.h>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+// UILoop divides mouse wheel movements by 120, so this is one notch.
+constexpr static float WHEEL_NOTCH_SCROLL_AMOUNT = 1.0f/120.0f;
+
+ScrollContainer::ScrollContainer() :
+	UIContainer(&staticType),
+	scrollPosition(0,0),
+	contentSize(0,0),
+	scrollDistancePerNotch(60)
+{}
+
+UIBox* ScrollContainer::construct() {
+	return new ScrollContainer();
+}
+
+void ScrollContainer::scrollTo(const Vec2f& position) {
+	Vec2f newPosition;
+	for (size_t axis = 0; axis < 2; ++axis) {
+		float maxScroll = contentSize[axis] - size[axis];
+		if (!(maxScroll > 0)) {
+			maxScroll = 0;
+		}
+		float value = roundf(position[axis]);
+		if (value > maxScroll) {
+			value = floorf(maxScroll);
+		}
+		if (!(value > 0)) {
+			value = 0;
+		}
+		newPosition[axis] = value;
+	}
+	if (newPosition == scrollPosition) {
+		return;
+	}
+
+	// Scrolling right moves the contents left, and scrolling down
+	// moves the contents up, since the y axis points up.
+	const Vec2f offset(scrollPosition[0] - newPosition[0], newPosition[1] - scrollPosition[1]);
+	scrollPosition = newPosition;
+	for (size_t i = 0, n = children.size(); i < n; ++i) {
+		UIBox& child = *children[i];
+		child.origin = child.origin + offset;
+		childBoundsChanged(i);
+	}
+	scrollBoxContents(*this, offset);
+}
+
+void ScrollContainer::onMouseScroll(UIBox& box, float scrollAmount, const MouseState& state) {
+	assert(box.type != nullptr);
+	ScrollContainer& container = static_cast<ScrollContainer&>(box);
+
+	const Vec2f previousPosition = container.scrollPosition;
+	const float distance = (scrollAmount/WHEEL_NOTCH_SCROLL_AMOUNT)*container.scrollDistancePerNotch;
+	container.scrollTo(Vec2f(previousPosition[0], previousPosition[1] - distance));
+
+	if (container.scrollPosition == previousPosition) {
+		// Already scrolled as far as possible, so let the child under the mouse
+		// handle it, e.g. if it contains something else that scrolls.
+		UIContainer::onMouseScroll(box, scrollAmount, state);
+		return;
+	}
+
+	// Different children are now under the mouse, so mouse focus may have changed,
+	// unless a button is down, in which case mouse focus stays unchanged.
+	if (state.buttonsDown == 0) {
+		updateMouseFocusIndex(container, state);
+	}
+}
+
+// The data saved by writeData, after the data common to all containers.
+struct ScrollContainerData {
+	float scrollPosition[2];
+	float contentSize[2];
+	float scrollDistancePerNotch;
+};
+
+void ScrollContainer::writeData(const UIBox& box, Array<uint8>& output) {
+	const ScrollContainer& container = static_cast<const ScrollContainer&>(box);
+	const ScrollContainerData data{
+		{container.scrollPosition[0], container.scrollPosition[1]},
+		{container.contentSize[0], container.contentSize[1]},
+		container.scrollDistancePerNotch
+	};
+	const size_t start = output.size();
+	output.setSize(start + sizeof(data));
+	memcpy(output.data() + start, &data, sizeof(data));
+}
+
+bool ScrollContainer::readData(UIBox& box, const uint8* bytes, size_t size) {
+	ScrollContainer& container = static_cast<ScrollContainer&>(box);
+	ScrollContainerData data;
+	if (size != sizeof(data)) {
+		return false;
+	}
+	memcpy(&data, bytes, sizeof(data));
+	// The children were saved at their scrolled positions, so this doesn't move them.
+	container.scrollPosition = Vec2f(data.scrollPosition[0], data.scrollPosition[1]);
+	container.contentSize = Vec2f(data.contentSize[0], data.contentSize[1]);
+	container.scrollDistancePerNotch = data.scrollDistancePerNotch;
+	return true;
+}
+
+UIContainerClass ScrollContainer::initClass() {
+	UIContainerClass c(UIContainer::initClass());
+	c.typeName = "ScrollContainer";
+	c.construct = &construct;
+	c.onMouseScroll = &onMouseScroll;
+	c.writeData = &writeData;
+	c.readData = &readData;
+	// The children are positioned by the user and moved by scrolling,
+	// so the layout engine doesn't position them.
+	c.measure = nullptr;
+	c.layout = nullptr;
+	return c;
+}
+
+const UIContainerClass ScrollContainer::staticType(ScrollContainer::initClass());
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END
@@ -0,0 +1,280 @@
+#include "widgets/VirtualList.h"
+#include "MainWindow.h"
+
+#include <Array.h>
+#include <ArrayDef.h>
+#include <Types.h>
+
+#include <string.h>
+
+OUTER_NAMESPACE_BEGIN
+UICOMMON_LIBRARY_NAMESPACE_BEGIN
+
+// UILoop divides mouse wheel movements by 120, so this is one notch.
+constexpr static float WHEEL_NOTCH_SCROLL_AMOUNT = 1.0f/120.0f;
+
+VirtualList::VirtualList() :
+	UIContainer(&staticType),
+	createRow(nullptr),
+	bindRow(nullptr),
+	callbackData(nullptr),
+	scrollPosition(0),
+	rowsPerWheelNotch(3),
+	defaultRowHeight(20),
+	firstChildRow(0)
+{}
+
+UIBox* VirtualList::construct() {
+	return new VirtualList();
+}
+
+void VirtualList::destruct(UIBox* box) {
+	assert(box->type != nullptr);
+	VirtualList* list = static_cast<VirtualList*>(box);
+	list->recycledRows.setCapacity(0);
+	list->rowHeights.setCapacity(0);
+	list->rowOffsets.clear();
+	UIContainer::staticType.destruct(box);
+}
+
+// Moves the rows to match the new scroll position, moving the pixels of the
+// rows that stay visible, instead of redrawing them.
+void VirtualList::scrollRows(float position) {
+	const float previousPosition = scrollPosition;
+	scrollPosition = position;
+	updateRows(false);
+	// Scrolling down moves the rows up, (toward positive y).
+	const float offset = scrollPosition - previousPosition;
+	if (offset != 0) {
+		scrollBoxContents(*this, Vec2f(0, offset));
+	}
+}
+
+void VirtualList::setNumRows(size_t numRows) {
+	rowHeights.setSize(numRows);
+	for (size_t i = 0; i < numRows; ++i) {
+		rowHeights[i] = defaultRowHeight;
+	}
+	rowOffsets.buildUniform(numRows, defaultRowHeight);
+	scrollPosition = 0;
+	rowsChanged();
+}
+
+void VirtualList::appendRow(float height) {
+	rowHeights.append(height);
+	rowOffsets.append(height);
+	updateVisibleRows();
+}
+
+void VirtualList::setRowHeight(size_t rowIndex, float height) {
+	assert(rowIndex < rowHeights.size());
+	rowOffsets.add(rowIndex, height - rowHeights[rowIndex]);
+	rowHeights[rowIndex] = height;
+	updateVisibleRows();
+}
+
+void VirtualList::scrollTo(float position) {
+	scrollRows(position);
+}
+
+void VirtualList::updateRows(bool rebindAll) {
+	const size_t numRows = rowHeights.size();
+	const float viewHeight = size[1];
+
+	// Limit the scroll position to the content.
+	float maxScroll = getContentHeight() - viewHeight;
+	if (!(maxScroll > 0)) {
+		maxScroll = 0;
+	}
+	if (scrollPosition > maxScroll) {
+		scrollPosition = maxScroll;
+	}
+	if (!(scrollPosition > 0)) {
+		scrollPosition = 0;
+	}
+
+	// Find the range of visible rows.  Only the first needs a search,
+	// since the rest are found by adding the heights of visible rows.
+	const size_t newFirst = findRowAtOffset(scrollPosition);
+	const float firstOffset = (newFirst < numRows) ? getRowOffset(newFirst) : 0;
+	size_t newEnd = newFirst;
+	// No rows can be shown until there's a way to create them.
+	if (createRow != nullptr) {
+		const float viewEnd = scrollPosition + viewHeight;
+		for (float offset = firstOffset; newEnd < numRows && offset < viewEnd; ++newEnd) {
+			offset += rowHeights[newEnd];
+		}
+	}
+
+	const size_t oldFirst = firstChildRow;
+	const size_t numOldChildren = children.size();
+
+	// Keep the focus indices on the same rows, if they're still visible.
+	if (keyFocusIndex != INVALID_INDEX) {
+		const size_t row = oldFirst + keyFocusIndex;
+		keyFocusIndex = (row >= newFirst && row < newEnd) ? (row - newFirst) : INVALID_INDEX;
+		// Even if the row is still visible, it may be a different child.
+		markAcceleratorsChanged();
+	}
+	if (mouseFocusIndex != INVALID_INDEX) {
+		const size_t row = oldFirst + mouseFocusIndex;
+		if (row >= newFirst && row < newEnd) {
+			mouseFocusIndex = row - newFirst;
+		}
+		else {
+			UIBox& child = *children[mouseFocusIndex];
+			auto childOnMouseExit = child.type->onMouseExit;
+			if (childOnMouseExit != nullptr) {
+				// The position isn't known here, so use one outside the row.
+				const MouseState exitState{Vec2f(-1,-1), 0};
+				(*childOnMouseExit)(child, exitState);
+			}
+			mouseFocusIndex = INVALID_INDEX;
+		}
+	}
+
+	// Recycle the children of rows that are no longer visible first,
+	// so that they can be reused for rows that have become visible.
+	Array<std::unique_ptr<UIBox>> newChildren;
+	newChildren.setSize(newEnd - newFirst);
+	for (size_t i = 0; i < numOldChildren; ++i) {
+		const size_t row = oldFirst + i;
+		if (row >= newFirst && row < newEnd) {
+			newChildren[row - newFirst] = std::move(children[i]);
+			if (rebindAll && bindRow != nullptr) {
+				bindRow(*this, *newChildren[row - newFirst], row);
+			}
+		}
+		else {
+			recycledRows.append(std::move(children[i]));
+		}
+	}
+
+	// The y axis points up, so the first row is at the top, and each row
+	// is below the previous one.
+	float top = size[1] - (firstOffset - scrollPosition);
+	children.setSize(newEnd - newFirst);
+	for (size_t row = newFirst; row < newEnd; ++row) {
+		std::unique_ptr<UIBox>& child = newChildren[row - newFirst];
+		if (!child) {
+			if (recycledRows.size() != 0) {
+				child = std::move(recycledRows.last());
+				recycledRows.setSize(recycledRows.size()-1);
+			}
+			else {
+				child.reset(createRow(*this));
+			}
+			child->parent = this;
+			if (bindRow != nullptr) {
+				bindRow(*this, *child, row);
+			}
+		}
+
+		const Vec2f rowOrigin(0, top - rowHeights[row]);
+		const Vec2f rowSize(size[0], rowHeights[row]);
+		if (rowOrigin != child->origin || rowSize != child->size) {
+			const Vec2f prevOrigin = child->origin;
+			const Vec2f prevSize = child->size;
+			child->origin = rowOrigin;
+			child->size = rowSize;
+			if (rowSize != prevSize && child->type->isContainer) {
+				markChildLayoutDirty(static_cast<UIContainer&>(*child));
+			}
+			auto onResize = child->type->onResize;
+			if (onResize != nullptr) {
+				onResize(*child, prevOrigin, prevSize);
+			}
+		}
+		top -= rowHeights[row];
+
+		children[row - newFirst] = std::move(child);
+	}
+
+	firstChildRow = newFirst;
+	childrenChanged();
+}
+
+void VirtualList::rowsChanged() {
+	updateRows(true);
+	invalidateBox(*this);
+}
+
+void VirtualList::updateVisibleRows() {
+	updateRows(false);
+	invalidateBox(*this);
+}
+
+void VirtualList::onMouseScroll(UIBox& box, float scrollAmount, const MouseState& state) {
+	assert(box.type != nullptr);
+	VirtualList& list = static_cast<VirtualList&>(box);
+
+	const float previousPosition = list.scrollPosition;
+	const float distance = (scrollAmount/WHEEL_NOTCH_SCROLL_AMOUNT)*list.rowsPerWheelNotch*list.defaultRowHeight;
+	list.scrollRows(list.scrollPosition - distance);
+
+	if (list.scrollPosition == previousPosition) {
+		// Already scrolled as far as possible, so let the row under the mouse
+		// handle it, e.g. if it contains something else that scrolls.
+		UIContainer::onMouseScroll(box, scrollAmount, state);
+		return;
+	}
+
+	// Different rows are now under the mouse, so mouse focus may have changed,
+	// unless a button is down, in which case mouse focus stays unchanged.
+	if (state.buttonsDown == 0) {
+		updateMouseFocusIndex(list, state);
+	}
+}
+
+void VirtualList::layout(UIContainer& container) {
+	assert(container.type != nullptr);
+	VirtualList& list = static_cast<VirtualList&>(container);
+	list.updateVisibleRows();
+}
+
+// The data saved by writeData.  The rows themselves aren't saved, since
+// the list starts with no rows, so any children saved with the list are
+// recycled for use as rows once there are rows.
+struct VirtualListData {
+	float rowsPerWheelNotch;
+	float defaultRowHeight;
+};
+
+void VirtualList::writeData(const UIBox& box, Array<uint8>& output) {
+	const VirtualList& list = static_cast<const VirtualList&>(box);
+	const VirtualListData data{list.rowsPerWheelNotch, list.defaultRowHeight};
+	const size_t start = output.size();
+	output.setSize(start + sizeof(data));
+	memcpy(output.data() + start, &data, sizeof(data));
+}
+
+bool VirtualList::readData(UIBox& box, const uint8* bytes, size_t size) {
+	VirtualList& list = static_cast<VirtualList&>(box);
+	VirtualListData data;
+	if (size != sizeof(data)) {
+		return false;
+	}
+	memcpy(&data, bytes, sizeof(data));
+	list.rowsPerWheelNotch = data.rowsPerWheelNotch;
+	list.defaultRowHeight = data.defaultRowHeight;
+	return true;
+}
+
+UIContainerClass VirtualList::initClass() {
+	UIContainerClass c(UIContainer::initClass());
+	c.typeName = "VirtualList";
+	c.construct = &construct;
+	c.destruct = &destruct;
+	c.onMouseScroll = &onMouseScroll;
+	c.writeData = &writeData;
+	c.readData = &readData;
+	// The size doesn't depend on the rows, only on layoutParams.
+	c.measure = nullptr;
+	c.layout = &layout;
+	return c;
+}
+
+const UIContainerClass VirtualList::staticType(VirtualList::initClass());
+
+UICOMMON_LIBRARY_NAMESPACE_END
+OUTER_NAMESPACE_END